@@ -0,0 +1,1040 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Differential check of the optimized kernels against the reference
+// implementation (reference.h), on randomized states.
+
+// 1. Single collisions. Random pairs of bodies (with unequal radii) in
+//    contact, and random bodies touching each wall, are bounced by both
+//    implementations. The resulting velocities and angular velocities must
+//    agree, and the optimized bounce must conserve momentum and energy, and
+//    wall_bounce energy.
+// 2. Whole steps. Models are started with random settings and window sizes
+//    and run for a while, during which objects are added and removed at
+//    random (after each change, kdtree_index and object_order must still be
+//    permutations of the objects). Then, for each of several steps, the
+//    optimized step (the kd-tree phases, advance_linear, advance_angular) and
+//    the reference step start from the same state, and every object's
+//    position, velocity, angular velocity and rotation (as a matrix) must
+//    agree. The modelview matrices from compute are checked too, and momentum
+//    and energy must be conserved by the object collisions and energy by the
+//    wall collisions.
+// 3. Checkpoints. A model is started afresh, saving a checkpoint, and
+//    another (with a different seed) is started from the checkpoint, with
+//    "exact" (see model_t::start). After running both for some frames,
+//    their positions, velocities, rotations and angular velocities must be
+//    identical.
+// 4. Recordings. A model's frames are recorded, and replayed into another
+//    model, reading straight through and after a seek. Each replayed value
+//    must be within half a quantum (recording.h) of the recorded one, and
+//    the Markov states must be identical. The recording is also replayed
+//    into a model with fewer objects, which is then resized; its
+//    permutations must be intact.
+// 5. Random streams. The four streams of rng4_t (random.h), for several
+//    seeds and stream sets, must match a scalar xorshift128+ seeded and
+//    jumped one step at a time, and rng4_t::jump must give the next set.
+// 6. Uniform blocks. After models of several sizes draw a frame, the colour,
+//    vertex coefficients and snub flag staged for each object (fill.h, four
+//    objects at a time and on several threads) must match the one-object
+//    calculation.
+// 7. Resizes. Models of random settings and sizes are resized to random
+//    sizes, larger and smaller, while running. Afterwards every object must
+//    be inside the new walls, the active count must be that of a model
+//    started at the new size, and the permutations must still be intact.
+// 8. Live settings. Running models are given new random settings through
+//    post_setting (commands.h). Afterwards the active count, the
+//    animation speed, the bump functions and every object's radius, mass
+//    and moment of inertia must be those of a model started with the new
+//    settings, and the squares of the velocities must have been scaled by
+//    the square of the change in the heat factor.
+// 9. Fades. Running models fade objects out and, in the same frame, back
+//    in (as the governor can), then run on with more changes of count. The
+//    counts of objects fading and fading out must match the objects' fades
+//    after every change and every frame, and be zero once the fades are
+//    done.
+
+// Errors are measured relative to a scale for each quantity: velocities
+// relative to the fastest speed (or surface speed) involved, positions
+// relative to distance from the eye, energy and momentum relative to
+// their totals, and rotations relative to |w|^3 (see check_states).
+// The program prints the largest error of each kind with its tolerance, and
+// exits with status 1 if any tolerance is exceeded.
+
+// Usage: check [-seed N] [-pairs N] [-states N] [-steps N]
+//   -seed N    random seed (default 1)
+//   -pairs N   single-collision trials (default 100000)
+//   -states N  started models (default 20)
+//   -steps N   steps checked per model (default 50)
+
+#include "checkpoint.h"
+#include "compiler.h"
+#include "graphics.h"
+#include "hsv-to-rgb.h"
+#include "kdtree.h"
+#include "model.h"
+#include "random-util.h"
+#include "random.h"
+#include "recording.h"
+#include "reference.h"
+#include "rodrigues.h"
+#include "settings.h"
+#include "vector.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <x86intrin.h>
+
+// Access to the model's private state and member kernels.
+struct model_access_t
+{
+  model_t & m;
+  unsigned count () const { return m.count; }
+  unsigned fading () const { return m.fading; }
+  unsigned fading_out () const { return m.fading_out; }
+  unsigned depth () const { return required_depth (m.count); }
+  float (* x () const) [4] { return m.x; }
+  float (* v () const) [4] { return m.v; }
+  float (* u () const) [4] { return m.u; }
+  float (* w () const) [4] { return m.w; }
+  object_t * objects () const { return m.objects; }
+  const unsigned * kdtree_index () const { return m.kdtree_index; }
+  const unsigned * kdtree_aux () const { return m.kdtree_aux; }
+  const unsigned * object_order () const { return m.object_order; }
+  const float (* walls () const) [2] [4] { return m.walls; }
+  const float (* e () const) [4] { return m.e; }
+  const float (* abc () const) [8] [4] { return m.abc; }
+  const bumps_t & bumps () const { return m.bumps; }
+  const step_t & step () const { return m.step; }
+  float animation_speed_constant () const
+  {
+    return m.animation_speed_constant;
+  }
+  void apply_commands () const { m.apply_commands (); }
+  const uniform_buffer_t & uniform_buffer () const
+  {
+    return m.program.uniform_buffer;
+  }
+  void kdtree_search () const
+  {
+    m.frame_arena.reset ();
+    m.kdtree_search ();
+  }
+  void kdtree_build () const { m.kdtree_build (depth ()); }
+  void kdtree_objects () const { m.kdtree_bounce_objects (depth ()); }
+  void kdtree_walls () const { m.kdtree_bounce_walls (depth ()); }
+  void bounce (unsigned ix, unsigned iy) const { m.bounce (ix, iy); }
+  void wall_bounce (unsigned iw, unsigned ix) const { m.wall_bounce (iw, ix); }
+};
+
+namespace
+{
+  // Largest error seen, against a tolerance.
+  struct check_t
+  {
+    const char * name;
+    double tolerance;
+    double worst;
+    unsigned long long count;
+    unsigned long long failures;
+
+    void operator () (double error)
+    {
+      if (error > worst) worst = error;
+      ++ count;
+      if (! (error <= tolerance)) ++ failures;
+    }
+  };
+
+  check_t checks [] = {
+    { "bounce v", 1e-5, 0, 0, 0 },
+    { "bounce w", 1e-5, 0, 0, 0 },
+    { "bounce momentum", 1e-6, 0, 0, 0 },
+    { "bounce energy", 1e-5, 0, 0, 0 },
+    { "wall_bounce v", 1e-5, 0, 0, 0 },
+    { "wall_bounce w", 1e-5, 0, 0, 0 },
+    { "wall_bounce energy", 1e-5, 0, 0, 0 },
+    { "step x", 1e-6, 0, 0, 0 },
+    { "step v", 1e-5, 0, 0, 0 },
+    { "step w", 1e-5, 0, 0, 0 },
+    { "step rotation", 0.1, 0, 0, 0 },
+    { "compute", 1e-5, 0, 0, 0 },
+    { "step momentum", 1e-5, 0, 0, 0 },
+    { "step energy (objects)", 1e-5, 0, 0, 0 },
+    { "step energy (walls)", 1e-5, 0, 0, 0 },
+    { "permutations", 0, 0, 0, 0 },
+    { "checkpoint", 0, 0, 0, 0 },
+    { "recording (quanta)", 0.51, 0, 0, 0 },
+    { "random streams", 0, 0, 0, 0 },
+    { "uniform blocks", 1e-5, 0, 0, 0 },
+    { "resize walls", 1e-4, 0, 0, 0 },
+    { "resize count", 0, 0, 0, 0 },
+    { "settings count", 0, 0, 0, 0 },
+    { "settings animation", 0, 0, 0, 0 },
+    { "settings size", 0, 0, 0, 0 },
+    { "settings heat", 1e-5, 0, 0, 0 },
+    { "fading count", 0, 0, 0, 0 },
+  };
+
+  enum {
+    bounce_v, bounce_w, bounce_momentum, bounce_energy,
+    wall_v, wall_w, wall_energy,
+    step_x, step_v, step_w, step_rotation, step_compute,
+    step_momentum, step_energy_objects, step_energy_walls,
+    permutations, checkpoint, recording, random_streams, uniform_blocks,
+    resize_walls, resize_count,
+    settings_count, settings_animation, settings_size, settings_heat,
+    fading_count,
+  };
+
+  vec3_t get3 (const float (& a) [4])
+  {
+    return { a [0], a [1], a [2] };
+  }
+
+  void set3 (float (& a) [4], vec3_t b)
+  {
+    a [0] = (float) b.x;
+    a [1] = (float) b.y;
+    a [2] = (float) b.z;
+    a [3] = 0.0f;
+  }
+
+  double length (vec3_t a)
+  {
+    return std::sqrt (dot (a, a));
+  }
+
+  vec3_t random_vector (rng_t & rng, float radius)
+  {
+    ALIGNED16 float a [4];
+    store4f (a, get_vector_in_ball (rng, radius));
+    return get3 (a);
+  }
+
+  body_t get_body (const model_access_t & access, unsigned n)
+  {
+    const object_t & A = access.objects () [n];
+    return { get3 (access.x () [n]), get3 (access.v () [n]),
+             get3 (access.u () [n]), get3 (access.w () [n]), A.m, A.l, A.r };
+  }
+
+  void set_body (const model_access_t & access, unsigned n, body_t & B)
+  {
+    object_t & A = access.objects () [n];
+    set3 (access.x () [n], B.x);
+    set3 (access.v () [n], B.v);
+    set3 (access.u () [n], B.u);
+    set3 (access.w () [n], B.w);
+    A.m = (float) B.m;
+    A.l = (float) B.l;
+    A.r = (float) B.r;
+    // Round to the optimized representation.
+    B = get_body (access, n);
+  }
+
+  // A body like those of model_t::start, with radius in [0.5, 1.5).
+  body_t random_body (rng_t & rng)
+  {
+    const double density = 100.0;
+    double r = get_float (rng, 0.5f, 1.5f);
+    return { { 0.0, 0.0, -40.0 }, random_vector (rng, 0.25f),
+             random_vector (rng, 3.14159265f), random_vector (rng, 0.10f),
+             density * r * r, 0.4 * density * (r * r) * (r * r), r };
+  }
+
+  // Angular velocity scale of a body: the speed of its surface.
+  double spin (const body_t & A)
+  {
+    return A.r * length (A.w);
+  }
+
+  void check_pairs (model_access_t access, std::uint64_t seed, unsigned trials)
+  {
+    rng_t rng;
+    rng.initialize (seed);
+    for (unsigned t = 0; t != trials; ++ t) {
+      // Two bodies in contact.
+      body_t A = random_body (rng), B = random_body (rng);
+      vec3_t direction = random_vector (rng, 1.0f);
+      double d = get_float (rng, 0.05f, 0.999f) * (A.r + B.r);
+      B.x = A.x + (d / length (direction)) * direction;
+      set_body (access, 0, A);
+      set_body (access, 1, B);
+
+      double p0 = length (momentum (A) + momentum (B));
+      double scale_p = length (momentum (A)) + length (momentum (B));
+      double E0 = kinetic_energy (A) + kinetic_energy (B);
+      double scale_v = std::fmax (std::fmax (length (A.v), length (B.v)),
+                                  std::fmax (spin (A), spin (B)));
+
+      access.bounce (0, 1);
+      reference_bounce (A, B, usr::balls_friction);
+      body_t A1 = get_body (access, 0), B1 = get_body (access, 1);
+
+      checks [bounce_v] (length (A1.v - A.v) / scale_v);
+      checks [bounce_v] (length (B1.v - B.v) / scale_v);
+      checks [bounce_w] (A.r * length (A1.w - A.w) / scale_v);
+      checks [bounce_w] (B.r * length (B1.w - B.w) / scale_v);
+      vec3_t p1 = momentum (A1) + momentum (B1);
+      checks [bounce_momentum] (std::fabs (length (p1) - p0) / scale_p);
+      double E1 = kinetic_energy (A1) + kinetic_energy (B1);
+      checks [bounce_energy] (std::fabs (E1 - E0) / E0);
+
+      // A body touching a wall.
+      unsigned iw = (unsigned) (rng.get () >> 61) % 6;
+      const float (& wall) [2] [4] = access.walls () [iw];
+      wall_t W = { get3 (wall [0]), get3 (wall [1]) };
+      body_t C = random_body (rng);
+      vec3_t offset = random_vector (rng, 10.0f);
+      offset = offset - dot (offset, W.normal) * W.normal;
+      double s = get_float (rng, -0.5f, 0.999f) * C.r;
+      C.x = W.anchor + offset + s * W.normal;
+      set_body (access, 0, C);
+
+      double E2 = kinetic_energy (C);
+      scale_v = std::fmax (length (C.v), spin (C));
+      access.wall_bounce (iw, 0);
+      reference_wall_bounce (C, W, usr::walls_friction);
+      body_t C1 = get_body (access, 0);
+      checks [wall_v] (length (C1.v - C.v) / scale_v);
+      checks [wall_w] (C.r * length (C1.w - C.w) / scale_v);
+      checks [wall_energy] (std::fabs (kinetic_energy (C1) - E2) / E2);
+    }
+  }
+
+  void totals (const model_access_t & access, vec3_t & p, double & p_scale,
+    double & E)
+  {
+    p = { 0.0, 0.0, 0.0 };
+    p_scale = 0.0;
+    E = 0.0;
+    for (unsigned n = 0; n != access.count (); ++ n) {
+      body_t A = get_body (access, n);
+      p = p + momentum (A);
+      p_scale += length (momentum (A));
+      E += kinetic_energy (A);
+    }
+  }
+
+  // The number of entries of kdtree_index and object_order that are out of
+  // range or repeated.
+  double permutation_errors (const model_access_t & access)
+  {
+    unsigned count = access.count (), errors = 0;
+    const unsigned * permutations [] = {
+      access.kdtree_index (), access.object_order (),
+    };
+    for (const unsigned * permutation : permutations) {
+      std::vector <bool> seen (count);
+      for (unsigned k = 0; k != count; ++ k) {
+        unsigned n = permutation [k];
+        if (n >= count || seen [n]) ++ errors;
+        else seen [n] = true;
+      }
+    }
+    return errors;
+  }
+
+  bool check_states (std::uint64_t seed, unsigned states, unsigned steps)
+  {
+    rng_t rng;
+    rng.initialize (seed);
+    for (unsigned state = 0; state != states; ++ state) {
+      settings_t settings;
+      settings.trackbar_pos [0] = 20 + (unsigned) ((rng.get () >> 32) % 81);
+      for (unsigned k = 1; k != trackbar_count; ++ k) {
+        settings.trackbar_pos [k] = (unsigned) ((rng.get () >> 32) % 101);
+      }
+      int width = 640 + (int) ((rng.get () >> 32) % 1281);
+      int height = 480 + (int) ((rng.get () >> 32) % 601);
+      unsigned warmup = (unsigned) ((rng.get () >> 32) % 200);
+
+      ALIGNED16 model_t model {};
+      model_access_t access { model };
+      model.initialize (rng.get ());
+      if (! model.start (width, height, settings)) {
+        std::fprintf (stderr, "model start failed\n");
+        return false;
+      }
+      // Change the population, between 1 and the initial count (keeping the
+      // density in the usual range).
+      unsigned initial_count = access.count ();
+      for (unsigned n = 0; n != warmup; ++ n) {
+        if (n % 16 == 15) {
+          std::uint64_t r = rng.get () >> 32;
+          unsigned new_count = 1 + (unsigned) ((r * initial_count) >> 32);
+          if (! model.set_count (new_count)) {
+            std::fprintf (stderr, "out of memory\n");
+            return false;
+          }
+          checks [permutations] (permutation_errors (access));
+        }
+        model.draw_next ();
+      }
+
+      unsigned count = access.count ();
+      std::vector <body_t> bodies (count);
+      std::vector <unsigned> index (count), order (count), identity (count);
+      for (unsigned n = 0; n != count; ++ n) identity [n] = n;
+      std::size_t stride = 64;
+      std::vector <float> buffer (16 * count);
+
+      wall_t walls [6];
+      for (unsigned k = 0; k != 6; ++ k) {
+        walls [k] = { get3 (access.walls () [k] [0]),
+                      get3 (access.walls () [k] [1]) };
+      }
+
+      for (unsigned step = 0; step != steps; ++ step) {
+        for (unsigned n = 0; n != count; ++ n) {
+          bodies [n] = get_body (access, n);
+        }
+        double scale_v = 0.0;
+        for (const body_t & A : bodies) {
+          scale_v = std::fmax (scale_v, std::fmax (length (A.v), spin (A)));
+        }
+
+        // Optimized step, with conservation checks around the phases.
+        vec3_t p0, p1, p2;
+        double p_scale, E0, E1, E2;
+        access.kdtree_build ();
+        totals (access, p0, p_scale, E0);
+        access.kdtree_objects ();
+        totals (access, p1, p_scale, E1);
+        access.kdtree_walls ();
+        totals (access, p2, p_scale, E2);
+        checks [step_momentum] (length (p1 - p0) / p_scale);
+        checks [step_energy_objects] (std::fabs (E1 - E0) / E0);
+        checks [step_energy_walls] (std::fabs (E2 - E1) / E1);
+        std::memcpy (index.data (), access.kdtree_index (),
+          count * sizeof (unsigned));
+        std::memcpy (order.data (), access.kdtree_aux (),
+          count * sizeof (unsigned));
+        advance_linear (access.x (), access.v (), count);
+        advance_angular (access.u (), access.w (), count);
+
+        reference_step (bodies.data (), count, walls, index.data (),
+          order.data (), usr::balls_friction, usr::walls_friction);
+
+        compute ((char *) buffer.data (), stride, access.x (), access.u (),
+          identity.data (), count);
+        for (unsigned n = 0; n != count; ++ n) {
+          const body_t & A = bodies [n];
+          body_t B = get_body (access, n);
+          checks [step_x] (length (B.x - A.x) / (1.0 + length (A.x)));
+          checks [step_v] (length (B.v - A.v) / scale_v);
+          checks [step_w] (A.r * length (B.w - A.w) / scale_v);
+
+          double R [3] [3], S [3] [3];
+          reference_rotation (A.u, R);
+          reference_rotation (B.u, S);
+          double f [16];
+          reference_modelview (B, f);
+          double rotation = 0.0, matrix = 0.0;
+          for (unsigned i = 0; i != 3; ++ i) {
+            for (unsigned j = 0; j != 3; ++ j) {
+              double e = std::fabs (R [i] [j] - S [i] [j]);
+              rotation = std::fmax (rotation, e);
+            }
+          }
+          for (unsigned i = 0; i != 16; ++ i) {
+            double e = std::fabs (buffer [16 * n + i] - f [i]);
+            if (i >= 12) e /= 1.0 + std::fabs (f [i]);
+            matrix = std::fmax (matrix, e);
+          }
+          // advance_angular uses a second-order method (bch2), so the
+          // rotation is only accurate to the order of |w|^3.
+          double w1 = length (bodies [n].w);
+          checks [step_rotation] (rotation / (1e-4 + w1 * w1 * w1));
+          checks [step_compute] (matrix);
+        }
+      }
+    }
+    return true;
+  }
+
+  // Start a model afresh (saving a checkpoint) and one from the checkpoint,
+  // run both, and compare them bit for bit.
+  bool check_checkpoint (std::uint64_t seed, unsigned steps)
+  {
+    if constexpr (! CHECKPOINTS_ENABLED) return true;
+    const char * directory = std::getenv ("TMPDIR");
+    if (! directory || ! * directory) directory = "/tmp";
+    char path [4096];
+    std::snprintf (path, sizeof path, "%s/check-%ld.ckpt", directory,
+      (long) ::getpid ());
+    const settings_t settings_list [] = {
+      { { 50, 50, 50, 50 } }, { { 100, 75, 25, 0 } }, { { 20, 10, 90, 100 } },
+    };
+    for (const settings_t & settings : settings_list) {
+      ::unlink (path);
+      ALIGNED16 model_t a {};
+      ALIGNED16 model_t b {};
+      a.initialize (seed);
+      b.initialize (seed + 1);
+      if (! a.start (800, 600, settings, path, true)
+          || ! b.start (800, 600, settings, path, true)) {
+        std::fprintf (stderr, "model start failed\n");
+        ::unlink (path);
+        return false;
+      }
+      for (unsigned step = 0; step != steps; ++ step) {
+        a.draw_next ();
+        b.draw_next ();
+      }
+      model_access_t A { a }, B { b };
+      unsigned count = A.count ();
+      checks [checkpoint] (count != B.count ());
+      if (count != B.count ()) continue;
+      std::size_t size = count * sizeof (float [4]);
+      checks [checkpoint] (!! std::memcmp (A.x (), B.x (), size));
+      checks [checkpoint] (!! std::memcmp (A.v (), B.v (), size));
+      checks [checkpoint] (!! std::memcmp (A.u (), B.u (), size));
+      checks [checkpoint] (!! std::memcmp (A.w (), B.w (), size));
+    }
+    ::unlink (path);
+    return true;
+  }
+
+#if RECORDING_ENABLED
+  // The recorded values of a frame.
+  struct snapshot_t
+  {
+    unsigned count;
+    std::vector <float> values;  // [count] [recording_plane_count]
+    std::vector <unsigned> states;
+
+    void take (model_access_t access)
+    {
+      count = access.count ();
+      values.resize (count * recording_plane_count);
+      states.resize (count);
+      for (unsigned n = 0; n != count; ++ n) {
+        get (access, n, & values [n * recording_plane_count]);
+        states [n] = pack_state (access.objects () [n]);
+      }
+    }
+
+    static void get (model_access_t access, unsigned n, float * v)
+    {
+      for (unsigned k = 0; k != 3; ++ k) {
+        v [plane_x0 + k] = access.x () [n] [k];
+        v [plane_u0 + k] = access.u () [n] [k];
+      }
+      const object_t & A = access.objects () [n];
+      v [plane_hue] = A.hue;
+      v [plane_time] = A.animation_time;
+      v [plane_r] = A.r;
+      v [plane_state] = 0.0f;
+    }
+
+    void compare (model_access_t access, const recording_header_t & header)
+      const
+    {
+      if (access.count () != count) {
+        checks [recording] (65536.0);
+        return;
+      }
+      double worst = 0.0;
+      for (unsigned n = 0; n != count; ++ n) {
+        float v [recording_plane_count];
+        get (access, n, v);
+        for (unsigned k = 0; k != plane_state; ++ k) {
+          double e = std::fabs (v [k] - values [n * recording_plane_count + k])
+            / header.step [k];
+          worst = std::fmax (worst, e);
+        }
+        if (pack_state (access.objects () [n]) != states [n]) worst = 65536.0;
+      }
+      checks [recording] (worst);
+    }
+  };
+#endif
+
+  // Record a model's frames, and replay them into another model.
+  bool check_recording (std::uint64_t seed, unsigned steps)
+  {
+#if RECORDING_ENABLED
+    const char * directory = std::getenv ("TMPDIR");
+    if (! directory || ! * directory) directory = "/tmp";
+    char path [4096];
+    std::snprintf (path, sizeof path, "%s/check-%ld.pmr", directory,
+      (long) ::getpid ());
+    settings_t settings { { 50, 50, 50, 50 } };
+    ALIGNED16 model_t a {};
+    ALIGNED16 model_t b {};
+    a.initialize (seed);
+    b.initialize (seed);
+    if (! a.start (800, 600, settings) || ! b.start (800, 600, settings)) {
+      std::fprintf (stderr, "model start failed\n");
+      return false;
+    }
+    recording_header_t header = a.recording_header (800, 600);
+    // Enough frames for a few keyframes.
+    unsigned frames = 3 * header.keyframe_interval + steps;
+    unsigned middle = frames / 2 + 1;
+    recorder_t recorder {};
+    if (! recorder.open (path, header)) {
+      std::perror (path);
+      return false;
+    }
+    snapshot_t at_middle, at_end;
+    for (unsigned n = 0; n != frames; ++ n) {
+      a.draw_next ();
+      // Record every frame, even if the writer falls behind.
+      while (! a.record (recorder)) std::this_thread::yield ();
+      if (n == middle) at_middle.take (model_access_t { a });
+    }
+    at_end.take (model_access_t { a });
+    recorder.close ();
+
+    player_t player {};
+    bool ok = player.open (path) && player.frames == frames;
+    for (unsigned n = 0; ok && n != frames; ++ n) ok = b.replay (player);
+    if (ok) at_end.compare (model_access_t { b }, player.header);
+    ok = ok && player.seek (middle) && b.replay (player);
+    if (ok) at_middle.compare (model_access_t { b }, player.header);
+    // Replay into a model of another count, then shrink its tank (as a
+    // window resized during a replay does).
+    settings_t few { { 10, 50, 50, 50 } };
+    ALIGNED16 model_t c {};
+    c.initialize (seed);
+    ok = ok && c.start (800, 600, few) && player.seek (0);
+    for (unsigned n = 0; ok && n != steps; ++ n) ok = c.replay (player);
+    if (ok) checks [permutations] (permutation_errors (model_access_t { c }));
+    ok = ok && c.resize (400, 400);
+    if (ok) checks [permutations] (permutation_errors (model_access_t { c }));
+    player.close ();
+    ::unlink (path);
+    if (! ok) {
+      std::fprintf (stderr, "replay failed\n");
+      return false;
+    }
+#else
+    (void) seed;
+    (void) steps;
+#endif
+    return true;
+  }
+
+  // Scalar xorshift128+ (see random.cpp).
+  struct xorshift128plus_t
+  {
+    std::uint64_t s [2];
+
+    std::uint64_t get ()
+    {
+      std::uint64_t x = s [0], y = s [1];
+      std::uint64_t result = x + y;
+      s [0] = y;
+      x ^= x << 23;
+      s [1] = x ^ y ^ (x >> 18) ^ (y >> 5);
+      return result;
+    }
+
+    void jump ()
+    {
+      const std::uint64_t polynomial [2] = {
+        0x8a5cd789635d2dffull, 0x121fd2155c472f96ull,
+      };
+      std::uint64_t t [2] = { 0, 0 };
+      for (std::uint64_t word : polynomial) {
+        for (unsigned b = 0; b != 64; ++ b) {
+          if (word >> b & 1) {
+            t [0] ^= s [0];
+            t [1] ^= s [1];
+          }
+          get ();
+        }
+      }
+      s [0] = t [0];
+      s [1] = t [1];
+    }
+  };
+
+  std::uint64_t splitmix64 (std::uint64_t & x)
+  {
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  void check_random_streams (std::uint64_t seed)
+  {
+    const unsigned sets = 4, draws = 1000;
+    for (unsigned trial = 0; trial != 4; ++ trial) {
+      std::uint64_t stream_seed = seed + trial * 0x100000001ull;
+      ALIGNED16 rng4_t rng4;
+      ALIGNED16 rng4_t next;
+      rng4.initialize (stream_seed, 0);
+      for (unsigned set = 0; set != sets; ++ set) {
+        xorshift128plus_t ref [4];
+        for (unsigned k = 0; k != 4; ++ k) {
+          std::uint64_t x = stream_seed;
+          ref [k].s [0] = splitmix64 (x);
+          ref [k].s [1] = splitmix64 (x);
+          for (unsigned n = 0; n != 4 * set + k; ++ n) ref [k].jump ();
+        }
+        // The set reached by jumping matches the set initialized directly.
+        next.initialize (stream_seed, set);
+        for (unsigned n = 0; n != draws; ++ n) {
+          ALIGNED16 __m128i r [2];
+          ALIGNED16 __m128i q [2];
+          rng4.get (r);
+          next.get (q);
+          ALIGNED16 std::uint64_t a [4], b [4];
+          std::memcpy (a, r, sizeof a);
+          std::memcpy (b, q, sizeof b);
+          for (unsigned k = 0; k != 4; ++ k) {
+            std::uint64_t expected = ref [k].get ();
+            checks [random_streams] (a [k] != expected || b [k] != expected);
+          }
+        }
+        // The high halves, from get32.
+        ALIGNED16 std::uint32_t h [4];
+        _mm_store_si128 ((__m128i *) h, next.get32 ());
+        for (unsigned k = 0; k != 4; ++ k) {
+          checks [random_streams] (h [k] != ref [k].get () >> 32);
+        }
+        rng4.initialize (stream_seed, set);
+        rng4.jump ();
+      }
+    }
+  }
+
+  // The uniform block of object m, one object at a time (as model_t::draw
+  // did before fill_blocks).
+  void reference_block (const model_access_t & access, unsigned m,
+    float (& d) [4], float (& g) [4], unsigned & s)
+  {
+    const object_t & obj = access.objects () [m];
+    s = obj.starting_point == 7 || obj.target.point == 7;
+    const v4f alpha = { 0.0f, 0.0f, 0.0f, 0.85f }; // usr::alpha (model.cpp)
+    v4f satval = access.bumps () (obj.animation_time);
+    v4f sat = _mm_moveldup_ps (satval);
+    v4f val = _mm_movehdup_ps (satval);
+    store4f (d, hsv_to_rgb (obj.hue, sat, val, alpha));
+    v4f t = access.step () (obj.animation_time)
+      * _mm_set1_ps (obj.locus_length);
+    v4f sc = sincos (t);
+    v4f sn = _mm_moveldup_ps (sc);
+    v4f cs = _mm_movehdup_ps (sc);
+    v4f g0 = load4f (access.abc () [obj.target.system] [obj.starting_point]);
+    v4f e = load4f (access.e () [m]);
+    store4f (g, _mm_set1_ps (obj.r) * (cs * g0 + sn * e));
+  }
+
+  bool check_uniform_blocks (std::uint64_t seed)
+  {
+    const settings_t settings_list [] = {
+      { { 1, 50, 50, 50 } }, { { 50, 50, 50, 50 } }, { { 100, 50, 50, 0 } },
+    };
+    for (const settings_t & settings : settings_list) {
+      ALIGNED16 model_t model {};
+      model_access_t access { model };
+      model.initialize (seed);
+      if (! model.initialize_graphics ()
+          || ! model.start (3840, 2160, settings)) {
+        std::fprintf (stderr, "model start failed\n");
+        return false;
+      }
+      for (unsigned frame = 0; frame != 150; ++ frame) model.draw_next ();
+      const uniform_buffer_t & buffer = access.uniform_buffer ();
+      for (unsigned n = 0; n != access.count (); ++ n) {
+        unsigned m = access.object_order () [n];
+        const object_data_t & block = buffer [n];
+        ALIGNED16 float d [4], g [4];
+        unsigned s;
+        reference_block (access, m, d, g, s);
+        double error = block.s != s;
+        for (unsigned k = 0; k != 4; ++ k) {
+          error = std::fmax (error, std::fabs (block.d [k] - d [k]));
+          error = std::fmax (error,
+            std::fabs (block.g [k] - g [k]) / (1.0 + std::fabs (g [k])));
+        }
+        checks [uniform_blocks] (error);
+      }
+    }
+    return true;
+  }
+
+  bool check_resize (std::uint64_t seed, unsigned states)
+  {
+    rng_t rng;
+    rng.initialize (seed);
+    // At least 400 pixels each way, so the tank is more than a diameter
+    // deep at the largest radius (see model_t::set_tank).
+    auto random_size = [&] (int & width, int & height) {
+      width = 400 + (int) ((rng.get () >> 32) % 1521);
+      height = 400 + (int) ((rng.get () >> 32) % 801);
+    };
+    for (unsigned state = 0; state != states; ++ state) {
+      settings_t settings;
+      for (unsigned k = 0; k != trackbar_count; ++ k) {
+        settings.trackbar_pos [k] = (unsigned) ((rng.get () >> 32) % 101);
+      }
+      int width, height;
+      random_size (width, height);
+      ALIGNED16 model_t model {};
+      model_access_t access { model };
+      model.initialize (rng.get ());
+      if (! model.start (width, height, settings)) {
+        std::fprintf (stderr, "model start failed\n");
+        return false;
+      }
+      for (unsigned resize = 0; resize != 4; ++ resize) {
+        for (unsigned n = 0; n != 20; ++ n) model.draw_next ();
+        random_size (width, height);
+        if (! model.resize (width, height)) {
+          std::fprintf (stderr, "model resize failed\n");
+          return false;
+        }
+        ALIGNED16 model_t fresh {};
+        fresh.initialize (seed);
+        if (! fresh.start (width, height, settings)) {
+          std::fprintf (stderr, "model start failed\n");
+          return false;
+        }
+        checks [resize_count] (std::fabs ((double) model.active_count ()
+            - fresh.active_count ()));
+        checks [permutations] (permutation_errors (access));
+        for (unsigned n = 0; n != access.count (); ++ n) {
+          float r = access.objects () [n].r;
+          vec3_t x = get3 (access.x () [n]);
+          double depth = 0.0;
+          for (unsigned k = 0; k != 6; ++ k) {
+            vec3_t anchor = get3 (access.walls () [k] [0]);
+            vec3_t normal = get3 (access.walls () [k] [1]);
+            depth = std::fmax (depth, r - dot (x - anchor, normal));
+          }
+          checks [resize_walls] (depth / r);
+        }
+      }
+    }
+    return true;
+  }
+
+  // The sum of the squares of the velocities and angular velocities of
+  // objects 0 to count - 1.
+  double sum_of_squares (const model_access_t & access, unsigned count)
+  {
+    double E = 0.0;
+    for (unsigned n = 0; n != count; ++ n) {
+      const body_t A = get_body (access, n);
+      E += dot (A.v, A.v) + dot (A.w, A.w);
+    }
+    return E;
+  }
+
+  // The factor applied to the annealed velocities for heat setting s (as in
+  // model.cpp).
+  double heat_factor (unsigned s)
+  {
+    return s * (s <= 50 ? 0.125 / 50 : 0.125 / (50 * 50) * s);
+  }
+
+  bool check_settings (std::uint64_t seed, unsigned states)
+  {
+    rng_t rng;
+    rng.initialize (seed);
+    auto random_settings = [&] (settings_t & settings) {
+      for (unsigned k = 0; k != trackbar_count; ++ k) {
+        settings.trackbar_pos [k] = (unsigned) ((rng.get () >> 32) % 101);
+      }
+      // Sometimes stop, or start from rest.
+      if (rng.get () >> 61 == 0) settings.trackbar_pos [1] = 0;
+    };
+    for (unsigned state = 0; state != states; ++ state) {
+      settings_t settings;
+      random_settings (settings);
+      int width = 640 + (int) ((rng.get () >> 32) % 1281);
+      int height = 480 + (int) ((rng.get () >> 32) % 601);
+      ALIGNED16 model_t model {};
+      model_access_t access { model };
+      model.initialize (rng.get ());
+      if (! model.start (width, height, settings)) {
+        std::fprintf (stderr, "model start failed\n");
+        return false;
+      }
+      for (unsigned change = 0; change != 4; ++ change) {
+        for (unsigned n = 0; n != 20; ++ n) model.draw_next ();
+        settings_t old_settings = model.settings ();
+        random_settings (settings);
+        // (Objects can be added, but not removed, before the next frame.)
+        unsigned count = access.count ();
+        double E0 = sum_of_squares (access, count);
+        // Post intermediate positions first, more of them than a dialog
+        // sends between frames; only the last position of each counts.
+        for (unsigned n = 0; n != 100; ++ n) {
+          unsigned k = (unsigned) ((rng.get () >> 32) % trackbar_count);
+          model.post_setting (k, (unsigned) ((rng.get () >> 32) % 101));
+        }
+        for (unsigned k = 0; k != trackbar_count; ++ k) {
+          if (! model.post_setting (k, settings.trackbar_pos [k])) {
+            std::fprintf (stderr, "post_setting failed\n");
+            return false;
+          }
+        }
+        access.apply_commands ();
+        double E1 = sum_of_squares (access, count);
+
+        ALIGNED16 model_t fresh {};
+        model_access_t fresh_access { fresh };
+        fresh.initialize (seed);
+        if (! fresh.start (width, height, settings)) {
+          std::fprintf (stderr, "model start failed\n");
+          return false;
+        }
+        checks [settings_count] (std::fabs ((double) model.active_count ()
+            - fresh.active_count ()));
+        checks [settings_animation] (
+          access.animation_speed_constant ()
+            != fresh_access.animation_speed_constant ()
+          || std::memcmp (& access.bumps (), & fresh_access.bumps (),
+            sizeof (bumps_t)));
+        const object_t & B = fresh_access.objects () [0];
+        for (unsigned n = 0; n != access.count (); ++ n) {
+          const object_t & A = access.objects () [n];
+          float fade = A.fade < 0.0f ? - A.fade : A.fade;
+          checks [settings_size] (A.r != B.r * fade || A.m != B.m
+            || A.l != B.l);
+        }
+        double f0 = heat_factor (old_settings.trackbar_pos [1]);
+        double f1 = heat_factor (settings.trackbar_pos [1]);
+        if (f0 > 0.0 && f1 > 0.0 && E0 > 0.0) {
+          double E = E0 * (f1 / f0) * (f1 / f0);
+          checks [settings_heat] (std::fabs (E1 - E) / E);
+        }
+      }
+    }
+    return true;
+  }
+
+  // The errors in the model's counts of objects fading and fading out.
+  double fading_errors (const model_access_t & access)
+  {
+    unsigned fading = 0, fading_out = 0;
+    for (unsigned n = 0; n != access.count (); ++ n) {
+      float fade = access.objects () [n].fade;
+      fading += fade != 1.0f;
+      fading_out += fade < 0.0f;
+    }
+    return std::fabs ((double) access.fading () - fading)
+      + std::fabs ((double) access.fading_out () - fading_out);
+  }
+
+  bool check_fades (std::uint64_t seed, unsigned states)
+  {
+    rng_t rng;
+    rng.initialize (seed);
+    for (unsigned state = 0; state != states; ++ state) {
+      settings_t settings { { 50, 50, 50, 50 } };
+      ALIGNED16 model_t model {};
+      model_access_t access { model };
+      model.initialize (rng.get ());
+      if (! model.start (800, 600, settings)) {
+        std::fprintf (stderr, "model start failed\n");
+        return false;
+      }
+      unsigned full = model.active_count ();
+      for (unsigned change = 0; change != 4; ++ change) {
+        for (unsigned n = 0; n != 10; ++ n) {
+          model.draw_next ();
+          checks [fading_count] (fading_errors (access));
+        }
+        // Shed some objects and restore them before the next frame.
+        unsigned active = model.active_count ();
+        unsigned shed = 1 + (unsigned) ((rng.get () >> 32) % active);
+        bool ok = model.fade_to_count (active - shed + 1)
+          && model.fade_to_count (active);
+        checks [fading_count] (fading_errors (access));
+        // Then a random count, which later changes overtake.
+        ok = ok && model.fade_to_count (1 + (unsigned) ((rng.get () >> 32)
+            % full));
+        checks [fading_count] (fading_errors (access));
+        if (! ok) {
+          std::fprintf (stderr, "fade_to_count failed\n");
+          return false;
+        }
+      }
+      // One second of fading, and a frame more.
+      for (unsigned n = 0; n != 61; ++ n) {
+        model.draw_next ();
+        checks [fading_count] (fading_errors (access));
+      }
+      checks [fading_count] (access.fading () + access.fading_out ());
+    }
+    return true;
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-seed N] [-pairs N] [-states N] "
+      "[-steps N]\n", program);
+    return 2;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  _mm_setcsr (_mm_getcsr () | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON));
+
+  std::uint64_t seed = 1;
+  unsigned pairs = 100000, states = 20, steps = 50;
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (i + 1 == argc) return usage (argv [0]);
+    const char * value = argv [++ i];
+    if (! std::strcmp (arg, "-seed")) seed = std::strtoull (value, nullptr, 0);
+    else if (! std::strcmp (arg, "-pairs")) pairs = std::atoi (value);
+    else if (! std::strcmp (arg, "-states")) states = std::atoi (value);
+    else if (! std::strcmp (arg, "-steps")) steps = std::atoi (value);
+    else return usage (argv [0]);
+  }
+
+  // A small model provides storage and walls for the single collisions.
+  settings_t settings { { 50, 50, 50, 50 } };
+  ALIGNED16 model_t model {};
+  model.initialize (seed);
+  if (! model.start (640, 480, settings)) {
+    std::fprintf (stderr, "model start failed\n");
+    return 1;
+  }
+  check_pairs (model_access_t { model }, seed, pairs);
+  if (! check_states (seed, states, steps)) return 1;
+  if (! check_checkpoint (seed, steps)) return 1;
+  if (! check_recording (seed, steps)) return 1;
+  check_random_streams (seed);
+  if (! check_uniform_blocks (seed)) return 1;
+  if (! check_resize (seed, states)) return 1;
+  if (! check_settings (seed, states)) return 1;
+  if (! check_fades (seed, states)) return 1;
+
+  bool ok = true;
+  std::printf ("%-24s %12s %12s %12s %10s\n", "check", "count", "worst",
+    "tolerance", "failures");
+  for (const check_t & check : checks) {
+    std::printf ("%-24s %12llu %12.3e %12.3e %10llu\n", check.name,
+      check.count, check.worst, check.tolerance, check.failures);
+    ok = ok && ! check.failures;
+  }
+  std::printf ("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
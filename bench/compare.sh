@@ -0,0 +1,74 @@
+#!/bin/sh
+
+# Copyright 2012-2019 Richard Copley
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compare the frame times of two builds of the frame benchmark (frames.cpp).
+
+# Usage: compare.sh OLD NEW [REPEATS [OPTION...]]
+
+# Runs every preset with OLD and NEW alternately, REPEATS times each (default
+# 3), passing the OPTIONs (for example -seed 5 -frames 2000) to both. Prints,
+# per preset, the least of the median frame times of each build over the
+# repeats, and the ratio NEW/OLD. Alternating the builds spreads any drift in
+# the machine's state over both.
+
+# Example, from the top-level directory:
+#   git stash; make host; cp .obj/host/frames /tmp/frames-old
+#   git stash pop; make host
+#   bench/compare.sh /tmp/frames-old .obj/host/frames
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "usage: $0 OLD NEW [REPEATS [OPTION...]]" >&2
+  exit 2
+fi
+old=$1
+new=$2
+shift 2
+repeats=3
+if [ $# -gt 0 ]; then
+  repeats=$1
+  shift
+fi
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+i=0
+while [ $i -lt "$repeats" ]; do
+  "$old" -preset all -csv "$@" | sed -n '2,$s/^/old,/p' >> "$results"
+  "$new" -preset all -csv "$@" | sed -n '2,$s/^/new,/p' >> "$results"
+  i=$((i + 1))
+done
+
+# Fields: build,preset,seed,width,height,objects,frames,mean,p50,p90,p99,max.
+awk -F, '
+  NF == 12 {
+    key = $1 "," $2
+    if (! (key in best) || $9 < best [key]) best [key] = $9
+    if (! ($2 in objects)) { order [count ++] = $2; objects [$2] = $6 }
+  }
+  END {
+    printf "%-16s %7s %12s %12s %9s\n", "preset", "objects",
+      "old p50 ms", "new p50 ms", "new/old"
+    for (i = 0; i != count; ++ i) {
+      p = order [i]
+      o = best ["old," p]
+      n = best ["new," p]
+      printf "%-16s %7d %12.4f %12.4f %9.3f\n", p, objects [p], o, n,
+        (o > 0 ? n / o : 0)
+    }
+  }' "$results"
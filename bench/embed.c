@@ -0,0 +1,88 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Example of embedding the simulation library (libpolymorph.h), in C. Runs
+// a simulation, reading the state in place each frame: prints the object
+// count, the kinetic energy and the centre of mass every so often, then
+// shrinks the tank and the population, and runs on. It exits with status 1
+// if the library fails or a position or velocity is not finite.
+
+// Usage: embed [frames [seed]]   (default 600 frames, seed 1)
+
+#include "libpolymorph.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int report (const polymorph_t * sim, unsigned frame)
+{
+  unsigned n = polymorph_count (sim);
+  const float * x = polymorph_positions (sim);
+  const float * v = polymorph_velocities (sim);
+  const polymorph_object_t * objects = polymorph_objects (sim);
+  double energy = 0.0, c [3] = { 0.0, 0.0, 0.0 }, mass = 0.0;
+  int ok = 1;
+  for (unsigned i = 0; i != n; ++ i) {
+    const float * xi = x + 4 * i, * vi = v + 4 * i;
+    float m = objects [i].m;
+    energy += 0.5 * m * (vi [0] * vi [0] + vi [1] * vi [1] + vi [2] * vi [2]);
+    for (unsigned k = 0; k != 3; ++ k) c [k] += m * xi [k];
+    mass += m;
+    for (unsigned k = 0; k != 3; ++ k) {
+      if (! isfinite (xi [k]) || ! isfinite (vi [k])) ok = 0;
+    }
+  }
+  if (mass > 0.0) for (unsigned k = 0; k != 3; ++ k) c [k] /= mass;
+  printf ("frame %5u: %4u objects, energy %10.4f, centre (%.3f, %.3f, %.3f)\n",
+    frame, n, energy, c [0], c [1], c [2]);
+  return ok;
+}
+
+int main (int argc, char * argv [])
+{
+  unsigned frames = argc > 1 ? (unsigned) strtoul (argv [1], NULL, 10) : 600;
+  unsigned long long seed = argc > 2 ? strtoull (argv [2], NULL, 10) : 1;
+  polymorph_settings_t settings = { 50, 50, 50, 50 };
+
+  if (polymorph_api_version () != POLYMORPH_API_VERSION) {
+    fprintf (stderr, "embed: library API version %u, header version %u\n",
+      polymorph_api_version (), (unsigned) POLYMORPH_API_VERSION);
+    return 1;
+  }
+
+  polymorph_t * sim = polymorph_create (seed, 1920, 1080, & settings);
+  if (! sim) {
+    fprintf (stderr, "embed: polymorph_create failed\n");
+    return 1;
+  }
+
+  int ok = 1;
+  for (unsigned frame = 0; frame != frames; ++ frame) {
+    if (frame % 100 == 0) ok = report (sim, frame) && ok;
+    if (frame == frames / 2) {
+      unsigned n = polymorph_count (sim);
+      if (! polymorph_resize (sim, 1280, 720)
+        || ! polymorph_set_count (sim, n / 2)) {
+        fprintf (stderr, "embed: resize failed\n");
+        ok = 0;
+        break;
+      }
+    }
+    polymorph_step (sim, 1);
+  }
+  ok = report (sim, frames) && ok;
+  polymorph_destroy (sim);
+  if (! ok) fprintf (stderr, "embed: state not finite\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,472 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Headless frame benchmark. Builds the model against the null graphics
+// backend, starts it with an explicit seed for each selected preset, runs
+// some warm-up frames and then times each of a fixed number of frames. For
+// each preset it prints the object count and the distribution of frame
+// times: mean, median, 90th and 99th percentiles and maximum. Instrumentation
+// reports (performance counters, collision statistics) cover every frame
+// after start-up, of all the presets run.
+
+// Usage: frames [option value]...
+//   -preset NAME  preset (see presets below), or "all" (default "default")
+//   -seed N       random seed (default 1)
+//   -frames N     timed frames per preset (default 1000)
+//   -warmup N     untimed frames per preset, after start-up (default 100)
+//   -size WxH     override the preset's window size
+//   -resize WxH   after the warm-up, resize to WxH without restarting (see
+//                 model_t::resize), and print the time taken to start and
+//                 to resize, and the first frame after the resize
+//   -count P      override the preset's trackbar positions, 0 to 100
+//   -heat P
+//   -speed P
+//   -radius P
+//   -csv          print CSV rows instead of a table
+//   -no-alloc     abort if a timed frame allocates memory (with
+//                 ENABLE_MEMORY_STATS)
+//   -governor MS  run the frame-time governor during the timed frames, with
+//                 a budget of MS milliseconds per frame, and print its
+//                 decisions (see governor.h)
+//   -checkpoint FILE  start from the checkpoint FILE if it matches, else
+//                 save one there (see checkpoint.h), and print the time
+//                 taken to start
+//   -record FILE  record every frame after start-up (see recording.h), and
+//                 print the size of the recording
+//   -replay FILE  draw the frames of the recording FILE (in a loop) instead
+//                 of simulating, at the recording's window size
+//   -times FILE   write every frame time as CSV
+//   -counters FILE  per-frame performance counters (with
+//                 ENABLE_PERF_COUNTERS)
+//   -histograms FILE  collision counter histograms (with
+//                 ENABLE_COLLISION_STATS)
+//   -trace FILE   Chrome trace (with ENABLE_TRACE)
+//   -contacts N   record contact events (see contact-events.h) in a ring of
+//                 N events, drained after every frame, and print the
+//                 events per frame (with ENABLE_CONTACT_EVENTS)
+//   -telemetry ADDRESS  stream per-frame metrics to a client on the Unix
+//                 socket path or localhost port ADDRESS, see scrape.cpp
+//                 (with ENABLE_TELEMETRY)
+
+// To compare two builds, see compare.sh.
+
+#include "collision-stats.h"
+#include "compiler.h"
+#include "contact-events.h"
+#include "governor.h"
+#include "memory.h"
+#include "model.h"
+#include "perf.h"
+#include "qpc.h"
+#include "recording.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <x86intrin.h>
+
+namespace
+{
+  struct preset_t
+  {
+    const char * name;
+    settings_t settings; // count, heat, speed, radius
+    int width, height;
+  };
+
+  const preset_t presets [] = {
+    { "default",        { {  50,  50,  50,  50 } }, 1920, 1080 },
+    { "sparse",         { {  10,  50,  50,  50 } }, 1920, 1080 },
+    { "dense",          { { 100,  50,  50,  50 } }, 1920, 1080 },
+    { "max-count",      { { 100,  50,  50,   0 } }, 3840, 2160 },
+    { "large-radius",   { {  50,  50,  50, 100 } }, 1920, 1080 },
+    { "high-heat",      { {  50, 100,  50,  50 } }, 1920, 1080 },
+    { "fast-animation", { {  50,  50, 100,  50 } }, 1920, 1080 },
+    { "preview",        { {  50,  50,  50,  50 } },  152,  112 },
+  };
+
+  const char * const trackbar_names [trackbar_count] = {
+    "-count", "-heat", "-speed", "-radius",
+  };
+
+  struct options_t
+  {
+    std::uint64_t seed;
+    unsigned frames;
+    unsigned warmup;
+    int width, height;             // Zero: the preset's.
+    int resize_width, resize_height; // Zero: no resize.
+    int trackbar_pos [trackbar_count]; // Negative: the preset's.
+    bool csv;
+    bool no_alloc;                 // Abort if a timed frame allocates.
+    double governor_budget;        // Milliseconds, or zero for none.
+    unsigned contacts;             // Contact event ring size, or zero.
+    const char * checkpoint;
+    const char * record;
+    const char * replay;
+    std::FILE * times;
+  };
+
+  // Percentile p of sorted values (nearest rank).
+  double percentile (const std::vector <double> & sorted, double p)
+  {
+    std::size_t n = sorted.size ();
+    std::size_t rank = (std::size_t) (p * n / 100.0 + 0.5);
+    return sorted [rank ? (rank < n ? rank : n) - 1 : 0];
+  }
+
+  bool run_preset (const preset_t & preset, const options_t & options)
+  {
+    settings_t settings = preset.settings;
+    for (unsigned k = 0; k != trackbar_count; ++ k) {
+      if (options.trackbar_pos [k] >= 0) {
+        settings.trackbar_pos [k] = options.trackbar_pos [k];
+      }
+    }
+    int width = options.width ? options.width : preset.width;
+    int height = options.height ? options.height : preset.height;
+
+#if RECORDING_ENABLED
+    player_t player {};
+    recorder_t recorder {};
+    if (options.replay) {
+      if (! player.open (options.replay)) {
+        std::fprintf (stderr, "%s: not a recording\n", options.replay);
+        return false;
+      }
+      width = player.header.width;
+      height = player.header.height;
+    }
+#endif
+
+#if CONTACT_EVENTS_ENABLED
+    contact_ring_t * ring = nullptr;
+    std::vector <contact_event_t> events (options.contacts);
+    std::uint64_t object_contacts = 0, wall_contacts = 0;
+    double impulse = 0.0;
+    if (options.contacts) {
+      ring = contact_events_open (options.contacts);
+      if (! ring) {
+        std::fprintf (stderr, "out of memory\n");
+        return false;
+      }
+    }
+#endif
+
+    ALIGNED16 model_t model {};
+    model.initialize (options.seed);
+    if (! model.initialize_graphics ()) {
+      std::fprintf (stderr, "initialization failed\n");
+      return false;
+    }
+    std::uint64_t start_time = qpc ();
+    if (! model.start (width, height, settings, options.checkpoint, true)) {
+      std::fprintf (stderr, "out of memory\n");
+      return false;
+    }
+    double start_ms = 1e3 * (qpc () - start_time) / qpf ();
+    if (options.checkpoint && ! options.resize_width && ! options.csv) {
+      std::printf ("  start %.3f ms\n", start_ms);
+    }
+#if RECORDING_ENABLED
+    if (options.record && ! recorder.open (options.record,
+        model.recording_header (width, height, options.resize_width,
+          options.resize_height))) {
+      std::perror (options.record);
+      return false;
+    }
+#endif
+    // Simulate and draw a frame, or replay one; record it.
+    auto next = [&] () {
+#if TELEMETRY_ENABLED
+      std::uint64_t t0 = qpc ();
+#endif
+#if RECORDING_ENABLED
+      if (player.is_open ()) {
+        if (! model.replay (player) && player.seek (0)) model.replay (player);
+      }
+      else
+#endif
+        model.draw_next ();
+#if RECORDING_ENABLED
+      if (recorder.is_open ()) model.record (recorder);
+#endif
+      TELEMETRY_END_FRAME (qpc () - t0, model.object_count (),
+        model.statistics ().transitions);
+#if CONTACT_EVENTS_ENABLED
+      if (ring) {
+        unsigned n = ring->read (events.data (), options.contacts);
+        for (unsigned k = 0; k != n; ++ k) {
+          if (events [k].wall == contact_none) ++ object_contacts;
+          else ++ wall_contacts;
+          impulse += events [k].impulse;
+        }
+      }
+#endif
+    };
+    for (unsigned n = 0; n != options.warmup; ++ n) next ();
+    if (options.resize_width) {
+      width = options.resize_width;
+      height = options.resize_height;
+      std::uint64_t t0 = qpc ();
+      if (! model.resize (width, height)) {
+        std::fprintf (stderr, "resize failed\n");
+        return false;
+      }
+      std::uint64_t t1 = qpc ();
+      next ();
+      std::uint64_t t2 = qpc ();
+      if (! options.csv) {
+        std::printf ("  start %.3f ms, resize %.3f ms, first frame %.3f ms\n",
+          start_ms, 1e3 * (t1 - t0) / qpf (), 1e3 * (t2 - t1) / qpf ());
+      }
+    }
+
+    std::vector <double> times (options.frames);
+    double scale = 1e3 / qpf ();
+    governor_t governor;
+    if (options.governor_budget) {
+      governor.allow_interval = true;
+      governor.reset (model, (float) (options.governor_budget * 1e-3));
+    }
+    MEMORY_FORBID_ALLOCATIONS (options.no_alloc);
+    for (unsigned n = 0; n != options.frames; ++ n) {
+      std::uint64_t t0 = qpc ();
+      next ();
+      times [n] = (qpc () - t0) * scale;
+      if (options.governor_budget) {
+        // The frames run back to back, so the period is the work.
+        float seconds = (float) (times [n] * 1e-3);
+        const governor_decision_t * decision =
+          governor.update (model, seconds, seconds);
+        if (decision && ! options.csv) {
+          std::printf ("  frame %6llu load %.2f count %u -> %u"
+            " collision interval %u -> %u\n",
+            (unsigned long long) decision->frame, decision->load,
+            decision->old_count, decision->new_count,
+            decision->old_interval, decision->new_interval);
+        }
+      }
+    }
+    MEMORY_FORBID_ALLOCATIONS (false);
+    std::uint64_t objects = model.active_count ();
+#if CONTACT_EVENTS_ENABLED
+    if (ring && ! options.csv) {
+      double all = (double) (options.warmup + options.frames);
+      std::uint64_t contacts = object_contacts + wall_contacts;
+      std::printf ("  contacts: %.2f per frame (%.2f object, %.2f wall), "
+        "mean impulse %.4g, %llu dropped\n", contacts / all,
+        object_contacts / all, wall_contacts / all,
+        contacts ? impulse / contacts : 0.0,
+        (unsigned long long) ring->dropped.load ());
+    }
+    contact_events_close ();
+#endif
+#if RECORDING_ENABLED
+    player.close ();
+    if (recorder.is_open ()) {
+      recorder.close ();
+      if (! options.csv) {
+        std::printf ("  recorded %u frames (%u dropped), %llu bytes, %.1f%% of"
+          " the floats\n", recorder.frames, recorder.dropped,
+          (unsigned long long) recorder.bytes,
+          recorder.raw_bytes ? 100.0 * recorder.bytes / recorder.raw_bytes
+            : 0.0);
+      }
+    }
+#endif
+
+    if (options.times) {
+      for (unsigned n = 0; n != options.frames; ++ n) {
+        std::fprintf (options.times, "%s,%llu,%u,%.6f\n", preset.name,
+          (unsigned long long) options.seed, n, times [n]);
+      }
+    }
+
+    double sum = 0.0;
+    for (double t : times) sum += t;
+    std::sort (times.begin (), times.end ());
+    double mean = options.frames ? sum / options.frames : 0.0;
+    double p50 = options.frames ? percentile (times, 50.0) : 0.0;
+    double p90 = options.frames ? percentile (times, 90.0) : 0.0;
+    double p99 = options.frames ? percentile (times, 99.0) : 0.0;
+    double max = options.frames ? times.back () : 0.0;
+    const char * format = options.csv
+      ? "%s,%llu,%d,%d,%llu,%u,%.4f,%.4f,%.4f,%.4f,%.4f\n"
+      : "%-16s %6llu %5dx%-5d %7llu %7u %9.4f %9.4f %9.4f %9.4f %9.4f\n";
+    std::printf (format, preset.name, (unsigned long long) options.seed,
+      width, height, (unsigned long long) objects, options.frames, mean,
+      p50, p90, p99, max);
+    if (options.governor_budget && ! options.csv) {
+      std::printf ("  governor: %u decreases, %u increases, final load %.2f\n",
+        governor.decreases, governor.increases, governor.load);
+    }
+    std::fflush (stdout);
+    return true;
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-preset NAME|all] [-seed N] "
+      "[-frames N] [-warmup N] [-size WxH] [-resize WxH] [-count P] "
+      "[-heat P] [-speed P] [-radius P] [-csv] [-no-alloc] [-governor MS] "
+      "[-checkpoint FILE] [-record FILE] [-replay FILE] [-times FILE] "
+      "[-counters FILE] "
+      "[-histograms FILE] [-trace FILE] [-contacts N] [-telemetry ADDRESS]"
+      "\npresets:", program);
+    for (const preset_t & preset : presets) {
+      std::fprintf (stderr, " %s", preset.name);
+    }
+    std::fprintf (stderr, "\n");
+    return 2;
+  }
+
+  std::FILE * open_output (const char * filename)
+  {
+    if (! filename) return nullptr;
+    std::FILE * file = std::fopen (filename, "w");
+    if (! file) std::perror (filename);
+    return file;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  _mm_setcsr (_mm_getcsr () | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON));
+
+  options_t options {
+    1, 1000, 100, 0, 0, 0, 0, { -1, -1, -1, -1 }, false, false, 0.0, 0,
+    nullptr, nullptr, nullptr, nullptr
+  };
+  const char * preset_name = "default";
+  const char * times_filename = nullptr;
+  const char * counters_filename = nullptr;
+  const char * histograms_filename = nullptr;
+  const char * trace_filename = nullptr;
+  const char * telemetry_address = nullptr;
+
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (! std::strcmp (arg, "-csv")) {
+      options.csv = true;
+      continue;
+    }
+    if (! std::strcmp (arg, "-no-alloc")) {
+      options.no_alloc = true;
+      continue;
+    }
+    if (i + 1 == argc) return usage (argv [0]);
+    const char * value = argv [++ i];
+    bool known = true;
+    if (! std::strcmp (arg, "-preset")) preset_name = value;
+    else if (! std::strcmp (arg, "-seed")) {
+      options.seed = std::strtoull (value, nullptr, 0);
+    }
+    else if (! std::strcmp (arg, "-frames")) options.frames = std::atoi (value);
+    else if (! std::strcmp (arg, "-warmup")) options.warmup = std::atoi (value);
+    else if (! std::strcmp (arg, "-size")) {
+      known = std::sscanf (value, "%dx%d", & options.width, & options.height)
+        == 2 && options.width > 0 && options.height > 0;
+    }
+    else if (! std::strcmp (arg, "-resize")) {
+      known = std::sscanf (value, "%dx%d", & options.resize_width,
+        & options.resize_height) == 2 && options.resize_width > 0
+        && options.resize_height > 0;
+    }
+    else if (! std::strcmp (arg, "-governor")) {
+      options.governor_budget = std::atof (value);
+      known = options.governor_budget > 0.0;
+    }
+    else if (! std::strcmp (arg, "-checkpoint")) options.checkpoint = value;
+    else if (! std::strcmp (arg, "-record")) options.record = value;
+    else if (! std::strcmp (arg, "-replay")) options.replay = value;
+    else if (! std::strcmp (arg, "-times")) times_filename = value;
+    else if (! std::strcmp (arg, "-counters")) counters_filename = value;
+    else if (! std::strcmp (arg, "-histograms")) histograms_filename = value;
+    else if (! std::strcmp (arg, "-trace")) trace_filename = value;
+    else if (! std::strcmp (arg, "-telemetry")) telemetry_address = value;
+    else if (! std::strcmp (arg, "-contacts")) {
+      options.contacts = (unsigned) std::atoi (value);
+      known = options.contacts > 0;
+    }
+    else {
+      known = false;
+      for (unsigned k = 0; k != trackbar_count; ++ k) {
+        if (! std::strcmp (arg, trackbar_names [k])) {
+          int pos = std::atoi (value);
+          options.trackbar_pos [k] = pos < 0 ? 0 : pos > 100 ? 100 : pos;
+          known = true;
+        }
+      }
+    }
+    if (! known) return usage (argv [0]);
+  }
+
+  bool all = ! std::strcmp (preset_name, "all");
+  bool found = false;
+  for (const preset_t & preset : presets) {
+    found = found || all || ! std::strcmp (preset_name, preset.name);
+  }
+  if (! found) return usage (argv [0]);
+
+  options.times = open_output (times_filename);
+  std::FILE * counters = open_output (counters_filename);
+  if ((times_filename && ! options.times) || (counters_filename && ! counters))
+  {
+    return 1;
+  }
+  if (options.times) {
+    std::fprintf (options.times, "preset,seed,frame,ms\n");
+  }
+  PERF_CSV (counters);
+  if (telemetry_address && ! TELEMETRY_OPEN (telemetry_address)) {
+    std::fprintf (stderr, "%s: cannot open the telemetry endpoint\n",
+      telemetry_address);
+    return 1;
+  }
+
+  if (options.csv) {
+    std::printf ("preset,seed,width,height,objects,frames,"
+      "mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+  }
+  else {
+    std::printf ("%-16s %6s %11s %7s %7s %9s %9s %9s %9s %9s\n", "preset",
+      "seed", "size", "objects", "frames", "mean ms", "p50 ms", "p90 ms",
+      "p99 ms", "max ms");
+  }
+  for (const preset_t & preset : presets) {
+    if (all || ! std::strcmp (preset_name, preset.name)) {
+      if (! run_preset (preset, options)) return 1;
+    }
+  }
+
+  PERF_REPORT (stdout);
+  COLLISION_STATS_REPORT (stdout);
+  MEMORY_STATS_REPORT (stdout);
+
+  if (options.times) std::fclose (options.times);
+  if (counters) std::fclose (counters);
+  if (histograms_filename) {
+    COLLISION_STATS_WRITE (histograms_filename);
+  }
+  if (trace_filename) {
+    TRACE_WRITE (trace_filename);
+  }
+  TELEMETRY_CLOSE ();
+  return 0;
+}
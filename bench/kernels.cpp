@@ -0,0 +1,525 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks for the hot kernels, on synthetic data from a fixed seed.
+
+// Each kernel is timed at several problem sizes n. A batch of calls is
+// repeated until it lasts at least usr::batch_ms; the best of usr::trials
+// batches is reported, as nanoseconds per operation (per element, per object
+// or per candidate pair, as appropriate) and millions of operations per
+// second.
+
+// The kd-tree phases, bounce, wall_bounce and markov_transition (a batch of
+// every object's Markov transitions) run on a model started headless
+// (see graphics-null.cpp) with the count trackbar at 100 and a window size
+// chosen to give about n objects; the reported n is the actual count. The
+// "bounce_contact" case restores the velocities of each pair before the call
+// so that every call applies an impulse. With ENABLE_CONTACT_EVENTS,
+// "bounce_contact" runs with no contact ring (see contact-events.h), and
+// "bounce_events" repeats it recording every impulse in a ring
+// (emptied after each batch); compare the first with a build without
+// ENABLE_CONTACT_EVENTS for the cost of the feature when unused.
+
+// Usage: kernels [-csv] [-seed N] [-n N] [-filter SUBSTRING]
+//   -csv     print "kernel,n,ns_per_op,mops_per_s" rows instead of a table
+//   -seed N  random seed (default 1)
+//   -n N     run size N only (default 64, 256, 1024, 4096 and 16384)
+//   -filter  run only kernels whose name contains SUBSTRING
+
+#include "bump.h"
+#include "compiler.h"
+#include "contact-events.h"
+#include "fill.h"
+#include "graphics.h"
+#include "hsv-to-rgb.h"
+#include "kdtree.h"
+#include "model.h"
+#include "partition.h"
+#include "qpc.h"
+#include "random-util.h"
+#include "random.h"
+#include "rodrigues.h"
+#include "settings.h"
+#include "vector.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <x86intrin.h>
+
+namespace usr
+{
+  const double batch_ms = 2.0;
+  const unsigned trials = 7;
+  const unsigned sizes [] = { 64, 256, 1024, 4096, 16384 };
+}
+
+// Access to the model's private state and member kernels.
+struct model_access_t
+{
+  model_t & m;
+  unsigned count () const { return m.count; }
+  unsigned depth () const { return required_depth (m.count); }
+  float (* x () const) [4] { return m.x; }
+  float (* v () const) [4] { return m.v; }
+  float (* w () const) [4] { return m.w; }
+  float radius () const { return m.radius; }
+  void kdtree_search () const
+  {
+    m.frame_arena.reset ();
+    m.kdtree_search ();
+  }
+  void kdtree_build () const { m.kdtree_build (depth ()); }
+  void kdtree_objects () const { m.kdtree_bounce_objects (depth ()); }
+  void kdtree_walls () const { m.kdtree_bounce_walls (depth ()); }
+  void bounce (unsigned ix, unsigned iy) const { m.bounce (ix, iy); }
+  void wall_bounce (unsigned iw, unsigned ix) const { m.wall_bounce (iw, ix); }
+  void transition (const unsigned * indices, unsigned n) const
+  {
+    m.markov.transition (m.rng, indices, n, m.objects, m.u, m.e);
+  }
+};
+
+namespace
+{
+  struct options_t
+  {
+    bool csv;
+    std::uint64_t seed;
+    unsigned only_n;
+    const char * filter;
+  };
+
+  options_t options { false, 1, 0, nullptr };
+
+  // Keep the compiler from discarding results.
+  inline void clobber ()
+  {
+    asm volatile ("" : : : "memory");
+  }
+
+  template <typename T>
+  inline void keep (const T & value)
+  {
+    asm volatile ("" : : "m" (value) : "memory");
+  }
+
+  template <typename T>
+  T * allocate_array (std::size_t count)
+  {
+    std::size_t bytes = (count * sizeof (T) + 63) & -64;
+    T * p = (T *) std::aligned_alloc (64, bytes ? bytes : 64);
+    if (! p) {
+      std::fprintf (stderr, "out of memory\n");
+      std::exit (1);
+    }
+    std::memset ((void *) p, 0, bytes);
+    return p;
+  }
+
+  bool selected (const char * name)
+  {
+    return ! options.filter || std::strstr (name, options.filter);
+  }
+
+  // Best time per call of f, in nanoseconds.
+  template <typename F>
+  double measure (F && f)
+  {
+    const std::uint64_t batch_ticks = (std::uint64_t) (usr::batch_ms * qpf ())
+      / 1000;
+    std::uint64_t reps = 1;
+    for (;;) {
+      std::uint64_t t0 = qpc ();
+      for (std::uint64_t r = 0; r != reps; ++ r) f ();
+      if (qpc () - t0 >= batch_ticks) break;
+      reps *= 2;
+    }
+    double best = HUGE_VAL;
+    for (unsigned trial = 0; trial != usr::trials; ++ trial) {
+      std::uint64_t t0 = qpc ();
+      for (std::uint64_t r = 0; r != reps; ++ r) f ();
+      double t = double (qpc () - t0) / reps;
+      if (t < best) best = t;
+    }
+    return best * 1e9 / qpf ();
+  }
+
+  template <typename F>
+  void run (const char * name, unsigned n, unsigned ops_per_call, F && f)
+  {
+    if (! selected (name)) return;
+    double ns = measure (f) / ops_per_call;
+    if (options.csv) {
+      std::printf ("%s,%u,%.4f,%.3f\n", name, n, ns, 1e3 / ns);
+    }
+    else {
+      std::printf ("%-20s %8u %12.3f %12.2f\n", name, n, ns, 1e3 / ns);
+    }
+    std::fflush (stdout);
+  }
+
+  void random_points (rng_t & rng, float (* x) [4], unsigned n, float scale)
+  {
+    const v4f mask = { scale, scale, scale, 0.0f };
+    for (unsigned k = 0; k != n; ++ k) {
+      store4f (x [k], mask * get_vector_in_box (rng));
+    }
+  }
+
+  // Sorting and partitioning, on points uniform in a cube.
+  void bench_partition (unsigned n)
+  {
+    rng_t rng;
+    rng.initialize (options.seed);
+    float (* x) [4] = allocate_array <float [4]> (n);
+    unsigned * index0 = allocate_array <unsigned> (n);
+    unsigned * index = allocate_array <unsigned> (n);
+    random_points (rng, x, n, 100.0f);
+    for (unsigned k = 0; k != n; ++ k) index0 [k] = k;
+
+    // Each call first restores the unsorted index (n words copied).
+    run ("partition", n, n, [&] {
+      std::memcpy (index, index0, n * sizeof (unsigned));
+      partition (index, x, 0, 0, n / 2, n);
+      clobber ();
+    });
+    run ("qsort", n, n, [&] {
+      std::memcpy (index, index0, n * sizeof (unsigned));
+      qsort (index, x, 2, 0, n);
+      clobber ();
+    });
+
+    // Insertion sort of a nearly sorted index, as in draw_next: sort, then
+    // move every point a little.
+    qsort (index0, x, 2, 0, n);
+    const v4f jitter = { 0.0f, 0.0f, 0.05f, 0.0f };
+    for (unsigned k = 0; k != n; ++ k) {
+      store4f (x [k], load4f (x [k]) + jitter * get_vector_in_box (rng));
+    }
+    run ("insertion_sort", n, n, [&] {
+      std::memcpy (index, index0, n * sizeof (unsigned));
+      insertion_sort (index, x, 2, 0, n);
+      clobber ();
+    });
+
+    std::free (index);
+    std::free (index0);
+    std::free (x);
+  }
+
+  // Rigid-body kernels (rodrigues.h) on random states.
+  void bench_motion (unsigned n)
+  {
+    rng_t rng;
+    rng.initialize (options.seed);
+    float (* x) [4] = allocate_array <float [4]> (n);
+    float (* v) [4] = allocate_array <float [4]> (n);
+    float (* u) [4] = allocate_array <float [4]> (n);
+    float (* w) [4] = allocate_array <float [4]> (n);
+    float (* r) [4] = allocate_array <float [4]> (n);
+    unsigned * permutation = allocate_array <unsigned> (n);
+    for (unsigned k = 0; k != n; ++ k) {
+      store4f (x [k], get_vector_in_ball (rng, 20.0f));
+      store4f (v [k], get_vector_in_ball (rng, 0.05f));
+      store4f (u [k], get_vector_in_ball (rng, 0x1.921fb4P+001f)); // pi
+      store4f (w [k], get_vector_in_ball (rng, 0.01f));
+      permutation [k] = k;
+    }
+
+    run ("advance_linear", n, n, [&] {
+      advance_linear (x, v, n);
+      clobber ();
+    });
+    run ("advance_angular", n, n, [&] {
+      advance_angular (u, w, n);
+      clobber ();
+    });
+
+    // The uniform buffer layout of the null backend.
+    std::size_t stride = (sizeof (object_data_t) + 255) & -256;
+    char * buffer = allocate_array <char> (n * stride);
+    run ("compute", n, n, [&] {
+      compute (buffer + offsetof (object_data_t, m), stride, x, u,
+        permutation, n);
+      clobber ();
+    });
+    std::free (buffer);
+
+    run ("rotate", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) {
+        store4f (r [k], rotate (load4f (u [k]), load4f (w [k])));
+      }
+      clobber ();
+    });
+
+    std::free (permutation);
+    std::free (r);
+    std::free (w);
+    std::free (u);
+    std::free (v);
+    std::free (x);
+  }
+
+  // Animation and colour functions, at n random times and hues.
+  void bench_animation (unsigned n)
+  {
+    rng_t rng;
+    rng.initialize (options.seed);
+    float * t = allocate_array <float> (n);
+    float (* r) [4] = allocate_array <float [4]> (n);
+    for (unsigned k = 0; k != n; ++ k) t [k] = get_float (rng, 0.0f, 4.25f);
+
+    ALIGNED16 bump_specifier_t sbump = { 1.50f, 1.75f, 3.75f, 4.25f,
+      0.00f, 0.275f };
+    ALIGNED16 bump_specifier_t vbump = { 1.50f, 1.75f, 3.75f, 4.25f,
+      0.09f, 0.333f };
+    ALIGNED16 bumps_t bumps;
+    ALIGNED16 step_t step;
+    bumps.initialize (sbump, vbump);
+    step.initialize (1.75f, 3.75f);
+
+    run ("bumps", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) store4f (r [k], bumps (t [k]));
+      clobber ();
+    });
+    run ("step", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) store4f (r [k], step (t [k]));
+      clobber ();
+    });
+
+    const v4f sat = _mm_set1_ps (0.275f);
+    const v4f val = _mm_set1_ps (0.333f);
+    const v4f alpha = { 0.0f, 0.0f, 0.0f, 0.85f };
+    run ("hsv_to_rgb", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) {
+        store4f (r [k], hsv_to_rgb (t [k] * 1.5f, sat, val, alpha));
+      }
+      clobber ();
+    });
+
+    // The colour and coefficients of the uniform blocks (fill.h), per
+    // object, for random objects in a random order.
+    {
+      object_t * objects = allocate_array <object_t> (n);
+      unsigned * order = allocate_array <unsigned> (n);
+      float (* e) [4] = allocate_array <float [4]> (n);
+      ALIGNED16 float abc [system_count] [8] [4];
+      for (unsigned k = 0; k != n; ++ k) {
+        object_t & A = objects [k];
+        A.r = get_float (rng, 0.5f, 1.5f);
+        A.hue = get_float (rng, 0.0f, 1.0f);
+        A.animation_time = t [k];
+        A.locus_length = get_float (rng, 0.0f, 1.5f);
+        A.starting_point = (unsigned) ((rng.get () >> 32) % 8);
+        A.target.system = (system_select_t) ((rng.get () >> 32)
+          % system_count);
+        A.target.point = (unsigned) ((rng.get () >> 32) % 8);
+        store4f (e [k], get_vector_in_ball (rng, 1.0f));
+        order [k] = k;
+      }
+      for (unsigned k = n; k > 1; -- k) {
+        unsigned j = (unsigned) (((rng.get () >> 32) * k) >> 32);
+        unsigned m = order [k - 1];
+        order [k - 1] = order [j];
+        order [j] = m;
+      }
+      for (auto & system : abc) {
+        for (auto & g0 : system) store4f (g0, get_vector_in_ball (rng, 1.0f));
+      }
+      std::size_t stride = (sizeof (object_data_t) + 255) & -256;
+      char * buffer = allocate_array <char> (n * stride);
+      run ("fill_blocks", n, n, [&] {
+        fill_blocks (buffer, stride, order, n, objects, e, abc, bumps, step,
+          0.85f);
+        clobber ();
+      });
+      std::free (buffer);
+      std::free (e);
+      std::free (order);
+      std::free (objects);
+    }
+
+    run ("rng_get", n, n, [&] {
+      std::uint64_t sum = 0;
+      for (unsigned k = 0; k != n; ++ k) sum += rng.get ();
+      keep (sum);
+    });
+
+    // Per 64-bit number, four to a call.
+    ALIGNED16 rng4_t rng4;
+    rng4.initialize (options.seed);
+    run ("rng4_get", n, 4 * n, [&] {
+      __m128i sum = _mm_setzero_si128 ();
+      for (unsigned k = 0; k != n; ++ k) {
+        __m128i r [2];
+        rng4.get (r);
+        sum = _mm_add_epi64 (sum, _mm_xor_si128 (r [0], r [1]));
+      }
+      keep (sum);
+    });
+
+    // Per vector.
+    run ("vector_in_box", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) {
+        store4f (r [k], get_vector_in_box (rng));
+      }
+      clobber ();
+    });
+    run ("vector_in_box4", n, n, [&] {
+      for (unsigned k = 0; k != n; ++ k) {
+        store4f (r [k], get_vector_in_box (rng4));
+      }
+      clobber ();
+    });
+
+    std::free (r);
+    std::free (t);
+  }
+
+  // Collision detection, on a started model.
+  void bench_collisions (unsigned n)
+  {
+    // Object count is about fill_factor * (side / 100)^3 (see model_t::start),
+    // with radius 1 at trackbar position 50.
+    int side = (int) (100.0 * std::cbrt (n / 0.185));
+    settings_t settings { { 100, 50, 50, 50 } };
+    ALIGNED16 model_t model {};
+    model_access_t access { model };
+    model.initialize (options.seed);
+    if (! model.start (side, side, settings)) {
+      std::fprintf (stderr, "model start failed\n");
+      std::exit (1);
+    }
+    unsigned count = access.count ();
+    access.kdtree_search ();
+
+    run ("kdtree_search", count, count, [&] { access.kdtree_search (); });
+    run ("kdtree_build", count, count, [&] { access.kdtree_build (); });
+    run ("kdtree_objects", count, count, [&] { access.kdtree_objects (); });
+    run ("kdtree_walls", count, count, [&] { access.kdtree_walls (); });
+
+    // Random pairs: nearly all rejected, as in the traversal.
+    rng_t rng;
+    rng.initialize (options.seed);
+    unsigned (* pairs) [2] = allocate_array <unsigned [2]> (count);
+    for (unsigned k = 0; k != count; ++ k) {
+      pairs [k] [0] = (unsigned) ((rng.get () >> 32) * count >> 32);
+      pairs [k] [1] = (unsigned) ((rng.get () >> 32) * count >> 32);
+    }
+    run ("bounce_miss", count, count, [&] {
+      for (unsigned k = 0; k != count; ++ k) {
+        access.bounce (pairs [k] [0], pairs [k] [1]);
+      }
+    });
+    std::free (pairs);
+
+    run ("wall_bounce", count, 6 * count, [&] {
+      for (unsigned iw = 0; iw != 6; ++ iw) {
+        for (unsigned k = 0; k != count; ++ k) access.wall_bounce (iw, k);
+      }
+    });
+
+    // Pairs (2k, 2k+1) overlapping and approaching.
+    float (* x) [4] = access.x ();
+    float (* v) [4] = access.v ();
+    float (* w) [4] = access.w ();
+    unsigned pair_count = count / 2;
+    float (* v0) [4] = allocate_array <float [4]> (2 * pair_count);
+    float (* w0) [4] = allocate_array <float [4]> (2 * pair_count);
+    const v4f offset = { access.radius (), 0.0f, 0.0f, 0.0f };
+    const v4f closing = { -0.1f, 0.0f, 0.0f, 0.0f };
+    for (unsigned k = 0; k != pair_count; ++ k) {
+      store4f (x [2 * k + 1], load4f (x [2 * k]) + offset);
+      store4f (v [2 * k + 1], load4f (v [2 * k]) + closing);
+    }
+    std::memcpy (v0, v, 2 * pair_count * sizeof * v);
+    std::memcpy (w0, w, 2 * pair_count * sizeof * w);
+    run ("bounce_contact", count, pair_count, [&] {
+      for (unsigned k = 0; k != 2 * pair_count; k += 2) {
+        store4f (v [k], load4f (v0 [k]));
+        store4f (v [k + 1], load4f (v0 [k + 1]));
+        store4f (w [k], load4f (w0 [k]));
+        store4f (w [k + 1], load4f (w0 [k + 1]));
+        access.bounce (k, k + 1);
+      }
+    });
+#if CONTACT_EVENTS_ENABLED
+    if (contact_ring_t * ring = contact_events_open (pair_count)) {
+      run ("bounce_events", count, pair_count, [&] {
+        for (unsigned k = 0; k != 2 * pair_count; k += 2) {
+          store4f (v [k], load4f (v0 [k]));
+          store4f (v [k + 1], load4f (v0 [k + 1]));
+          store4f (w [k], load4f (w0 [k]));
+          store4f (w [k + 1], load4f (w0 [k + 1]));
+          access.bounce (k, k + 1);
+        }
+        ring->discard ();
+      });
+      contact_events_close ();
+    }
+#endif
+    std::free (w0);
+    std::free (v0);
+
+    unsigned * indices = allocate_array <unsigned> (count);
+    for (unsigned k = 0; k != count; ++ k) indices [k] = k;
+    run ("markov_transition", count, count, [&] {
+      access.transition (indices, count);
+    });
+    std::free (indices);
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-csv] [-seed N] [-n N] "
+      "[-filter SUBSTRING]\n", program);
+    return 2;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  _mm_setcsr (_mm_getcsr () | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON));
+
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (! std::strcmp (arg, "-csv")) {
+      options.csv = true;
+      continue;
+    }
+    if (i + 1 == argc) return usage (argv [0]);
+    const char * value = argv [++ i];
+    if (! std::strcmp (arg, "-seed")) {
+      options.seed = std::strtoull (value, nullptr, 0);
+    }
+    else if (! std::strcmp (arg, "-n")) options.only_n = std::atoi (value);
+    else if (! std::strcmp (arg, "-filter")) options.filter = value;
+    else return usage (argv [0]);
+  }
+
+  if (options.csv) std::printf ("kernel,n,ns_per_op,mops_per_s\n");
+  else std::printf ("%-20s %8s %12s %12s\n", "kernel", "n", "ns/op", "Mop/s");
+
+  for (unsigned n : usr::sizes) {
+    if (options.only_n) n = options.only_n;
+    bench_partition (n);
+    bench_motion (n);
+    bench_animation (n);
+    bench_collisions (n);
+    if (options.only_n) break;
+  }
+  return 0;
+}
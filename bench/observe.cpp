@@ -0,0 +1,181 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Test reader for the shared-memory publication (publish.h). By default it
+// forks a publisher: the child runs a headless model at full speed,
+// publishing every frame, while the parent reads the newest frame as often
+// as it can (or every -interval microseconds, to play a slow consumer).
+// Every frame read is checked: the frame numbers must increase, and each
+// object's modelview matrix must translate to its published position (so
+// a copy mixing two frames is caught). The program prints the frames
+// published and read, the torn copies discarded, and the child's mean
+// frame time for simulating and for publishing. It exits with status 1 on
+// an inconsistent frame, or if nothing could be read.
+
+// With -attach it only reads, from an existing publisher (for example the
+// screensaver, run with POLYMORPH_PUBLISH=NAME), until that closes.
+
+// Usage: observe [option value]...
+//   -name NAME    publication name (default "polymorph-observe")
+//   -attach       read an existing publication
+//   -frames N     frames to publish (default 2000)
+//   -size WxH     window size (default 1920x1080)
+//   -count P      count trackbar position, 0 to 100 (default 50)
+//   -interval US  microseconds between reads (default 0)
+
+#include "model.h"
+#include "publish.h"
+#include "qpc.h"
+#include "settings.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+  struct options_t
+  {
+    const char * name = "polymorph-observe";
+    bool attach = false;
+    unsigned frames = 2000;
+    int width = 1920, height = 1080;
+    unsigned count = 50;
+    unsigned interval = 0;
+  };
+
+  bool parse (int argc, char * argv [], options_t & o)
+  {
+    for (int i = 1; i < argc; ++ i) {
+      const char * a = argv [i];
+      const char * value = i + 1 < argc ? argv [i + 1] : nullptr;
+      if (! std::strcmp (a, "-attach")) {
+        o.attach = true;
+        continue;
+      }
+      if (! value) return false;
+      ++ i;
+      if (! std::strcmp (a, "-name")) o.name = value;
+      else if (! std::strcmp (a, "-frames")) o.frames = std::atoi (value);
+      else if (! std::strcmp (a, "-size")) {
+        if (std::sscanf (value, "%dx%d", & o.width, & o.height) != 2
+            || o.width <= 0 || o.height <= 0) {
+          return false;
+        }
+      }
+      else if (! std::strcmp (a, "-count")) o.count = std::atoi (value);
+      else if (! std::strcmp (a, "-interval")) o.interval = std::atoi (value);
+      else return false;
+    }
+    return o.count <= 100;
+  }
+
+  // The child: simulate and publish.
+  int publish (const options_t & o)
+  {
+    static model_t model {};
+    publisher_t publisher {};
+    model.initialize (1);
+    settings_t settings { { o.count, 50, 50, 50 } };
+    if (! model.start (o.width, o.height, settings)
+        || ! publisher.open (o.name, model.maximum_count ())) {
+      std::fprintf (stderr, "observe: publisher failed to start\n");
+      return 1;
+    }
+    std::uint64_t simulate = 0, publishing = 0;
+    for (unsigned n = 0; n != o.frames; ++ n) {
+      std::uint64_t t0 = qpc ();
+      model.draw_next ();
+      std::uint64_t t1 = qpc ();
+      model.publish (publisher);
+      std::uint64_t t2 = qpc ();
+      simulate += t1 - t0;
+      publishing += t2 - t1;
+    }
+    publisher.close ();
+    double ms = 1e3 / qpf () / (o.frames ? o.frames : 1);
+    std::printf ("publisher: %u frames of %u objects, simulate %.3f ms, "
+      "publish %.3f ms per frame\n", o.frames, model.object_count (),
+      simulate * ms, publishing * ms);
+    return 0;
+  }
+
+  // The parent: read until the publisher closes.
+  int observe (const options_t & o)
+  {
+    subscriber_t subscriber {};
+    // Wait up to five seconds for the publication to appear.
+    for (unsigned n = 0; ! subscriber.open (o.name); ++ n) {
+      if (n == 500) {
+        std::fprintf (stderr, "observe: cannot open \"%s\"\n", o.name);
+        return 1;
+      }
+      ::usleep (10000);
+    }
+    std::vector <published_object_t> objects (subscriber.capacity ());
+    std::uint64_t reads = 0, previous = 0, bad = 0, truncated = 0;
+    for (;;) {
+      bool closed = subscriber.closed ();
+      std::uint64_t frame;
+      unsigned count, total;
+      if (subscriber.read (objects.data (), frame, count, total)) {
+        ++ reads;
+        if (frame <= previous) ++ bad;
+        previous = frame;
+        if (count < total) ++ truncated;
+        for (unsigned k = 0; k != count; ++ k) {
+          const published_object_t & p = objects [k];
+          if (p.m [3] [0] != p.x [0] || p.m [3] [1] != p.x [1]
+              || p.m [3] [2] != p.x [2] || p.m [3] [3] != 1.0f) {
+            ++ bad;
+            break;
+          }
+        }
+      }
+      else if (closed) break;
+      if (o.interval) ::usleep (o.interval);
+    }
+    std::printf ("reader: %llu frames read (of %llu), %llu torn copies "
+      "discarded, %llu truncated, %llu inconsistent\n",
+      (unsigned long long) reads, (unsigned long long) previous,
+      (unsigned long long) subscriber.torn,
+      (unsigned long long) truncated, (unsigned long long) bad);
+    subscriber.close ();
+    return bad || ! reads;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  options_t o;
+  if (! parse (argc, argv, o)) {
+    std::fprintf (stderr, "usage: observe [-name NAME] [-attach] "
+      "[-frames N] [-size WxH] [-count P] [-interval US]\n");
+    return 2;
+  }
+  if (o.attach) return observe (o);
+  std::fflush (stdout);
+  pid_t child = ::fork ();
+  if (child < 0) return 1;
+  if (! child) std::exit (publish (o));
+  int result = observe (o);
+  int status;
+  if (::waitpid (child, & status, 0) != child || ! WIFEXITED (status)
+      || WEXITSTATUS (status)) {
+    result = 1;
+  }
+  return result;
+}
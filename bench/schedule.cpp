@@ -0,0 +1,172 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Check of the frame scheduler's policy (scheduler.h) against a simulated
+// clock and window system, as MainWndProc uses it. For each scenario (a mode
+// and window size), the scheduler is polled for a number of simulated
+// seconds. A frame costs a fixed time plus a time per simulation step. An
+// uncapped frame is presented at the next vertical blank; a wait is a timer,
+// which expires at the next tick of the system timer after the wait. The
+// window is minimized for the middle fifth of the run, and then covered for
+// a tenth. Time is counted as visible or hidden according to the state at
+// the poll that began it.
+
+// The program prints, for the time the window is visible, the frames and
+// steps per second, and, for the time it is hidden, the frames, steps and
+// polls per second. It exits with status 1 if a hidden window is drawn or
+// simulated, if a capped rate is exceeded, if a capped scenario does not
+// keep the simulation within 10% of 60 steps per second, or if an uncapped
+// one does not draw and step at the refresh rate.
+
+// Usage: schedule [option value]...
+//   -seconds N       simulated seconds per scenario (default 10)
+//   -refresh HZ      display refresh rate (default 60)
+//   -granularity MS  system timer resolution (default 15.625)
+//   -frame-cost MS   time to draw a frame (default 2)
+//   -step-cost MS    time per simulation step (default 1)
+
+#include "scheduler.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+  struct scenario_t
+  {
+    const char * name;
+    schedule_mode_t mode;
+    int width, height;
+  };
+
+  const scenario_t scenarios [] = {
+    { "screensaver", schedule_screensaver, 1920, 1080 },
+    { "small-window", schedule_screensaver, 320, 240 },
+    { "persistent", schedule_persistent, 1920, 1080 },
+    { "preview", schedule_preview, 152, 112 },
+  };
+
+  struct options_t
+  {
+    double seconds;
+    double refresh;
+    double granularity;  // Seconds.
+    double frame_cost;   // Seconds.
+    double step_cost;    // Seconds.
+  };
+
+  // Simulated time, in microseconds.
+  std::uint64_t mock_now (void * context)
+  {
+    return * static_cast <std::uint64_t *> (context);
+  }
+
+  // The next multiple of "period" strictly after t.
+  std::uint64_t next_multiple (std::uint64_t t, double period)
+  {
+    return (std::uint64_t) ((std::floor (t / period) + 1.0) * period);
+  }
+
+  bool run_scenario (const scenario_t & scenario, const options_t & options)
+  {
+    std::uint64_t now = 0;
+    clock_source_t clock = { & mock_now, & now, 1000000 };
+    double end = options.seconds * 1e6;
+    double hidden_begin = 0.4 * end, occluded_begin = 0.6 * end;
+    double hidden_end = 0.7 * end;
+
+    scheduler_t scheduler;
+    scheduler.reset (clock, scenario.mode, scenario.width, scenario.height);
+    double vblank = 1e6 / options.refresh;
+    double timer_tick = options.granularity * 1e6;
+
+    unsigned frames [2] = { 0, 0 }, steps [2] = { 0, 0 }, polls [2] = { 0, 0 };
+    double seconds [2] = { 0.0, 0.0 };
+    while (now < end) {
+      std::uint64_t then = now;
+      bool hidden = now >= hidden_begin && now < hidden_end;
+      visibility_t visibility = ! hidden ? window_visible :
+        now < occluded_begin ? window_minimized : window_occluded;
+      unsigned wait;
+      unsigned n = scheduler.poll (visibility, wait);
+      ++ polls [hidden];
+      if (n) {
+        ++ frames [hidden];
+        steps [hidden] += n;
+        now += (std::uint64_t)
+          (1e6 * (options.frame_cost + n * options.step_cost));
+      }
+      if (wait) now = next_multiple (now + 1000 * wait, timer_tick);
+      else now = next_multiple (now, vblank);
+      seconds [hidden] += 1e-6 * (now - then);
+    }
+
+    double fps = frames [0] / seconds [0];
+    double sps = steps [0] / seconds [0];
+    double hidden_pps = polls [1] / seconds [1];
+    bool ok = ! frames [1] && ! steps [1];
+    if (scheduler.rate) {
+      ok = ok && fps <= scheduler.rate * 1.02 && std::fabs (sps - 60.0) < 6.0;
+    }
+    else {
+      double rate = options.refresh;
+      ok = ok && fps > rate * 0.98 && fps <= rate * 1.02 && sps == fps;
+    }
+    std::printf ("%-13s %5dx%-5d %4u %9.2f %9.2f %9u %9u %9.2f  %s\n",
+      scenario.name, scenario.width, scenario.height, scheduler.rate, fps,
+      sps, frames [1], steps [1], hidden_pps, ok ? "ok" : "FAIL");
+    return ok;
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-seconds N] [-refresh HZ] "
+      "[-granularity MS] [-frame-cost MS] [-step-cost MS]\n", program);
+    return 2;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  options_t options = { 10.0, 60.0, 15.625e-3, 2e-3, 1e-3 };
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (i + 1 == argc) return usage (argv [0]);
+    double value = std::atof (argv [++ i]);
+    if (value <= 0.0) return usage (argv [0]);
+    if (! std::strcmp (arg, "-seconds")) options.seconds = value;
+    else if (! std::strcmp (arg, "-refresh")) options.refresh = value;
+    else if (! std::strcmp (arg, "-granularity")) {
+      options.granularity = value * 1e-3;
+    }
+    else if (! std::strcmp (arg, "-frame-cost")) {
+      options.frame_cost = value * 1e-3;
+    }
+    else if (! std::strcmp (arg, "-step-cost")) {
+      options.step_cost = value * 1e-3;
+    }
+    else return usage (argv [0]);
+  }
+
+  std::printf ("%-13s %11s %4s %9s %9s %9s %9s %9s\n", "scenario", "size",
+    "cap", "frames/s", "steps/s", "hidden f", "hidden s", "polls/s");
+  bool ok = true;
+  for (const scenario_t & scenario : scenarios) {
+    ok = run_scenario (scenario, options) && ok;
+  }
+  std::printf ("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stand-in telemetry client (telemetry.h). Connects to a program's
+// telemetry endpoint (for example, frames -telemetry ADDRESS, built with
+// ENABLE_TELEMETRY) and reads records until the program closes it or
+// enough have been read. Each line must be one JSON object with a frame
+// number greater than the last. Prints the records read, the frames they
+// span and the records the server dropped, and the mean frame time; with
+// -echo, prints every line too. A pause after each line (-delay) plays a
+// slow client, so the server drops records; the frame loop should not
+// slow down. Exits with status 1 on a malformed or out-of-order record,
+// or if nothing could be read.
+
+// Usage: scrape ADDRESS [option value]...
+//   ADDRESS       Unix socket path, or localhost TCP port number
+//   -records N    stop after N records (default: read until closed)
+//   -delay MS     milliseconds to pause after each record (default 0)
+//   -echo         print each record
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+  int connect_to (const char * address)
+  {
+    char * end;
+    unsigned long port = std::strtoul (address, & end, 10);
+    if (* address && ! * end) {
+      if (! port || port > 65535) return -1;
+      int fd = ::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0) return -1;
+      sockaddr_in a = { };
+      a.sin_family = AF_INET;
+      a.sin_port = htons ((unsigned short) port);
+      a.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+      if (! ::connect (fd, (const sockaddr *) & a, sizeof a)) return fd;
+      ::close (fd);
+      return -1;
+    }
+    sockaddr_un a = { };
+    a.sun_family = AF_UNIX;
+    if (std::strlen (address) >= sizeof a.sun_path) return -1;
+    std::strcpy (a.sun_path, address);
+    int fd = ::socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (! ::connect (fd, (const sockaddr *) & a, sizeof a)) return fd;
+    ::close (fd);
+    return -1;
+  }
+
+  // A number member of a record, or -1.
+  double member (const std::string & line, const char * name)
+  {
+    std::string key = std::string ("\"") + name + "\":";
+    std::size_t k = line.find (key);
+    return k == std::string::npos ? -1.0
+      : std::atof (line.c_str () + k + key.size ());
+  }
+
+  bool well_formed (const std::string & line)
+  {
+    if (line.size () < 2 || line.front () != '{' || line.back () != '}') {
+      return false;
+    }
+    int depth = 0;
+    for (char c : line) {
+      if (c == '{') ++ depth;
+      else if (c == '}' && -- depth < 0) return false;
+    }
+    return ! depth;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  if (argc < 2) {
+    std::fprintf (stderr, "usage: scrape ADDRESS [-records N] [-delay MS] "
+      "[-echo]\n");
+    return 2;
+  }
+  const char * address = argv [1];
+  unsigned long limit = 0, delay = 0;
+  bool echo = false;
+  for (int i = 2; i < argc; ++ i) {
+    if (! std::strcmp (argv [i], "-echo")) echo = true;
+    else if (i + 1 < argc && ! std::strcmp (argv [i], "-records")) {
+      limit = std::strtoul (argv [++ i], nullptr, 10);
+    }
+    else if (i + 1 < argc && ! std::strcmp (argv [i], "-delay")) {
+      delay = std::strtoul (argv [++ i], nullptr, 10);
+    }
+    else {
+      std::fprintf (stderr, "scrape: bad option %s\n", argv [i]);
+      return 2;
+    }
+  }
+
+  // Wait up to five seconds for the endpoint.
+  int fd;
+  for (unsigned n = 0; (fd = connect_to (address)) < 0; ++ n) {
+    if (n == 500) {
+      std::fprintf (stderr, "scrape: cannot connect to %s\n", address);
+      return 1;
+    }
+    ::usleep (10000);
+  }
+
+  unsigned long records = 0, bad = 0;
+  double first = -1.0, last = 0.0, dropped = 0.0, frame_ms = 0.0;
+  std::string line;
+  char buffer [4096];
+  bool done = false;
+  while (! done) {
+    ssize_t n = ::recv (fd, buffer, sizeof buffer, 0);
+    if (n <= 0) break;
+    for (ssize_t k = 0; k != n && ! done; ++ k) {
+      if (buffer [k] != '\n') {
+        line += buffer [k];
+        continue;
+      }
+      double frame = member (line, "frame");
+      if (! well_formed (line) || frame <= last) ++ bad;
+      else {
+        if (first < 0.0) first = frame;
+        last = frame;
+        dropped = member (line, "dropped");
+        frame_ms += member (line, "frame_ms");
+      }
+      ++ records;
+      if (echo) std::printf ("%s\n", line.c_str ());
+      line.clear ();
+      if (limit && records == limit) done = true;
+      if (delay) ::usleep (delay * 1000);
+    }
+  }
+  ::close (fd);
+
+  std::printf ("scrape: %lu records, frames %.0f to %.0f, %.0f dropped by "
+    "the server, mean frame %.4f ms, %lu malformed\n", records,
+    first < 0.0 ? 0.0 : first, last, dropped,
+    records > bad ? frame_ms / (records - bad) : 0.0, bad);
+  return bad || ! records;
+}
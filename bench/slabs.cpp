@@ -0,0 +1,257 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Scaling benchmark for the slab domain decomposition (domain.h). One tank
+// (a window size and settings, with a fixed seed) is simulated by 1, 2, ...,
+// N local processes in turn. For each process count, after some warm-up
+// steps, a number of steps is timed by rank 0, including the exchanges, the
+// barriers, and the assembly and drawing of the draw list (against the null
+// graphics backend). The program prints the time per step, the speed-up and
+// parallel efficiency relative to one process, and the ghosts and migrations
+// exchanged per step. It exits with status 1 if the total number of objects
+// ever changes (an object lost or duplicated in a migration).
+
+// Usage: slabs [option value]...
+//   -processes N  largest process count (default: the number of CPUs)
+//   -seed N       random seed (default 1)
+//   -steps N      timed steps (default 200)
+//   -warmup N     untimed steps (default 20)
+//   -size WxH     window size (default 7680x2160, a video wall)
+//   -count P      trackbar positions, 0 to 100 (default 100, 50, 50, 0)
+//   -heat P
+//   -speed P
+//   -radius P
+//   -csv          print CSV rows instead of a table
+
+#include "compiler.h"
+#include "domain.h"
+#include "qpc.h"
+#include "settings.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+namespace
+{
+  const char * const trackbar_names [trackbar_count] = {
+    "-count", "-heat", "-speed", "-radius",
+  };
+
+  struct options_t
+  {
+    unsigned processes;
+    std::uint64_t seed;
+    unsigned steps;
+    unsigned warmup;
+    int width, height;
+    settings_t settings;
+    bool csv;
+  };
+
+  // Written by rank 0 of each run, read by the parent.
+  struct result_t
+  {
+    bool ok;
+    unsigned objects;
+    double ms_per_step;
+    double ghosts, migrations;  // Per step.
+  };
+
+  // Rank "rank" of a run: step, and (rank 0) time the steps and check the
+  // object count.
+  int run_rank (domain_t & domain, unsigned rank, const options_t & options,
+    result_t & result)
+  {
+    if (! domain.start (rank)) {
+      std::fprintf (stderr, "rank %u: start failed\n", rank);
+      return 1;
+    }
+    bool ok = true;
+    unsigned objects = 0;
+    double ghosts = 0.0, migrations = 0.0;
+    std::uint64_t t0 = 0;
+    for (unsigned n = 0; n != options.warmup + options.steps; ++ n) {
+      if (n == options.warmup) t0 = qpc ();
+      if (! domain.step ()) {
+        std::fprintf (stderr, "rank %u: out of memory\n", rank);
+        return 1;
+      }
+      if (rank == 0) {
+        domain_statistics_t s = domain.statistics ();
+        if (n == 0) objects = s.objects;
+        ok = ok && s.objects == objects;
+        if (n >= options.warmup) {
+          ghosts += s.ghosts;
+          migrations += s.migrations;
+        }
+      }
+    }
+    if (rank == 0) {
+      double steps = options.steps ? options.steps : 1;
+      result.ok = ok;
+      result.objects = objects;
+      result.ms_per_step = 1e3 * (qpc () - t0) / qpf () / steps;
+      result.ghosts = ghosts / steps;
+      result.migrations = migrations / steps;
+    }
+    return 0;
+  }
+
+  // One run, with "ranks" processes: this process (forked from the parent)
+  // is rank 0, and forks the others.
+  int run (unsigned ranks, const options_t & options, result_t & result)
+  {
+    void * p = ::operator new (sizeof (domain_t), std::align_val_t (16));
+    domain_t & domain = * new (p) domain_t {};
+    if (! domain.create (ranks, options.width, options.height,
+        options.settings, options.seed)) {
+      std::fprintf (stderr, "cannot create %u slabs\n", ranks);
+      return 1;
+    }
+    for (unsigned rank = 1; rank != ranks; ++ rank) {
+      pid_t pid = ::fork ();
+      if (pid < 0) {
+        std::perror ("fork");
+        return 1;
+      }
+      if (pid == 0) {
+        int status = run_rank (domain, rank, options, result);
+        domain.destroy ();
+        std::fflush (stdout);
+        ::_exit (status);
+      }
+    }
+    int status = run_rank (domain, 0, options, result);
+    for (unsigned rank = 1; rank != ranks; ++ rank) {
+      int child_status;
+      if (::wait (& child_status) < 0 || ! WIFEXITED (child_status)
+          || WEXITSTATUS (child_status)) {
+        status = 1;
+      }
+    }
+    domain.destroy ();
+    return status;
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-processes N] [-seed N] [-steps N] "
+      "[-warmup N] [-size WxH] [-count P] [-heat P] [-speed P] [-radius P] "
+      "[-csv]\n", program);
+    return 2;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  _mm_setcsr (_mm_getcsr () | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON));
+
+  long cpus = ::sysconf (_SC_NPROCESSORS_ONLN);
+  options_t options {
+    (unsigned) (cpus > 0 ? cpus : 1), 1, 200, 20, 7680, 2160,
+    { { 100, 50, 50, 0 } }, false
+  };
+
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (! std::strcmp (arg, "-csv")) {
+      options.csv = true;
+      continue;
+    }
+    if (i + 1 == argc) return usage (argv [0]);
+    const char * value = argv [++ i];
+    bool known = true;
+    if (! std::strcmp (arg, "-processes")) {
+      options.processes = std::atoi (value);
+      known = options.processes >= 1;
+    }
+    else if (! std::strcmp (arg, "-seed")) {
+      options.seed = std::strtoull (value, nullptr, 0);
+    }
+    else if (! std::strcmp (arg, "-steps")) options.steps = std::atoi (value);
+    else if (! std::strcmp (arg, "-warmup")) options.warmup = std::atoi (value);
+    else if (! std::strcmp (arg, "-size")) {
+      known = std::sscanf (value, "%dx%d", & options.width, & options.height)
+        == 2 && options.width > 0 && options.height > 0;
+    }
+    else {
+      known = false;
+      for (unsigned k = 0; k != trackbar_count; ++ k) {
+        if (! std::strcmp (arg, trackbar_names [k])) {
+          int pos = std::atoi (value);
+          options.settings.trackbar_pos [k] = pos < 0 ? 0 : pos > 100 ? 100
+            : pos;
+          known = true;
+        }
+      }
+    }
+    if (! known) return usage (argv [0]);
+  }
+
+  // Each run's rank 0 reports through a shared mapping.
+  void * p = ::mmap (nullptr, sizeof (result_t), PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    std::perror ("mmap");
+    return 1;
+  }
+  result_t & result = * static_cast <result_t *> (p);
+
+  if (options.csv) {
+    std::printf ("processes,objects,ms_per_step,speedup,efficiency,"
+      "ghosts_per_step,migrations_per_step,conserved\n");
+  }
+  else {
+    std::printf ("%9s %8s %9s %8s %10s %8s %10s\n", "processes", "objects",
+      "ms/step", "speed-up", "efficiency", "ghosts", "migrations");
+  }
+  std::fflush (stdout);
+
+  bool ok = true;
+  double base = 0.0;
+  for (unsigned ranks = 1; ranks <= options.processes; ++ ranks) {
+    result = result_t { false, 0, 0.0, 0.0, 0.0 };
+    pid_t pid = ::fork ();
+    if (pid < 0) {
+      std::perror ("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      int status = run (ranks, options, result);
+      std::fflush (stdout);
+      ::_exit (status);
+    }
+    int status;
+    if (::waitpid (pid, & status, 0) < 0 || ! WIFEXITED (status)
+        || WEXITSTATUS (status)) {
+      return 1;
+    }
+    if (ranks == 1) base = result.ms_per_step;
+    double speedup = base / result.ms_per_step;
+    const char * format = options.csv
+      ? "%u,%u,%.4f,%.3f,%.3f,%.1f,%.1f,%s\n"
+      : "%9u %8u %9.4f %8.3f %10.3f %8.1f %10.1f%s\n";
+    std::printf (format, ranks, result.objects, result.ms_per_step, speedup,
+      speedup / ranks, result.ghosts, result.migrations,
+      options.csv ? (result.ok ? "1" : "0") : result.ok ? "" : "  LOST");
+    std::fflush (stdout);
+    ok = ok && result.ok;
+  }
+  return ok ? 0 : 1;
+}
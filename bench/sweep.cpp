@@ -0,0 +1,198 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Ensemble runner, for parameter sweeps (ensemble.h). Simulates a number of
+// independent tanks at once, headless, one per thread, each with its own
+// seed (derived from the base seed). All members share a window size and
+// settings, except that one setting can be swept evenly across the
+// members. After some warm-up frames each member times a fixed number of
+// frames. The program prints, for each member, its seed, setting, object
+// count, mean and longest frame time and Markov transitions per frame, and
+// then the wall time and the aggregate throughput, in member frames and
+// object-frames per second. It exits with status 1 if a member fails to
+// start.
+
+// Usage: sweep [option value]...
+//   -members N    members (default: the number of CPUs)
+//   -threads N    threads (default: the number of CPUs)
+//   -seed N       base random seed (default 1)
+//   -frames N     timed frames per member (default 500)
+//   -warmup N     untimed frames per member (default 50)
+//   -size WxH     window size (default 1920x1080)
+//   -count P      trackbar positions, 0 to 100 (default 50, 50, 50, 50)
+//   -heat P
+//   -speed P
+//   -radius P
+//   -sweep NAME:LO:HI  spread trackbar NAME (count, heat, speed or radius)
+//                 evenly over LO to HI across the members
+//   -csv          print CSV rows instead of a table
+
+#include "ensemble.h"
+#include "settings.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <x86intrin.h>
+
+namespace
+{
+  const char * const trackbar_names [trackbar_count] = {
+    "count", "heat", "speed", "radius",
+  };
+
+  struct options_t
+  {
+    unsigned members;
+    unsigned threads;
+    std::uint64_t seed;
+    unsigned frames;
+    unsigned warmup;
+    int width, height;
+    settings_t settings;
+    int sweep;            // Trackbar swept, or -1.
+    int sweep_lo, sweep_hi;
+    bool csv;
+  };
+
+  int clamp_position (int pos)
+  {
+    return pos < 0 ? 0 : pos > 100 ? 100 : pos;
+  }
+
+  int trackbar_index (const char * name, std::size_t length)
+  {
+    for (unsigned k = 0; k != trackbar_count; ++ k) {
+      if (std::strlen (trackbar_names [k]) == length
+          && ! std::strncmp (name, trackbar_names [k], length)) {
+        return (int) k;
+      }
+    }
+    return -1;
+  }
+
+  int usage (const char * program)
+  {
+    std::fprintf (stderr, "usage: %s [-members N] [-threads N] [-seed N] "
+      "[-frames N] [-warmup N] [-size WxH] [-count P] [-heat P] [-speed P] "
+      "[-radius P] [-sweep NAME:LO:HI] [-csv]\n", program);
+    return 2;
+  }
+}
+
+int main (int argc, char * argv [])
+{
+  _mm_setcsr (_mm_getcsr () | (_MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON));
+
+  unsigned cpus = std::thread::hardware_concurrency ();
+  if (! cpus) cpus = 1;
+  options_t options {
+    cpus, cpus, 1, 500, 50, 1920, 1080, { { 50, 50, 50, 50 } }, -1, 0, 0,
+    false
+  };
+
+  for (int i = 1; i != argc; ++ i) {
+    const char * arg = argv [i];
+    if (! std::strcmp (arg, "-csv")) {
+      options.csv = true;
+      continue;
+    }
+    if (i + 1 == argc) return usage (argv [0]);
+    const char * value = argv [++ i];
+    bool known = true;
+    if (! std::strcmp (arg, "-members")) {
+      options.members = std::atoi (value);
+      known = options.members >= 1;
+    }
+    else if (! std::strcmp (arg, "-threads")) {
+      options.threads = std::atoi (value);
+      known = options.threads >= 1;
+    }
+    else if (! std::strcmp (arg, "-seed")) {
+      options.seed = std::strtoull (value, nullptr, 0);
+    }
+    else if (! std::strcmp (arg, "-frames")) options.frames = std::atoi (value);
+    else if (! std::strcmp (arg, "-warmup")) options.warmup = std::atoi (value);
+    else if (! std::strcmp (arg, "-size")) {
+      known = std::sscanf (value, "%dx%d", & options.width, & options.height)
+        == 2 && options.width > 0 && options.height > 0;
+    }
+    else if (! std::strcmp (arg, "-sweep")) {
+      const char * colon = std::strchr (value, ':');
+      options.sweep = colon ? trackbar_index (value, colon - value) : -1;
+      known = options.sweep >= 0 && std::sscanf (colon + 1, "%d:%d",
+        & options.sweep_lo, & options.sweep_hi) == 2;
+      options.sweep_lo = clamp_position (options.sweep_lo);
+      options.sweep_hi = clamp_position (options.sweep_hi);
+    }
+    else {
+      int k = * arg == '-' ? trackbar_index (arg + 1, std::strlen (arg + 1))
+        : -1;
+      known = k >= 0;
+      if (known) {
+        options.settings.trackbar_pos [k] = clamp_position (std::atoi (value));
+      }
+    }
+    if (! known) return usage (argv [0]);
+  }
+
+  std::vector <ensemble_member_t> members (options.members);
+  for (unsigned k = 0; k != options.members; ++ k) {
+    ensemble_member_t & member = members [k];
+    member = ensemble_member_t { };
+    member.seed = ensemble_seed (options.seed, k);
+    member.width = options.width;
+    member.height = options.height;
+    member.settings = options.settings;
+    if (options.sweep >= 0) {
+      int span = options.sweep_hi - options.sweep_lo;
+      int steps = options.members > 1 ? (int) options.members - 1 : 1;
+      member.settings.trackbar_pos [options.sweep] = options.sweep_lo
+        + (span * (int) k + (span < 0 ? - steps : steps) / 2) / steps;
+    }
+  }
+
+  ensemble_totals_t totals;
+  bool ok = run_ensemble (members.data (), options.members, options.threads,
+    options.warmup, options.frames, totals);
+
+  unsigned column = options.sweep >= 0 ? options.sweep : 0;
+  if (options.csv) {
+    std::printf ("member,seed,%s,objects,ms_mean,ms_max,transitions,ok\n",
+      trackbar_names [column]);
+  }
+  else {
+    std::printf ("%6s %20s %6s %8s %9s %9s %11s\n", "member", "seed",
+      trackbar_names [column], "objects", "ms mean", "ms max",
+      "transitions");
+  }
+  for (unsigned k = 0; k != options.members; ++ k) {
+    const ensemble_member_t & member = members [k];
+    const char * format = options.csv
+      ? "%u,%llu,%u,%u,%.4f,%.4f,%.2f,%s\n"
+      : "%6u %20llu %6u %8u %9.4f %9.4f %11.2f%s\n";
+    std::printf (format, k, (unsigned long long) member.seed,
+      (unsigned) member.settings.trackbar_pos [column], member.objects,
+      member.ms_mean, member.ms_max, member.transitions,
+      options.csv ? (member.ok ? "1" : "0") : member.ok ? "" : "  FAILED");
+  }
+  std::printf (options.csv ? "# threads,seconds,frames_per_s,"
+    "object_frames_per_s\n# %u,%.3f,%.1f,%.0f\n"
+    : "\nthreads %u, wall %.3f s, %.1f frames/s, %.0f object-frames/s\n",
+    options.threads < options.members ? options.threads : options.members,
+    totals.seconds, totals.frames_per_second,
+    totals.object_frames_per_second);
+  return ok ? 0 : 1;
+}
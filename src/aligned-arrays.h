@@ -19,12 +19,18 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 // Interface.
 
+// Make room for at least new_capacity elements in each of the arrays p,
+// which share one block of memory. The first "keep" elements of each array
+// are preserved. Returns false, leaving everything unchanged, if memory is
+// exhausted.
+
 template <typename ... P>
-inline void reallocate_aligned_arrays (
-  void *& memory, std::size_t & capacity, std::size_t new_capacity, P *& ... p);
+inline bool reallocate_aligned_arrays (void *& memory, std::size_t & capacity,
+  std::size_t new_capacity, std::size_t keep, P *& ... p);
 
 // Implementation.
 
@@ -37,31 +43,37 @@ namespace internal
     return (T) ((((std::intptr_t) p) + N - 1) & -N);
   }
 
-  inline void setp (std::size_t, char *)
+  inline void setp (std::size_t, char *, std::size_t)
   {
     // Base case for recursion.
   }
 
   template <typename T, typename ... P>
-  inline void setp (std::size_t capacity, char * base, T *& head, P *& ... rest)
+  inline void setp (std::size_t capacity, char * base, std::size_t keep,
+    T *& head, P *& ... rest)
   {
+    T * old = head;
     head = reinterpret_cast <T *> (base);
-    setp (capacity, base + capacity * sizeof (T), rest ...);
+    if (keep) std::memcpy (head, old, keep * sizeof (T));
+    setp (capacity, base + capacity * sizeof (T), keep, rest ...);
   }
 }
 
 template <typename ... P>
-inline void reallocate_aligned_arrays (
-  void *& memory, std::size_t & capacity, std::size_t new_capacity, P *& ... p)
+inline bool reallocate_aligned_arrays (void *& memory, std::size_t & capacity,
+  std::size_t new_capacity, std::size_t keep, P *& ... p)
 {
   if (new_capacity > capacity) {
-    deallocate (memory);
-    capacity = internal::align_up <16> (new_capacity);
-    std::size_t bytes_needed = capacity * (0 + ... + sizeof (P)) + 63;
-    memory = allocate (bytes_needed);
-    void * memp = internal::align_up <64> (memory);
-    internal::setp (capacity, (char *) memp, p ...);
+    std::size_t aligned_capacity = internal::align_up <16> (new_capacity);
+    std::size_t bytes_needed = aligned_capacity * (0 + ... + sizeof (P));
+    void * new_memory = pool_allocate (bytes_needed);
+    if (! new_memory) return false;
+    internal::setp (aligned_capacity, (char *) new_memory, keep, p ...);
+    pool_deallocate (memory);
+    memory = new_memory;
+    capacity = aligned_capacity;
   }
+  return true;
 }
 
 #endif
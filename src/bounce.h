@@ -18,6 +18,8 @@
 #define bounce_h
 
 #include "model.h"
+#include "collision-stats.h"
+#include "contact-events.h"
 #include "vector.h"
 
 namespace usr
@@ -31,6 +33,7 @@ namespace usr
 ALWAYS_INLINE
 inline void model_t::bounce (unsigned ix, unsigned iy)
 {
+  COLLISION_COUNT (collision_object_candidates);
   const object_t & A = objects [ix];
   const object_t & B = objects [iy];
   v4f s = { A.r + B.r, 0.0f, 0.0f, 0.0f };
@@ -38,10 +41,12 @@ inline void model_t::bounce (unsigned ix, unsigned iy)
   v4f dx = load4f (x [iy]) - load4f (x [ix]);
   v4f dxsq = dot (dx, dx);
   if (_mm_comilt_ss (dxsq, ssq)) { // Spheres interpenetrate?
+    COLLISION_COUNT (collision_object_contacts);
     v4f dv = load4f (v [iy]) - load4f (v [ix]);
     v4f dxdv = dot (dx, dv);
     v4f zero = _mm_setzero_ps ();
     if (_mm_comilt_ss (dxdv, zero)) { // Spheres approach?
+      COLLISION_COUNT (collision_object_approaches);
       v4f dxn = normalize (dx);
       v4f rw = _mm_set1_ps (A.r) * load4f (w [ix])
              + _mm_set1_ps (B.r) * load4f (w [iy]);
@@ -72,6 +77,11 @@ inline void model_t::bounce (unsigned ix, unsigned iy)
       store4f (v [iy], load4f (v [iy]) + muB * u);
       store4f (w [ix], load4f (w [ix]) - nuA * dxu);
       store4f (w [iy], load4f (w [iy]) - nuB * dxu); // sic
+      // The contact point divides the line of centres in the ratio of the
+      // radii; the impulse is B.m * muB * |u|.
+      CONTACT_EVENT (load4f (x [ix]) + _mm_set1_ps (A.r / (A.r + B.r)) * dx,
+        B.m * _mm_cvtss_f32 (muB * _mm_sqrt_ss (usq)), stats.frames, ix, iy,
+        contact_none);
     }
   }
 }
@@ -80,15 +90,18 @@ inline void model_t::bounce (unsigned ix, unsigned iy)
 ALWAYS_INLINE
 inline void model_t::wall_bounce (unsigned iw, unsigned ix)
 {
+  COLLISION_COUNT (collision_wall_candidates);
   object_t & A = objects [ix];
   v4f anchor = load4f (walls [iw] [0]);
   v4f normal = load4f (walls [iw] [1]);
   v4f s = dot (load4f (x [ix]) - anchor, normal);
   v4f R = _mm_set1_ps (A.r);
   if (_mm_comilt_ss (s, R)) { // Sphere penetrates plane?
+    COLLISION_COUNT (collision_wall_contacts);
     v4f vn = dot (load4f (v [ix]), normal);
     v4f zero = _mm_setzero_ps ();
     if (_mm_comilt_ss (vn, zero)) { // Sphere approaches plane?
+      COLLISION_COUNT (collision_wall_approaches);
       // A comprehensible version is left as an exercise to the reader.
       // vN is the normal component of v. (The normal is a unit vector.)
       // vF is the tangential contact velocity, composed of glide and spin.
@@ -110,6 +123,11 @@ inline void model_t::wall_bounce (unsigned iw, unsigned ix)
       v4f nu = _mm_movehl_ps (munu, munu);
       store4f (v [ix], load4f (v [ix]) - mu * uneg);
       store4f (w [ix], load4f (w [ix]) + nu * cross (rn, uneg));
+      // The contact point is the foot of the perpendicular from the centre
+      // to the wall; the impulse is A.m * mu * |uneg|.
+      CONTACT_EVENT (load4f (x [ix]) - s * normal,
+        A.m * _mm_cvtss_f32 (mu * _mm_sqrt_ss (dot (uneg, uneg))),
+        stats.frames, ix, contact_none, iw);
     }
   }
 }
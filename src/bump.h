@@ -35,6 +35,8 @@ struct step_t
 {
   // Returns { f, f, f, f } where f = step(t);
   v4f operator () (float t) const;
+  // Four arguments, one per lane: returns { step(t0), ..., step(t3) }.
+  v4f operator () (v4f t) const;
   void initialize (float t0, float t1);
 private:
   float c [4], T [4];
@@ -61,9 +63,47 @@ struct bumps_t
 {
   // Returns { f, g, f, g } where f = bump0(t), g = bump1(t).
   v4f operator () (float t) const;
+  // Four arguments, one per lane: f = { bump0(t0), ..., bump0(t3) } and
+  // g = { bump1(t0), ..., bump1(t3) }.
+  void operator () (v4f t, v4f & f, v4f & g) const;
   void initialize (const bump_specifier_t & b0, const bump_specifier_t & b1);
 private:
   float c [4] [4], S0 [4], T0 [4], U0 [4], V0 [4];
 };
 
+// The four-lane versions are inline, so that a loop calling them can keep
+// the broadcast coefficients in registers. They evaluate the same
+// polynomials as the one-lane versions (the results can differ by rounding).
+
+inline v4f step_t::operator () (v4f t) const
+{
+  v4f one = _mm_set1_ps (1.0f);
+  v4f f = (_mm_set1_ps (c [0]) + _mm_set1_ps (c [1]) * t)
+    + (_mm_set1_ps (c [2]) + _mm_set1_ps (c [3]) * t) * (t * t);
+  v4f ge0 = _mm_cmpge_ps (t, _mm_set1_ps (T [0]));
+  v4f ge1 = _mm_cmpge_ps (t, _mm_set1_ps (T [1]));
+  v4f lt1 = _mm_cmplt_ps (t, _mm_set1_ps (T [1]));
+  v4f lt3 = _mm_cmplt_ps (t, _mm_set1_ps (T [3]));
+  v4f f0 = _mm_and_ps (_mm_and_ps (ge0, lt1), f);
+  v4f f1 = _mm_and_ps (_mm_and_ps (ge1, lt3), one);
+  return f0 + f1;
+}
+
+inline void bumps_t::operator () (v4f t, v4f & f, v4f & g) const
+{
+  v4f val [4];
+  for (unsigned k = 0; k != 4; ++ k) {
+    v4f p = ((_mm_set1_ps (c [3] [k]) * t + _mm_set1_ps (c [2] [k])) * t
+      + _mm_set1_ps (c [1] [k])) * t + _mm_set1_ps (c [0] [k]);
+    v4f ltS = _mm_cmplt_ps (t, _mm_set1_ps (S0 [k]));
+    v4f geT = _mm_cmpge_ps (t, _mm_set1_ps (T0 [k]));
+    v4f x1 = _mm_andnot_ps (_mm_or_ps (ltS, geT), p);
+    v4f x2 = _mm_and_ps (ltS, _mm_set1_ps (U0 [k]));
+    v4f x3 = _mm_and_ps (geT, _mm_set1_ps (V0 [k]));
+    val [k] = _mm_or_ps (_mm_or_ps (x1, x2), x3);
+  }
+  f = val [0] + val [1];
+  g = val [2] + val [3];
+}
+
 #endif
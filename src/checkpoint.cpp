@@ -0,0 +1,266 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mswin.h"
+
+#include "checkpoint.h"
+
+#if CHECKPOINTS_ENABLED
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include "qpc.h"
+#endif
+
+#ifndef _WIN32
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const std::size_t alignment = 64;
+
+  std::uint64_t align_up (std::uint64_t n)
+  {
+    return (n + alignment - 1) & ~ std::uint64_t (alignment - 1);
+  }
+
+  // Fill in the offsets and file size.
+  void lay_out (checkpoint_header_t & header)
+  {
+    std::uint64_t offset = align_up (sizeof (checkpoint_header_t));
+    for (unsigned k = 0; k != checkpoint_array_count; ++ k) {
+      header.offset [k] = offset;
+      offset = align_up (offset + header.size [k]);
+    }
+    header.file_size = offset;
+  }
+
+  bool valid (const checkpoint_header_t & header, std::uint64_t file_size)
+  {
+    if (header.magic != checkpoint_magic
+        || header.version != checkpoint_version
+        || header.header_size != sizeof (checkpoint_header_t)
+        || header.file_size != file_size) {
+      return false;
+    }
+    for (unsigned k = 0; k != checkpoint_array_count; ++ k) {
+      if (header.offset [k] % alignment
+          || header.offset [k] > file_size
+          || header.size [k] > file_size - header.offset [k]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The file's contents, given one write call per block.
+  template <typename Write>
+  bool write_contents (const checkpoint_header_t & header,
+    const void * const (& arrays) [checkpoint_array_count], Write write)
+  {
+    static const char zeros [alignment] = { };
+    std::uint64_t position = sizeof header;
+    if (! write (& header, sizeof header)) return false;
+    for (unsigned k = 0; k != checkpoint_array_count; ++ k) {
+      if (! write (zeros, header.offset [k] - position)) return false;
+      if (! write (arrays [k], header.size [k])) return false;
+      position = header.offset [k] + header.size [k];
+    }
+    return write (zeros, header.file_size - position);
+  }
+}
+
+#ifdef _WIN32
+
+namespace
+{
+  std::uint64_t splitmix64 (std::uint64_t & x)
+  {
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+}
+
+bool checkpoint_write (const char * path, checkpoint_header_t & header,
+  const void * const (& arrays) [checkpoint_array_count])
+{
+  lay_out (header);
+  // A new file of our own (CREATE_NEW), with a name hard to guess, as in
+  // the POSIX version; try another name if it is taken.
+  char temp [MAX_PATH];
+  HANDLE file = INVALID_HANDLE_VALUE;
+  std::uint64_t seed = qpc () ^ std::uint64_t (::GetCurrentProcessId ()) << 32;
+  for (unsigned attempt = 0; attempt != 16; ++ attempt) {
+    std::uint64_t suffix = splitmix64 (seed);
+    if (std::snprintf (temp, sizeof temp, "%s.%012llx.tmp", path,
+        (unsigned long long) (suffix >> 16)) >= (int) sizeof temp) {
+      return false;
+    }
+    file = ::CreateFileA (temp, GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+      FILE_ATTRIBUTE_TEMPORARY, nullptr);
+    if (file != INVALID_HANDLE_VALUE
+        || ::GetLastError () != ERROR_FILE_EXISTS) {
+      break;
+    }
+  }
+  if (file == INVALID_HANDLE_VALUE) return false;
+  bool ok = write_contents (header, arrays,
+    [file] (const void * data, std::uint64_t n) {
+      DWORD written;
+      return ! n || (::WriteFile (file, data, (DWORD) n, & written, nullptr)
+        && written == n);
+    });
+  ok = ok && ::FlushFileBuffers (file);
+  ::CloseHandle (file);
+  ok = ok && ::MoveFileExA (temp, path,
+    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+  if (! ok) ::DeleteFileA (temp);
+  return ok;
+}
+
+bool checkpoint_map_t::open (const char * path)
+{
+  HANDLE file = ::CreateFileA (path, GENERIC_READ,
+    FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER file_size;
+  HANDLE mapping = nullptr;
+  base = nullptr;
+  if (::GetFileSizeEx (file, & file_size)
+      && std::uint64_t (file_size.QuadPart) >= sizeof (checkpoint_header_t)) {
+    mapping = ::CreateFileMappingA (file, nullptr, PAGE_READONLY, 0, 0,
+      nullptr);
+  }
+  if (mapping) {
+    base = ::MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle (mapping);
+  }
+  ::CloseHandle (file);
+  if (! base) return false;
+  header = static_cast <const checkpoint_header_t *> (base);
+  size = (std::size_t) file_size.QuadPart;
+  if (! valid (* header, size)) {
+    close ();
+    return false;
+  }
+  return true;
+}
+
+void checkpoint_map_t::close ()
+{
+  if (base) ::UnmapViewOfFile (base);
+  base = nullptr;
+  header = nullptr;
+}
+
+bool checkpoint_default_path (char * buffer, std::size_t buffer_size,
+  int width, int height, unsigned radius_pos)
+{
+  char directory [MAX_PATH + 1];
+  DWORD n = ::GetTempPathA (sizeof directory, directory);
+  if (! n || n > MAX_PATH) return false;
+  int m = std::snprintf (buffer, buffer_size, "%spolymorph-%dx%d-%u.ckpt",
+    directory, width, height, radius_pos);
+  return m > 0 && std::size_t (m) < buffer_size;
+}
+
+#else
+
+bool checkpoint_write (const char * path, checkpoint_header_t & header,
+  const void * const (& arrays) [checkpoint_array_count])
+{
+  lay_out (header);
+  // A new file of our own, with an unpredictable name (the directory may
+  // be shared, as /tmp is), mode 0600.
+  char temp [4096];
+  if (std::snprintf (temp, sizeof temp, "%s.XXXXXX", path)
+      >= (int) sizeof temp) {
+    return false;
+  }
+  int fd = ::mkstemp (temp);
+  if (fd < 0) return false;
+  ::fcntl (fd, F_SETFD, FD_CLOEXEC);
+  bool ok = write_contents (header, arrays,
+    [fd] (const void * data, std::uint64_t n) {
+      const char * p = static_cast <const char *> (data);
+      while (n) {
+        ssize_t written = ::write (fd, p, n);
+        if (written <= 0) return false;
+        p += written;
+        n -= written;
+      }
+      return true;
+    });
+  ok = ok && ! ::fsync (fd);
+  ok = ! ::close (fd) && ok;
+  ok = ok && ! ::rename (temp, path);
+  if (! ok) ::unlink (temp);
+  return ok;
+}
+
+bool checkpoint_map_t::open (const char * path)
+{
+  base = nullptr;
+  int fd = ::open (path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (! ::fstat (fd, & st)
+      && std::uint64_t (st.st_size) >= sizeof (checkpoint_header_t)) {
+    void * p = ::mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      base = p;
+      size = st.st_size;
+    }
+  }
+  ::close (fd);
+  if (! base) return false;
+  header = static_cast <const checkpoint_header_t *> (base);
+  if (! valid (* header, size)) {
+    close ();
+    return false;
+  }
+  return true;
+}
+
+void checkpoint_map_t::close ()
+{
+  if (base) ::munmap (const_cast <void *> (base), size);
+  base = nullptr;
+  header = nullptr;
+}
+
+bool checkpoint_default_path (char * buffer, std::size_t buffer_size,
+  int width, int height, unsigned radius_pos)
+{
+  const char * directory = std::getenv ("TMPDIR");
+  if (! directory || ! * directory) directory = "/tmp";
+  int m = std::snprintf (buffer, buffer_size,
+    "%s/polymorph-%ld-%dx%d-%u.ckpt", directory, (long) ::getuid (), width,
+    height, radius_pos);
+  return m > 0 && std::size_t (m) < buffer_size;
+}
+
+#endif
+
+#endif
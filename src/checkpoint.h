@@ -0,0 +1,108 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef checkpoint_h
+#define checkpoint_h
+
+#define ENABLE_CHECKPOINTS
+
+#if defined (ENABLE_CHECKPOINTS) && ! defined (TINY)
+#define CHECKPOINTS_ENABLED 1
+#else
+#define CHECKPOINTS_ENABLED 0
+#endif
+
+// Simulation checkpoints, for a warm start.
+
+// model_t::start places the objects by rejection sampling and then anneals
+// them for 24 steps, which at high counts takes a noticeable time, on every
+// resize. Given a checkpoint file, start instead resumes the annealed
+// population saved there, if the file was written for the same window size
+// and radius setting and holds at least as many objects as are wanted (the
+// first "count" objects are taken); otherwise it starts afresh and saves
+// the new population to the file, just after annealing. The file holds the
+// arrays x, v, u, w, e and objects, the kd-tree's permutation (whose order
+// decides the order of collisions) and the RNG state, so a model resumed
+// with the same count and "exact" (as the programs in bench do) continues
+// exactly as the original one did. The screensaver resumes without
+// "exact": it keeps its freshly seeded RNG and varies the hues and morph
+// phases, so warm starts do not repeat the same animation.
+
+// The file is the header below, followed by the arrays, each at an offset
+// aligned to 64 bytes, in the machine's byte order. It is mapped read-only
+// and the arrays are copied straight out; nothing is parsed. A file whose
+// magic number, version, header size, object size or length does not match
+// is ignored, as is one with an object whose system or point index is out of
+// range (see model_t::resume). It is written to a new temporary file with a
+// random name in the same directory, which is then renamed over the old one,
+// so readers see either the old file or the new one, never a partial file.
+
+#include <cstddef>
+#include <cstdint>
+
+const std::uint32_t checkpoint_magic = 0x4b43504du; // "MPCK"
+const std::uint32_t checkpoint_version = 1;
+
+enum checkpoint_array_t
+{
+  checkpoint_x, checkpoint_v, checkpoint_u, checkpoint_w, checkpoint_e,
+  checkpoint_objects, checkpoint_kdtree_index, checkpoint_array_count
+};
+
+struct checkpoint_header_t
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t header_size;   // sizeof (checkpoint_header_t)
+  std::uint32_t object_size;   // sizeof (object_t)
+  // The key: the population depends on these alone.
+  std::int32_t width, height;
+  std::uint32_t radius_pos;    // The radius trackbar.
+  std::uint32_t count;
+  std::uint64_t rng_state;
+  std::uint64_t offset [checkpoint_array_count];
+  std::uint64_t size [checkpoint_array_count];
+  std::uint64_t file_size;
+};
+
+// Write the header and arrays (the offsets and file size are filled in).
+bool checkpoint_write (const char * path, checkpoint_header_t & header,
+  const void * const (& arrays) [checkpoint_array_count]);
+
+// A checkpoint file, mapped read-only.
+struct checkpoint_map_t
+{
+  // Map and validate a file. Returns false (with nothing mapped) if the file
+  // does not exist or is not a valid checkpoint of this version.
+  bool open (const char * path);
+  void close ();
+  const void * array (checkpoint_array_t k) const
+  {
+    return static_cast <const char *> (base) + header->offset [k];
+  }
+
+  const checkpoint_header_t * header;
+private:
+  const void * base;
+  std::size_t size;
+};
+
+// A per-user file name for a checkpoint of the given key, in the temporary
+// directory. Returns false if it does not fit.
+bool checkpoint_default_path (char * buffer, std::size_t buffer_size,
+  int width, int height, unsigned radius_pos);
+
+#endif
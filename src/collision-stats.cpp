@@ -0,0 +1,132 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "collision-stats.h"
+
+#if COLLISION_STATS_ENABLED
+
+#include <cstring>
+
+thread_local collision_counts_t collision_frame_counts;
+
+namespace
+{
+  const unsigned bucket_count = 40;
+
+  struct collision_stats_t
+  {
+    std::uint64_t frames;
+    std::uint64_t objects;
+    collision_counts_t last;
+    std::uint64_t total [collision_counter_count];
+    std::uint64_t min [collision_counter_count];
+    std::uint64_t max [collision_counter_count];
+    std::uint64_t histogram [collision_counter_count] [bucket_count];
+  };
+
+  thread_local collision_stats_t collision_stats;
+
+  inline unsigned bucket (std::uint64_t value)
+  {
+    unsigned k = value ? 64 - __builtin_clzll (value) : 0;
+    return k < bucket_count ? k : bucket_count - 1;
+  }
+
+  inline double ratio (std::uint64_t a, std::uint64_t b)
+  {
+    return b ? double (a) / b : 0.0;
+  }
+}
+
+void collision_stats_end_frame (unsigned object_count)
+{
+  collision_stats_t & stats = collision_stats;
+  const collision_counts_t & frame = collision_frame_counts;
+  for (unsigned k = 0; k != collision_counter_count; ++ k) {
+    std::uint64_t value = frame.counts [k];
+    stats.total [k] += value;
+    if (! stats.frames || value < stats.min [k]) stats.min [k] = value;
+    if (! stats.frames || value > stats.max [k]) stats.max [k] = value;
+    ++ stats.histogram [k] [bucket (value)];
+  }
+  ++ stats.frames;
+  stats.objects += object_count;
+  stats.last = frame;
+  collision_stats_discard_frame ();
+}
+
+void collision_stats_discard_frame ()
+{
+  std::memset (& collision_frame_counts, 0, sizeof collision_frame_counts);
+}
+
+const collision_counts_t & collision_stats_last_frame ()
+{
+  return collision_stats.last;
+}
+
+void collision_stats_report (std::FILE * file)
+{
+  const collision_stats_t & stats = collision_stats;
+  if (! stats.frames) return;
+  std::fprintf (file, "Collision statistics, %llu frames, "
+    "%.1f objects per frame.\n\n", (unsigned long long) stats.frames,
+    double (stats.objects) / stats.frames);
+  std::fprintf (file, "%-18s %14s %12s %12s %12s\n",
+    "counter", "mean", "min", "max", "per object");
+  for (unsigned k = 0; k != collision_counter_count; ++ k) {
+    std::fprintf (file, "%-18s %14.1f %12llu %12llu %12.3f\n",
+      collision_counter_names [k], ratio (stats.total [k], stats.frames),
+      (unsigned long long) stats.min [k], (unsigned long long) stats.max [k],
+      ratio (stats.total [k], stats.objects));
+  }
+  const std::uint64_t * t = stats.total;
+  std::fprintf (file, "\nObject broadphase false positives: %.2f%%\n",
+    100.0 * (1.0 - ratio (t [collision_object_contacts],
+                          t [collision_object_candidates])));
+  std::fprintf (file, "Wall broadphase false positives: %.2f%%\n",
+    100.0 * (1.0 - ratio (t [collision_wall_contacts],
+                          t [collision_wall_candidates])));
+  std::fprintf (file, "Object contacts approaching: %.2f%%\n",
+    100.0 * ratio (t [collision_object_approaches],
+                   t [collision_object_contacts]));
+  std::fprintf (file, "Wall contacts approaching: %.2f%%\n",
+    100.0 * ratio (t [collision_wall_approaches],
+                   t [collision_wall_contacts]));
+}
+
+bool collision_stats_write (const char * filename)
+{
+  const collision_stats_t & stats = collision_stats;
+  std::FILE * file = std::fopen (filename, "w");
+  if (! file) return false;
+  // One row per non-empty bucket; the bucket holds frames whose value of
+  // the counter is in [low, high].
+  std::fprintf (file, "counter,low,high,frames\n");
+  for (unsigned k = 0; k != collision_counter_count; ++ k) {
+    for (unsigned b = 0; b != bucket_count; ++ b) {
+      if (! stats.histogram [k] [b]) continue;
+      std::uint64_t low = b ? std::uint64_t (1) << (b - 1) : 0;
+      std::uint64_t high = b + 1 == bucket_count
+        ? ~std::uint64_t (0)
+        : b ? (std::uint64_t (1) << b) - 1 : 0;
+      std::fprintf (file, "%s,%llu,%llu,%llu\n", collision_counter_names [k],
+        (unsigned long long) low, (unsigned long long) high,
+        (unsigned long long) stats.histogram [k] [b]);
+    }
+  }
+  return std::fclose (file) == 0;
+}
+
+#endif
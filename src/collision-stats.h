@@ -0,0 +1,103 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef collision_stats_h
+#define collision_stats_h
+
+//#define ENABLE_COLLISION_STATS
+
+#if defined (ENABLE_COLLISION_STATS) && ! defined (TINY)
+#define COLLISION_STATS_ENABLED 1
+#else
+#define COLLISION_STATS_ENABLED 0
+#endif
+
+// Collision detection statistics.
+
+// COLLISION_COUNT (counter) increments one of the counters below for the
+// current frame. collision_stats_end_frame adds the frame's value of each
+// counter to a histogram (bucket 0 counts frames with the value 0, bucket k
+// counts frames with a value in [2^(k-1), 2^k)) and keeps the frame's counts
+// for inspection. collision_stats_report prints the mean, minimum and maximum
+// per frame, with the broadphase false-positive rates; collision_stats_write
+// exports the histograms as CSV.
+
+// All state is per thread. When disabled the macros expand to nothing.
+
+#include <cstdint>
+#include <cstdio>
+
+enum collision_counter_t : unsigned
+{
+  collision_object_candidates,  // calls to bounce
+  collision_object_contacts,    // spheres interpenetrate
+  collision_object_approaches,  // spheres approach (impulse applied)
+  collision_object_pushes,      // kd-tree nodes pushed
+  collision_object_pops,        // kd-tree nodes popped
+  collision_object_leaves,      // kd-tree leaves visited
+  collision_wall_candidates,    // calls to wall_bounce
+  collision_wall_contacts,      // sphere penetrates wall
+  collision_wall_approaches,    // sphere approaches wall (impulse applied)
+  collision_wall_pushes,
+  collision_wall_pops,
+  collision_wall_leaves,
+  collision_counter_count
+};
+
+const char * const collision_counter_names [collision_counter_count] = {
+  "object_candidates",
+  "object_contacts",
+  "object_approaches",
+  "object_pushes",
+  "object_pops",
+  "object_leaves",
+  "wall_candidates",
+  "wall_contacts",
+  "wall_approaches",
+  "wall_pushes",
+  "wall_pops",
+  "wall_leaves",
+};
+
+struct collision_counts_t
+{
+  std::uint64_t counts [collision_counter_count];
+};
+
+#if COLLISION_STATS_ENABLED
+extern thread_local collision_counts_t collision_frame_counts;
+
+void collision_stats_end_frame (unsigned object_count);
+void collision_stats_discard_frame ();
+const collision_counts_t & collision_stats_last_frame ();
+void collision_stats_report (std::FILE * file);
+bool collision_stats_write (const char * filename);
+
+#define COLLISION_COUNT(counter) ++ collision_frame_counts.counts [counter]
+#define COLLISION_STATS_END_FRAME(object_count) \
+  collision_stats_end_frame (object_count)
+#define COLLISION_STATS_DISCARD_FRAME() collision_stats_discard_frame ()
+#define COLLISION_STATS_REPORT(file) collision_stats_report (file)
+#define COLLISION_STATS_WRITE(filename) collision_stats_write (filename)
+#else
+#define COLLISION_COUNT(counter)
+#define COLLISION_STATS_END_FRAME(object_count)
+#define COLLISION_STATS_DISCARD_FRAME()
+#define COLLISION_STATS_REPORT(file)
+#define COLLISION_STATS_WRITE(filename)
+#endif
+
+#endif
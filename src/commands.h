@@ -0,0 +1,66 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef commands_h
+#define commands_h
+
+// Settings changes for a running model (see model_t::post_setting).
+
+// The configure dialog (or any other thread) posts each setting that
+// changes, and the model applies the posted settings at the start of the
+// next frame. There is one slot per setting, holding the latest position
+// posted and a "pending" bit: posting stores both (a release store), and
+// the model takes a pending position by exchanging the slot with zero (an
+// acquire exchange). A position posted before the model takes the last one
+// replaces it, so however many changes are posted between frames (while
+// the preview is hidden, none is drawn), the model sees the newest of each
+// setting, and neither side ever waits for the other.
+
+#include "settings.h"
+#include <atomic>
+#include <cstdint>
+
+struct setting_slots_t
+{
+  // Producer.
+  void post (unsigned index, DWORD pos)
+  {
+    slots [index].store (pending | pos, std::memory_order_release);
+  }
+
+  // Consumer. Returns true if any setting was pending, having stored the
+  // pending positions in "settings".
+  bool take (settings_t & settings)
+  {
+    bool taken = false;
+    for (unsigned index = 0; index != trackbar_count; ++ index) {
+      std::atomic <std::uint32_t> & slot = slots [index];
+      if (! (slot.load (std::memory_order_relaxed) & pending)) continue;
+      std::uint32_t value = slot.exchange (0, std::memory_order_acquire);
+      if (value & pending) {
+        settings.trackbar_pos [index] = value & ~ pending;
+        taken = true;
+      }
+    }
+    return taken;
+  }
+
+private:
+  static const std::uint32_t pending = 0x80000000u;
+  std::atomic <std::uint32_t> slots [trackbar_count];
+};
+
+#endif
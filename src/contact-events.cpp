@@ -0,0 +1,69 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contact-events.h"
+
+#if CONTACT_EVENTS_ENABLED
+
+#include "memory.h"
+#include <new>
+
+thread_local contact_ring_t * contact_ring;
+
+unsigned contact_ring_t::read (contact_event_t * events, unsigned n)
+{
+  unsigned h = head.load (std::memory_order_relaxed);
+  unsigned t = tail.load (std::memory_order_acquire);
+  if (n > t - h) n = t - h;
+  for (unsigned k = 0; k != n; ++ k) {
+    events [k] = entries [(h + k) & (capacity - 1)];
+  }
+  head.store (h + n, std::memory_order_release);
+  return n;
+}
+
+void contact_ring_t::discard ()
+{
+  head.store (tail.load (std::memory_order_acquire),
+    std::memory_order_release);
+}
+
+contact_ring_t * contact_events_open (unsigned capacity)
+{
+  contact_events_close ();
+  unsigned n = 1;
+  while (n < capacity && n < 1u << 30) n <<= 1;
+  void * memory = pool_allocate (n * sizeof (contact_event_t));
+  if (! memory) return nullptr;
+  contact_ring_t * ring = new (std::nothrow) contact_ring_t ();
+  if (! ring) {
+    pool_deallocate (memory);
+    return nullptr;
+  }
+  ring->entries = static_cast <contact_event_t *> (memory);
+  ring->capacity = n;
+  contact_ring = ring;
+  return ring;
+}
+
+void contact_events_close ()
+{
+  contact_ring_t * ring = contact_ring;
+  if (! ring) return;
+  contact_ring = nullptr;
+  pool_deallocate (ring->entries);
+  delete ring;
+}
+
+#endif
@@ -0,0 +1,122 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef contact_events_h
+#define contact_events_h
+
+//#define ENABLE_CONTACT_EVENTS
+
+#if defined (ENABLE_CONTACT_EVENTS) && ! defined (TINY)
+#define CONTACT_EVENTS_ENABLED 1
+#else
+#define CONTACT_EVENTS_ENABLED 0
+#endif
+
+// Contact events: a record of each impulse applied by bounce and
+// wall_bounce (bounce.h), for consumers such as sound, analytics or visual
+// effects.
+
+// contact_events_open gives the calling thread a ring of events (the only
+// allocation); from then on, until contact_events_close, every impulse
+// that thread's models apply appends an event: the objects' indices (as
+// they are during the frame; removing objects renumbers the rest), or the
+// object's index and the wall's, the impulse's magnitude (the change in
+// momentum of either body) and the contact point. A thread without a ring
+// pays one test of a thread-local pointer per impulse.
+
+// The ring is single-producer, single-consumer, like the telemetry queue
+// (telemetry.h): the simulating thread writes, and any one thread (the same
+// one between frames, or another) reads, with contact_ring_t::read. When
+// the ring is full, new events are dropped and counted; the simulation
+// never waits.
+
+// When disabled the macros expand to nothing.
+
+#include <cstdint>
+
+const std::uint32_t contact_none = ~ std::uint32_t (0);
+
+struct contact_event_t
+{
+  float point [3];      // Contact point.
+  float impulse;        // Magnitude of the impulse.
+  std::uint32_t frame;  // Low bits of model_statistics_t::frames.
+  std::uint32_t a;      // Object index.
+  std::uint32_t b;      // Other object's index, or contact_none.
+  std::uint32_t wall;   // Wall index (see model_t::set_tank), or contact_none.
+};
+
+#if CONTACT_EVENTS_ENABLED
+
+#include "compiler.h"
+#include "vector.h"
+#include <atomic>
+
+struct contact_ring_t
+{
+  // Producer.
+  ALWAYS_INLINE void push (v4f point, float impulse, std::uint64_t frame,
+    unsigned a, unsigned b, unsigned wall)
+  {
+    unsigned t = tail.load (std::memory_order_relaxed);
+    if (t - head.load (std::memory_order_acquire) == capacity) {
+      dropped.store (dropped.load (std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+      return;
+    }
+    ALIGNED16 float p [4];
+    store4f (p, point);
+    contact_event_t & e = entries [t & (capacity - 1)];
+    e.point [0] = p [0];
+    e.point [1] = p [1];
+    e.point [2] = p [2];
+    e.impulse = impulse;
+    e.frame = (std::uint32_t) frame;
+    e.a = a;
+    e.b = b;
+    e.wall = wall;
+    tail.store (t + 1, std::memory_order_release);
+  }
+
+  // Consumer. Copy up to n events, oldest first, and free them. Returns the
+  // number copied.
+  unsigned read (contact_event_t * events, unsigned n);
+  // Free all the events.
+  void discard ();
+
+  contact_event_t * entries;
+  unsigned capacity;  // A power of two.
+  std::atomic <unsigned> head, tail;
+  std::atomic <std::uint64_t> dropped;
+};
+
+extern thread_local contact_ring_t * contact_ring;
+
+// Give the calling thread a ring of "capacity" events (rounded up to a
+// power of two). Returns the ring, or null if memory is short.
+contact_ring_t * contact_events_open (unsigned capacity);
+void contact_events_close ();
+
+#define CONTACT_EVENT(point, impulse, frame, a, b, wall) \
+  do { \
+    if (contact_ring_t * ring = contact_ring) \
+      ring->push (point, impulse, frame, a, b, wall); \
+  } while (false)
+#else
+#define CONTACT_EVENT(point, impulse, frame, a, b, wall)
+#endif
+
+#endif
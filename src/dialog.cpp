@@ -90,6 +90,12 @@ INT_PTR CALLBACK DialogProc (HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam)
       if (! ws->hwnd) {
         ws->hwnd = create_screensaver_window (* ws);
       }
+      else {
+        // The preview's model runs on this thread (between its frames
+        // now), so it can take the dialog's settings directly, whatever
+        // became of the positions posted meanwhile.
+        ws->model.apply_settings (ws->settings);
+      }
       if (ws->hwnd) {
         ::PostMessage (ws->hwnd, WM_APP, 0, 0);
       }
@@ -97,6 +103,23 @@ INT_PTR CALLBACK DialogProc (HWND hdlg, UINT msg, WPARAM wParam, LPARAM lParam)
     return TRUE;
   }
 
+  case WM_HSCROLL: {
+    // A trackbar has been moved. The preview's model, once there is one,
+    // takes the new position without restarting (see commands.h). The
+    // preview is hidden while the dialog is in use, so only the end of each
+    // movement is sent.
+    if (ws->hwnd && LOWORD (wParam) == TB_ENDTRACK) {
+      for (unsigned i = 0; i != trackbar_count; ++ i) {
+        HWND hitem = ::GetDlgItem (hdlg, IDC_TRACKBARS_START + 4 * i);
+        if ((HWND) lParam == hitem) {
+          DWORD pos = (DWORD) ::SendMessage (hitem, TBM_GETPOS, 0, 0);
+          ws->model.post_setting (i, pos);
+        }
+      }
+    }
+    return FALSE;
+  }
+
   case WM_NOTIFY: {
     LPNMHDR notify = (LPNMHDR) lParam;
     if (notify->idFrom == IDC_SYSLINK
@@ -0,0 +1,325 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "domain.h"
+#include "memory.h"
+#include "partition.h"
+#include "trace.h"
+#include <pthread.h>
+#include <sys/mman.h>
+
+namespace usr
+{
+  // Width of the ghost zones, in units of the (largest) object radius.
+  const float ghost_margin = 2.25f;
+  // Smallest slab width, in units of the radius: a migrating object must
+  // land in the neighbouring slab.
+  const float min_slab_width = 4.0f;
+}
+
+namespace
+{
+  // Mailboxes: each rank's outgoing ghosts and migrations for each
+  // neighbour, and its objects to draw.
+  enum mailbox_kind_t : unsigned
+  {
+    ghosts_left, ghosts_right, migrations_left, migrations_right, drawn,
+    mailbox_kind_count
+  };
+
+  struct rank_statistics_t
+  {
+    unsigned objects, ghosts, migrations;
+  };
+
+  const float unbounded = 0x1.0P+100f;
+}
+
+// The header of the shared mapping. It is followed by the mailboxes' counts
+// (unsigned [ranks] [mailbox_kind_count]) and the ranks' statistics, and
+// then by the mailboxes, each with "capacity" records (enough for every
+// object in the tank, so none can overflow; pages of the mapping are only
+// committed when touched).
+struct domain_shared_t
+{
+  pthread_barrier_t barrier;
+  std::size_t header_size;
+};
+
+namespace
+{
+  std::size_t round_up (std::size_t n)
+  {
+    return (n + pool_alignment - 1) & ~ (pool_alignment - 1);
+  }
+
+  unsigned * counts (domain_shared_t * shared, unsigned rank)
+  {
+    typedef unsigned row_t [mailbox_kind_count];
+    return reinterpret_cast <row_t *> (shared + 1) [rank];
+  }
+
+  rank_statistics_t * rank_statistics (domain_shared_t * shared,
+    unsigned ranks)
+  {
+    return reinterpret_cast <rank_statistics_t *> (counts (shared, ranks));
+  }
+}
+
+bool domain_t::create (unsigned new_ranks, int new_width, int new_height,
+  const settings_t & new_settings, std::uint64_t new_seed)
+{
+  ranks = new_ranks;
+  width = new_width;
+  height = new_height;
+  settings = new_settings;
+  seed = new_seed;
+
+  // Find out how many objects there are by starting a model.
+  model.initialize (seed);
+  if (! model.start (width, height, settings)) return false;
+  capacity = model.count;
+
+  std::size_t header_size = round_up (sizeof (domain_shared_t)
+    + ranks * (sizeof (unsigned [mailbox_kind_count])
+      + sizeof (rank_statistics_t)));
+  shared_size = header_size
+    + ranks * mailbox_kind_count * capacity * sizeof (object_state_t);
+  void * p = ::mmap (nullptr, shared_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) return false;
+  shared = static_cast <domain_shared_t *> (p);
+  shared->header_size = header_size;
+
+  pthread_barrierattr_t attr;
+  ::pthread_barrierattr_init (& attr);
+  ::pthread_barrierattr_setpshared (& attr, PTHREAD_PROCESS_SHARED);
+  int error = ::pthread_barrier_init (& shared->barrier, & attr, ranks);
+  ::pthread_barrierattr_destroy (& attr);
+  if (error) {
+    ::munmap (p, shared_size);
+    return false;
+  }
+  return true;
+}
+
+void domain_t::destroy ()
+{
+  if (rank == 0) ::pthread_barrier_destroy (& shared->barrier);
+  ::munmap (shared, shared_size);
+  deallocate (marks);
+  deallocate (heads);
+}
+
+object_state_t * domain_t::mailbox (unsigned owner, unsigned kind) const
+{
+  char * base = reinterpret_cast <char *> (shared) + shared->header_size;
+  std::size_t index = std::size_t (owner) * mailbox_kind_count + kind;
+  return reinterpret_cast <object_state_t *> (base)
+    + index * capacity;
+}
+
+void domain_t::wait ()
+{
+  TRACE_SCOPE ("wait");
+  ::pthread_barrier_wait (& shared->barrier);
+}
+
+bool domain_t::start (unsigned new_rank)
+{
+  rank = new_rank;
+  // The model was started in create (before the fork); start it again so
+  // that every rank begins from the same state, whatever create did.
+  model.rng.initialize (seed);
+  if (! model.start (width, height, settings)) return false;
+
+  // The tank's extent in x is that of the spawning box, plus the radius.
+  float x0 = model.spawn_box [0] [0];
+  float half = model.spawn_box [1] [0] + model.radius;
+  float slab = 2.0f * half / ranks;
+  if (ranks > 1 && slab < usr::min_slab_width * model.radius) return false;
+  lo = rank == 0 ? - unbounded : x0 - half + rank * slab;
+  hi = rank == ranks - 1 ? unbounded : x0 - half + (rank + 1) * slab;
+
+  // Keep only the objects in this slab. Reseed, so the ranks' animations
+  // are independent.
+  marks_capacity = 2 * capacity;
+  marks = static_cast <std::uint8_t *> (allocate (marks_capacity));
+  if (! marks) return false;
+  for (unsigned n = 0; n != model.count; ++ n) {
+    marks [n] = model.x [n] [0] < lo || model.x [n] [0] >= hi;
+  }
+  model.remove_objects (marks);
+  model.rng.initialize (seed + 0x9e3779b97f4a7c15ull * (rank + 1));
+
+  if (rank == 0) {
+    heads = static_cast <unsigned *> (allocate (ranks * sizeof (unsigned)));
+    if (! heads) return false;
+    display.initialize (seed);
+    if (! display.initialize_graphics ()) return false;
+    if (! display.start (width, height, settings)) return false;
+  }
+  return true;
+}
+
+bool domain_t::step ()
+{
+  TRACE_SCOPE ("domain step");
+  unsigned * my_counts = counts (shared, rank);
+  float margin = usr::ghost_margin * model.radius;
+
+  // 1. Publish ghosts.
+  {
+    TRACE_SCOPE ("publish ghosts");
+    unsigned left = 0, right = 0;
+    object_state_t * to_left = mailbox (rank, ghosts_left);
+    object_state_t * to_right = mailbox (rank, ghosts_right);
+    for (unsigned n = 0; n != model.count; ++ n) {
+      float x = model.x [n] [0];
+      if (rank != 0 && x < lo + margin) {
+        model.export_object (n, to_left [left ++]);
+      }
+      if (rank != ranks - 1 && x >= hi - margin) {
+        model.export_object (n, to_right [right ++]);
+      }
+    }
+    my_counts [ghosts_left] = left;
+    my_counts [ghosts_right] = right;
+  }
+  wait ();
+
+  // 2. Import the neighbours' ghosts, and advance.
+  unsigned owned = model.count, ghosts = 0;
+  if (rank != 0) {
+    unsigned n = counts (shared, rank - 1) [ghosts_right];
+    if (! model.import_objects (mailbox (rank - 1, ghosts_right), n)) {
+      return false;
+    }
+    ghosts += n;
+  }
+  if (rank != ranks - 1) {
+    unsigned n = counts (shared, rank + 1) [ghosts_left];
+    if (! model.import_objects (mailbox (rank + 1, ghosts_left), n)) {
+      return false;
+    }
+    ghosts += n;
+  }
+  model.advance ();
+
+  // 3. Drop the ghosts, and hand over the objects that have left the slab.
+  {
+    TRACE_SCOPE ("migrate");
+    std::size_t count = model.count;
+    if (count > marks_capacity) {
+      deallocate (marks);
+      marks_capacity = 2 * count;
+      marks = static_cast <std::uint8_t *> (allocate (marks_capacity));
+      if (! marks) return false;
+    }
+    unsigned left = 0, right = 0;
+    object_state_t * to_left = mailbox (rank, migrations_left);
+    object_state_t * to_right = mailbox (rank, migrations_right);
+    for (unsigned n = 0; n != owned; ++ n) {
+      float x = model.x [n] [0];
+      bool out_left = x < lo, out_right = x >= hi;
+      if (out_left) model.export_object (n, to_left [left ++]);
+      if (out_right) model.export_object (n, to_right [right ++]);
+      marks [n] = out_left || out_right;
+    }
+    for (unsigned n = owned; n != count; ++ n) marks [n] = 1;
+    model.remove_objects (marks);
+    my_counts [migrations_left] = left;
+    my_counts [migrations_right] = right;
+  }
+  wait ();
+
+  // Take the neighbours' migrations.
+  unsigned migrations = 0;
+  if (rank != 0) {
+    unsigned n = counts (shared, rank - 1) [migrations_right];
+    if (! model.import_objects (mailbox (rank - 1, migrations_right), n)) {
+      return false;
+    }
+    migrations += n;
+  }
+  if (rank != ranks - 1) {
+    unsigned n = counts (shared, rank + 1) [migrations_left];
+    if (! model.import_objects (mailbox (rank + 1, migrations_left), n)) {
+      return false;
+    }
+    migrations += n;
+  }
+
+  // 4. Publish the objects in depth order (maintained as in draw_next).
+  {
+    TRACE_SCOPE ("publish objects");
+    if (model.count) {
+      insertion_sort (model.object_order, model.x, 2, 0, model.count);
+    }
+    object_state_t * out = mailbox (rank, drawn);
+    for (unsigned n = 0; n != model.count; ++ n) {
+      model.export_object (model.object_order [n], out [n]);
+    }
+    my_counts [drawn] = model.count;
+    rank_statistics (shared, ranks) [rank] = { model.count, ghosts,
+      migrations };
+  }
+  wait ();
+
+  if (rank == 0) assemble ();
+  return true;
+}
+
+// Merge the ranks' objects, each list in depth order, into the display
+// model, and draw them.
+void domain_t::assemble ()
+{
+  TRACE_SCOPE ("assemble");
+  model_t & d = display;
+  unsigned total = 0;
+  for (unsigned r = 0; r != ranks; ++ r) {
+    heads [r] = 0;
+    total += counts (shared, r) [drawn];
+  }
+  d.count = 0;
+  d.fading = 0;
+  d.fading_out = 0;
+  for (unsigned n = 0; n != total; ++ n) {
+    // The farthest (least z) of the ranks' next objects.
+    unsigned best = ranks;
+    float best_z = 0.0f;
+    for (unsigned r = 0; r != ranks; ++ r) {
+      if (heads [r] == counts (shared, r) [drawn]) continue;
+      float z = mailbox (r, drawn) [heads [r]].x [2];
+      if (best == ranks || z < best_z) {
+        best = r;
+        best_z = z;
+      }
+    }
+    d.import_objects (mailbox (best, drawn) + heads [best] ++, 1);
+  }
+  d.render ();
+}
+
+domain_statistics_t domain_t::statistics () const
+{
+  domain_statistics_t result = { 0, 0, 0 };
+  const rank_statistics_t * s = rank_statistics (shared, ranks);
+  for (unsigned r = 0; r != ranks; ++ r) {
+    result.objects += s [r].objects;
+    result.ghosts += s [r].ghosts;
+    result.migrations += s [r].migrations;
+  }
+  return result;
+}
@@ -0,0 +1,95 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef domain_h
+#define domain_h
+
+// Slab domain decomposition, for tanks with more objects than one process
+// can simulate (video walls). POSIX only; see the host section of the
+// Makefile, and bench/slabs.cpp.
+
+// The tank is divided along the x axis into equal slabs, one per process
+// ("rank"), on one host. Every rank starts the same model (same seed,
+// window size and settings) and keeps the objects in its slab, so the
+// initial state is that of the undivided tank. Each step:
+
+// 1. Each rank publishes copies ("ghosts") of its objects within reach of a
+//    collision (twice the radius, and a little more) of each interior slab
+//    boundary, for the neighbour on that side.
+// 2. Each rank adds its neighbours' ghosts to its model, and advances it by
+//    one frame. A collision between an object and a ghost changes both, but
+//    only the change to the object is kept: the neighbour makes the same
+//    collision (in its own order, so the results agree only approximately).
+// 3. Each rank drops the ghosts, and hands over ("migrates") to the
+//    neighbour any object that has left its slab.
+// 4. Each rank publishes its objects in depth order, and rank 0 merges them
+//    into the draw list of a display model, and draws it.
+
+// The ranks exchange ghosts, migrations and the objects to draw through a
+// shared memory mapping, made before the processes are forked, and step in
+// lockstep with a process-shared barrier (three waits per step).
+
+#include "compiler.h"
+#include "model.h"
+#include "settings.h"
+#include <cstddef>
+#include <cstdint>
+
+struct domain_shared_t;
+
+struct domain_statistics_t
+{
+  unsigned objects;     // Objects in all slabs.
+  unsigned ghosts;      // Ghosts exchanged in the last step.
+  unsigned migrations;  // Objects migrated in the last step.
+};
+
+struct domain_t
+{
+  // Map the shared memory for "ranks" processes. Call before forking.
+  bool create (unsigned ranks, int width, int height,
+    const settings_t & settings, std::uint64_t seed);
+  // In each process, once: start this rank's model (and in rank 0, the
+  // display model).
+  bool start (unsigned rank);
+  // Advance one step. In rank 0, also assemble and draw the draw list.
+  bool step ();
+  // Rank 0 only: totals as of the last step.
+  domain_statistics_t statistics () const;
+  // Unmap the shared memory (in every process).
+  void destroy ();
+
+  unsigned rank, ranks;
+  float lo, hi;         // This rank's slab (of x).
+private:
+  void wait ();
+  object_state_t * mailbox (unsigned owner, unsigned kind) const;
+  void assemble ();
+
+  domain_shared_t * shared;
+  std::size_t shared_size;
+  std::size_t capacity;  // Objects per mailbox.
+  int width, height;
+  settings_t settings;
+  std::uint64_t seed;
+  std::uint8_t * marks;
+  std::size_t marks_capacity;
+  unsigned * heads;      // Merge positions (rank 0).
+  ALIGNED16 model_t model;
+  ALIGNED16 model_t display;
+};
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ensemble.h"
+#include "compiler.h"
+#include "model.h"
+#include "qpc.h"
+#include "trace.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct shared_t
+  {
+    ensemble_member_t * members;
+    unsigned count;
+    unsigned warmup, frames;
+    std::atomic <unsigned> next;
+    std::atomic <std::uint64_t> member_frames;
+    std::atomic <std::uint64_t> object_frames;
+  };
+
+  bool run_member (ensemble_member_t & member, unsigned warmup,
+    unsigned frames, std::uint64_t & object_frames)
+  {
+    TRACE_SCOPE ("ensemble member");
+    ALIGNED16 model_t model {};
+    model.initialize (member.seed);
+    if (! model.start (member.width, member.height, member.settings)) {
+      return false;
+    }
+    for (unsigned n = 0; n != warmup; ++ n) {
+      model.draw_next ();
+      object_frames += model.object_count ();
+    }
+    std::uint64_t transitions = model.statistics ().transitions;
+    std::uint64_t total = 0, longest = 0;
+    for (unsigned n = 0; n != frames; ++ n) {
+      std::uint64_t t0 = qpc ();
+      model.draw_next ();
+      std::uint64_t t = qpc () - t0;
+      total += t;
+      if (longest < t) longest = t;
+      object_frames += model.object_count ();
+    }
+    double ms = 1e3 / qpf (), n = frames ? frames : 1;
+    member.objects = model.object_count ();
+    member.ms_mean = total * ms / n;
+    member.ms_max = longest * ms;
+    member.transitions = (model.statistics ().transitions - transitions) / n;
+    return true;
+  }
+
+  void worker (shared_t & shared)
+  {
+    std::uint64_t member_frames = 0, object_frames = 0;
+    for (;;) {
+      unsigned k = shared.next.fetch_add (1, std::memory_order_relaxed);
+      if (k >= shared.count) break;
+      ensemble_member_t & member = shared.members [k];
+      member.ok = run_member (member, shared.warmup, shared.frames,
+        object_frames);
+      if (member.ok) member_frames += shared.warmup + shared.frames;
+    }
+    shared.member_frames += member_frames;
+    shared.object_frames += object_frames;
+  }
+}
+
+std::uint64_t ensemble_seed (std::uint64_t base, unsigned k)
+{
+  // SplitMix64 of base + k (see random.cpp).
+  std::uint64_t z = base + 0x9e3779b97f4a7c15ull * (k + 1);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+bool run_ensemble (ensemble_member_t * members, unsigned count,
+  unsigned threads, unsigned warmup, unsigned frames,
+  ensemble_totals_t & totals)
+{
+  shared_t shared;
+  shared.members = members;
+  shared.count = count;
+  shared.warmup = warmup;
+  shared.frames = frames;
+  shared.next = 0;
+  shared.member_frames = 0;
+  shared.object_frames = 0;
+  if (threads > count) threads = count;
+  if (! threads) threads = 1;
+
+  std::uint64_t t0 = qpc ();
+  std::vector <std::thread> workers;
+  for (unsigned t = 1; t != threads; ++ t) {
+    workers.emplace_back (worker, std::ref (shared));
+  }
+  worker (shared);
+  for (std::thread & w : workers) w.join ();
+  double seconds = (qpc () - t0) / (double) qpf ();
+
+  bool ok = true;
+  for (unsigned k = 0; k != count; ++ k) ok = ok && members [k].ok;
+  totals.seconds = seconds;
+  totals.frames_per_second = seconds > 0.0
+    ? shared.member_frames / seconds : 0.0;
+  totals.object_frames_per_second = seconds > 0.0
+    ? shared.object_frames / seconds : 0.0;
+  return ok;
+}
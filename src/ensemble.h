@@ -0,0 +1,70 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ensemble_h
+#define ensemble_h
+
+// Ensembles: many independent models simulated at once, one per thread,
+// for parameter studies. Host build only; see bench/sweep.cpp.
+
+// Each member has its own seed, window size and settings, and runs
+// headless (initialize without initialize_graphics). run_ensemble starts
+// "threads" threads, each of which repeatedly takes the next member not yet
+// run, starts its model and runs it for the warm-up and the timed frames;
+// so a member runs start to finish on one thread, and the members' frames
+// are not synchronized with each other.
+
+// Nothing is shared between the members' models, except the process's
+// memory allocators and, when enabled, the memory statistics (memory.h),
+// which are process-wide. The other instrumentation (phase times, perf
+// counters, collision statistics, traces) is per thread.
+
+#include "settings.h"
+#include <cstdint>
+
+struct ensemble_member_t
+{
+  // Input.
+  std::uint64_t seed;
+  int width, height;
+  settings_t settings;
+
+  // Output, for the timed frames.
+  bool ok;              // The model started.
+  unsigned objects;     // At the end of the run.
+  double ms_mean;       // Frame time.
+  double ms_max;
+  double transitions;   // Markov transitions per frame.
+};
+
+struct ensemble_totals_t
+{
+  double seconds;                   // Wall time, start to finish.
+  // Over the wall time, counting every frame (warm-up and timed).
+  double frames_per_second;         // Member frames.
+  double object_frames_per_second;  // Objects advanced one frame.
+};
+
+// The seed of member k, for a base seed (distinct members get
+// well-separated seeds, even for consecutive base seeds).
+std::uint64_t ensemble_seed (std::uint64_t base, unsigned k);
+
+// Run the members. Returns false if any failed to start.
+bool run_ensemble (ensemble_member_t * members, unsigned count,
+  unsigned threads, unsigned warmup, unsigned frames,
+  ensemble_totals_t & totals);
+
+#endif
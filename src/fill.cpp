@@ -0,0 +1,119 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fill.h"
+#include "graphics.h"
+#include "rodrigues.h"
+#include "vector.h"
+#include <cstddef>
+
+namespace
+{
+  // Lane k of v, in all four lanes.
+  template <int k> ALWAYS_INLINE inline v4f lane (v4f v)
+  {
+    return SHUFPS (v, v, (k, k, k, k));
+  }
+
+  // The colour channel with the given offset (1/6 for red, 5/6 for green,
+  // 1/2 for blue), for four hues (see hue_vector in hsv-to-rgb.h).
+  ALWAYS_INLINE inline v4f channel (v4f hue, v4f offset, v4f vs, v4f v)
+  {
+    v4f temp = hue + offset;
+    v4f theta = // fmod (temp, 6.0)
+      _mm_set1_ps (6.0f) * (temp - _mm_cvtepi32_ps (_mm_cvttps_epi32 (temp)));
+    v4f lt2 = theta < _mm_set1_ps (2.0f);
+    v4f lt3 = theta < _mm_set1_ps (3.0f);
+    v4f b23 = _mm_xor_ps (lt2, lt3);
+    v4f ge5 = theta >= _mm_set1_ps (5.0f);
+    v4f term1 = _mm_and_ps (lt2, _mm_set1_ps (1.0f));
+    v4f term2 = _mm_and_ps (b23, _mm_set1_ps (3.0f) - theta);
+    v4f term3 = _mm_and_ps (ge5, theta - _mm_set1_ps (5.0f));
+    return v - vs * _mm_or_ps (_mm_or_ps (term1, term2), term3);
+  }
+
+  // Object k of a group of four: store its colour, coefficients and flag.
+  template <int k> ALWAYS_INLINE inline
+  void store (char * block, v4f d, v4f r, v4f s, v4f c, const float * g0,
+    const float * e, GLuint snub)
+  {
+    object_data_t & data = * (object_data_t *) block;
+    store4f (data.d, d);
+    v4f g = lane <k> (c) * load4f (g0) + lane <k> (s) * load4f (e);
+    store4f (data.g, lane <k> (r) * g);
+    data.s = snub;
+  }
+}
+
+void fill_blocks (char * buffer, std::size_t stride, const unsigned * order,
+  unsigned count, const object_t * objects, const float (* e) [4],
+  const float (* abc) [8] [4], const bumps_t & bumps, const step_t & step,
+  float alpha)
+{
+  const v4f red = _mm_set1_ps (0x1.555556p-3f);
+  const v4f green = _mm_set1_ps (0x1.aaaaaap-1f);
+  const v4f blue = _mm_set1_ps (0.5f);
+  const v4f a = _mm_set1_ps (alpha);
+
+  for (unsigned n = 0; n < count; n += 4) {
+    // Gather the group (repeating the last object to fill a short group).
+    const object_t * obj [4];
+    unsigned m [4];
+    for (unsigned k = 0; k != 4; ++ k) {
+      m [k] = order [n + k < count ? n + k : count - 1];
+      obj [k] = & objects [m [k]];
+    }
+    v4f time = _mm_setr_ps (obj [0]->animation_time, obj [1]->animation_time,
+      obj [2]->animation_time, obj [3]->animation_time);
+    v4f hue = _mm_setr_ps (obj [0]->hue, obj [1]->hue, obj [2]->hue,
+      obj [3]->hue);
+    v4f length = _mm_setr_ps (obj [0]->locus_length, obj [1]->locus_length,
+      obj [2]->locus_length, obj [3]->locus_length);
+    v4f r = _mm_setr_ps (obj [0]->r, obj [1]->r, obj [2]->r, obj [3]->r);
+
+    // Diffuse reflectance (one colour per register after the transpose).
+    v4f sat, val;
+    bumps (time, sat, val);
+    v4f vs = val * sat;
+    v4f d0 = channel (hue, red, vs, val);
+    v4f d1 = channel (hue, green, vs, val);
+    v4f d2 = channel (hue, blue, vs, val);
+    v4f d3 = a;
+    _MM_TRANSPOSE4_PS (d0, d1, d2, d3);
+
+    // Vertex coefficients.
+    v4f s, c;
+    sincos (step (time) * length, s, c);
+
+    GLuint snub [4];
+    const float * g0 [4];
+    for (unsigned k = 0; k != 4; ++ k) {
+      snub [k] = (GLuint) (obj [k]->starting_point == 7
+        || obj [k]->target.point == 7);
+      g0 [k] = abc [obj [k]->target.system] [obj [k]->starting_point];
+    }
+
+    char * block = buffer + n * stride;
+    unsigned left = count - n;
+    store <0> (block, d0, r, s, c, g0 [0], e [m [0]], snub [0]);
+    if (left > 1)
+      store <1> (block + stride, d1, r, s, c, g0 [1], e [m [1]], snub [1]);
+    if (left > 2)
+      store <2> (block + 2 * stride, d2, r, s, c, g0 [2], e [m [2]],
+        snub [2]);
+    if (left > 3)
+      store <3> (block + 3 * stride, d3, r, s, c, g0 [3], e [m [3]],
+        snub [3]);
+  }
+}
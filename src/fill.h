@@ -0,0 +1,48 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef fill_h
+#define fill_h
+
+// The per-object part of the uniform blocks: the diffuse colour d, the
+// vertex coefficients g and the snub flag s (see object_data_t).
+
+// Evaluating the bump, step, hsv_to_rgb and sincos functions for one object
+// at a time uses one or two lanes of each vector and spends most of its
+// time shuffling. Instead, fill_blocks takes four objects at a time (the
+// SSE width), gathering animation_time, hue, locus_length and r into one
+// register each, one object per lane, evaluates the functions lane by lane,
+// then transposes the colours and scatters the coefficients into the
+// blocks. The functions are the same, so the results agree to rounding
+// (bench/check.cpp compares them).
+
+// The blocks are written with ordinary stores, not non-temporal ones:
+// compute has just written the modelview matrices, which share cache lines
+// with d and g, and a non-temporal store to a cached line evicts it (with
+// whole-frame staging that made the stage two and a half times slower).
+
+#include "bump.h"
+#include "object.h"
+#include <cstddef>
+
+// Fill blocks 0, 1, ..., count - 1 of buffer (block k at buffer + k * stride)
+// for the objects objects [order [0]], ..., objects [order [count - 1]].
+void fill_blocks (char * buffer, std::size_t stride, const unsigned * order,
+  unsigned count, const object_t * objects, const float (* e) [4],
+  const float (* abc) [8] [4], const bumps_t & bumps, const step_t & step,
+  float alpha);
+
+#endif
@@ -0,0 +1,118 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "governor.h"
+#include "trace.h"
+#include "vector.h"
+
+namespace usr
+{
+  // Load (fraction of the frame budget) above which objects are shed, and
+  // below which they are restored.
+  const float governor_high = 0.90f;
+  const float governor_low = 0.60f;
+  // Shed objects to bring the load down to this level.
+  const float governor_aim = 0.75f;
+  // Restore at most this fraction more objects at a time.
+  const float governor_growth = 0.10f;
+  // Frames for which the load must stay beyond a mark before acting.
+  const unsigned governor_hold = 30;
+  // Frames to wait after a change (longer than a fade, 60 frames).
+  const unsigned governor_settle = 90;
+  // Weight of each frame in the moving average.
+  const float governor_smoothing = 1.0f / 16.0f;
+  // Fraction of the configured count below which the collision detection
+  // rate is reduced instead.
+  const float governor_floor = 0.25f;
+}
+
+void governor_t::reset (model_t & model, float budget_seconds)
+{
+  model.set_collision_interval (1);
+  budget = budget_seconds;
+  load = 0.0f;
+  decreases = 0;
+  increases = 0;
+  frame = 0;
+  rebase (model);
+}
+
+// Take the model's present count as the configured count.
+void governor_t::rebase (model_t & model)
+{
+  ceiling = model.active_count ();
+  count = ceiling;
+  over = 0;
+  under = 0;
+  wait = usr::governor_settle;
+  generation = model.settings_generation ();
+}
+
+const governor_decision_t * governor_t::update (model_t & model, float work,
+  float period)
+{
+  ++ frame;
+  // The count has been set anew (by a change of settings since the last
+  // frame); don't undo it.
+  if (model.settings_generation () != generation) rebase (model);
+  float sample = work / budget;
+  float late = period / budget;
+  if (late >= 1.5f && late > sample) sample = late;
+  load += usr::governor_smoothing * (sample - load);
+  TRACE_COUNTER ("governor load", load);
+
+  over = load > usr::governor_high ? over + 1 : 0;
+  under = load < usr::governor_low ? under + 1 : 0;
+  if (wait) {
+    -- wait;
+    return nullptr;
+  }
+
+  unsigned interval = model.get_collision_interval ();
+  if (interval < 1) interval = 1;
+  unsigned new_count = count, new_interval = interval;
+  if (over >= usr::governor_hold) {
+    // Shed load in proportion to the excess (a fraction between 5% and 50%).
+    float keep = usr::governor_aim / load;
+    keep = keep < 0.5f ? 0.5f : keep > 0.95f ? 0.95f : keep;
+    unsigned minimum = truncate (usr::governor_floor * ui2f (ceiling));
+    new_count = truncate (keep * ui2f (count));
+    if (new_count < minimum) {
+      new_count = count > minimum ? minimum : count;
+      if (new_count == count && allow_interval) new_interval = 2;
+    }
+    if (new_count < 1) new_count = 1;
+  }
+  else if (under >= usr::governor_hold) {
+    if (interval > 1) new_interval = 1;
+    else {
+      new_count = count + truncate (usr::governor_growth * ui2f (count)) + 1;
+      if (new_count > ceiling) new_count = ceiling;
+    }
+  }
+  if (new_count == count && new_interval == interval) return nullptr;
+
+  decision = { frame, load, count, new_count, interval, new_interval };
+  if (new_count < count || new_interval > interval) ++ decreases;
+  else ++ increases;
+  count = new_count;
+  model.fade_to_count (new_count);
+  model.set_collision_interval (new_interval);
+  TRACE_COUNTER ("governor count", new_count);
+  TRACE_COUNTER ("governor collision interval", new_interval);
+  over = 0;
+  under = 0;
+  wait = usr::governor_settle;
+  return & decision;
+}
@@ -0,0 +1,85 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef governor_h
+#define governor_h
+
+#define ENABLE_GOVERNOR
+
+#ifdef ENABLE_GOVERNOR
+#define GOVERNOR_ENABLED 1
+#else
+#define GOVERNOR_ENABLED 0
+#endif
+
+// Frame-time governor.
+
+// Each frame, update is given the time taken to compute and draw the frame
+// ("work") and the time since the previous frame ("period"), and compares
+// them with the frame budget (the display's refresh interval). The load is a
+// moving average of work / budget, or of period / budget for a frame that
+// missed its deadline by half an interval or more.
+
+// If the load stays above a high-water mark for a while, the governor fades
+// out some objects, in proportion to the excess; if it stays below a
+// low-water mark, it fades some back in, up to the configured count: the
+// count when the model was started, or after the count or radius setting
+// last changed (see model_t::settings_generation). Between the marks
+// nothing changes (hysteresis), and after each change the governor waits
+// for the fades to finish and the average to settle before acting again.
+// As a last resort, when the count has come down to a quarter of the
+// configured count, collisions are detected only every other frame (and
+// this is undone first when the load falls).
+
+// Every decision is returned to the caller, and recorded in the trace as
+// counters (see trace.h).
+
+#include "model.h"
+#include <cstdint>
+
+struct governor_decision_t
+{
+  std::uint64_t frame;
+  float load;
+  unsigned old_count, new_count;
+  unsigned old_interval, new_interval;
+};
+
+struct governor_t
+{
+  // Call after model_t::start, with the budget in seconds.
+  void reset (model_t & model, float budget);
+  // Returns the decision made this frame, if any.
+  const governor_decision_t * update (model_t & model, float work,
+    float period);
+
+  bool allow_interval;  // Allow reducing the collision detection rate.
+  float load;
+  unsigned decreases, increases;
+private:
+  float budget;
+  unsigned ceiling;     // The configured count.
+  unsigned count;       // The count the governor has asked for.
+  unsigned over, under; // Consecutive frames above or below the marks.
+  unsigned wait;        // Frames to wait before acting again.
+  unsigned generation;  // The model's settings generation.
+  std::uint64_t frame;
+  governor_decision_t decision;
+
+  void rebase (model_t & model);
+};
+
+#endif
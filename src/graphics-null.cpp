@@ -0,0 +1,106 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Null graphics backend, for running the model without a window or an OpenGL
+// context (see the host section of the Makefile). The uniform buffer is backed
+// by ordinary memory, so the per-object fill loop in model_t::draw still does
+// its work; nothing is uploaded and nothing is painted.
+
+#include "graphics.h"
+#include "memory.h"
+
+namespace
+{
+  // Typical values of GL_MAX_UNIFORM_BLOCK_SIZE and
+  // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+  const std::uint32_t null_max_block_size = 65536;
+  const std::intptr_t null_alignment = 256;
+
+  template <typename Dest, typename Source>
+  inline void align_up (Dest & y, Source x, std::intptr_t alignment)
+  {
+    y = (Dest) ((((std::intptr_t) (x)) + (alignment - 1)) & -alignment);
+  }
+}
+
+void clear ()
+{
+}
+
+unsigned make_vao (unsigned, const float (*) [4], const std::uint8_t (*) [6])
+{
+  return 0;
+}
+
+uniform_buffer_t::~uniform_buffer_t ()
+{
+  deallocate (m_memory);
+}
+
+bool uniform_buffer_t::initialize ()
+{
+  m_size = null_max_block_size;
+  m_alignment = null_alignment;
+  m_capacity = m_size;
+  m_memory = allocate (m_size + null_alignment);
+  if (! m_memory) return false;
+  align_up (m_begin, m_memory, null_alignment);
+  align_up (m_stride, sizeof (object_data_t), null_alignment);
+  m_id = 0;
+  return true;
+}
+
+bool uniform_buffer_t::reserve (std::size_t n)
+{
+  std::size_t per_buffer = count ();
+  std::size_t blocks = (n + per_buffer - 1) / per_buffer;
+  std::size_t size = (blocks ? blocks : 1) * m_size;
+  if (size <= m_capacity) return true;
+  void * memory = allocate (size + m_alignment);
+  if (! memory) return false;
+  deallocate (m_memory);
+  m_memory = memory;
+  m_capacity = size;
+  align_up (m_begin, m_memory, m_alignment);
+  return true;
+}
+
+void uniform_buffer_t::bind ()
+{
+}
+
+void uniform_buffer_t::update (std::size_t)
+{
+}
+
+bool initialize_graphics (program_t & program)
+{
+  return program.initialize ();
+}
+
+void program_t::set_view (const float (&) [4], int, int, float, float, float,
+                          float)
+{
+}
+
+bool program_t::initialize ()
+{
+  id = 0;
+  static_uniform_buffer_id = 0;
+  return uniform_buffer.initialize ();
+}
+
+void paint (unsigned, unsigned, GLuint, std::ptrdiff_t)
+{
+}
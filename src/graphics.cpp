@@ -21,6 +21,7 @@
 #include "memory.h"
 #include "print.h"
 #include "resources.h"
+#include "trace.h"
 #include <algorithm>
 
 // Uniform block binding indices and vertex attribute indices.
@@ -129,6 +130,7 @@ void APIENTRY debug_message_callback (GLenum source, GLenum type, GLuint id,
 
 GLuint make_shader (GLenum type, int resource_id)
 {
+  TRACE_SCOPE ("make_shader");
   const char * text;
   GLint size;
   get_resource_data (resource_id, text, size);
@@ -199,6 +201,8 @@ bool uniform_buffer_t::initialize ()
   // Align client buffer to at least 64 bytes to avoid straddling cache lines.
   align = std::max (align, 64);
   m_size = max_size;
+  m_alignment = align;
+  m_capacity = m_size;
   m_memory = allocate (m_size + align);
   if (! m_memory) return false;
   align_up (m_begin, m_memory, align);
@@ -207,18 +211,35 @@ bool uniform_buffer_t::initialize ()
   return true;
 }
 
+bool uniform_buffer_t::reserve (std::size_t n)
+{
+  // Whole uniform buffers' worth, so that update can always read m_size.
+  std::size_t per_buffer = count ();
+  std::size_t blocks = (n + per_buffer - 1) / per_buffer;
+  std::size_t size = (blocks ? blocks : 1) * m_size;
+  if (size <= m_capacity) return true;
+  void * memory = allocate (size + m_alignment);
+  if (! memory) return false;
+  deallocate (m_memory);
+  m_memory = memory;
+  m_capacity = size;
+  align_up (m_begin, m_memory, m_alignment);
+  return true;
+}
+
 void uniform_buffer_t::bind ()
 {
   glBindBuffer (GL_UNIFORM_BUFFER, m_id); GLCHECK;
 }
 
-void uniform_buffer_t::update ()
+void uniform_buffer_t::update (std::size_t first)
 {
   // The buffer id is already bound to the GL_UNIFORM_BUFFER target.
   // Create a buffer, orphaning any previous buffer.
   glBufferData (GL_UNIFORM_BUFFER, m_size, nullptr, GL_DYNAMIC_DRAW); GLCHECK;
   // Upload the buffer data.
-  glBufferSubData (GL_UNIFORM_BUFFER, 0, m_size, m_begin); GLCHECK;
+  glBufferSubData (GL_UNIFORM_BUFFER, 0, m_size, m_begin + first * m_stride);
+  GLCHECK;
 }
 
 bool initialize_graphics (program_t & program)
@@ -347,6 +368,7 @@ void program_t::set_view (const float (& view) [4],
 
 bool program_t::initialize ()
 {
+  TRACE_SCOPE ("program_t::initialize");
   if (! uniform_buffer.initialize ()) return false;
   glGenBuffers (1, & static_uniform_buffer_id); GLCHECK;
 
@@ -357,6 +379,7 @@ bool program_t::initialize ()
   if (vshader && gshader && fshader) {
     id = glCreateProgram (); GLCHECK;
     if (id) {
+      TRACE_SCOPE ("link_program");
       glAttachShader (id, vshader); GLCHECK;
       glAttachShader (id, gshader); GLCHECK;
       glAttachShader (id, fshader); GLCHECK;
@@ -34,6 +34,8 @@ struct object_data_t
   GLuint s;           // bool, snub?
 };
 
+// The staging memory holds the blocks of a whole frame (see reserve); the
+// uniform buffer holds "count" of them at a time.
 struct uniform_buffer_t
 {
   inline uniform_buffer_t () : m_memory (nullptr) { };
@@ -47,11 +49,16 @@ struct uniform_buffer_t
 
   ~uniform_buffer_t ();
   bool initialize ();
+  // Make room in the staging memory for the blocks of n objects.
+  bool reserve (std::size_t n);
   void bind ();
-  void update ();
+  // Upload the blocks first, first + 1, ..., first + count () - 1.
+  void update (std::size_t first);
 private:
   std::uint32_t m_size;
   std::uint32_t m_stride;
+  std::uint32_t m_alignment;
+  std::size_t m_capacity;  // Bytes of staging memory.
   void * m_memory;
   char * m_begin;
   GLuint m_id;
@@ -20,9 +20,11 @@
 #include "mswin.h"
 
 #include "bounce.h"
+#include "collision-stats.h"
 #include "compiler.h"
 #include "memory.h"
 #include "partition.h"
+#include "phase.h"
 #include "vector.h"
 #include <cstdint>
 #include <x86intrin.h>
@@ -133,16 +135,23 @@ inline unsigned required_depth (unsigned point_count)
 ALWAYS_INLINE
 inline void model_t::kdtree_search ()
 {
-  // Reallocate memory for the nodes.
+  // Scratch memory for the nodes, from the frame arena (see set_capacity).
   unsigned depth = required_depth (count);
   unsigned nonleaf_count = (1 << depth) - 1;
-  if (nonleaf_count > kdtree_capacity) {
-    deallocate (kdtree_split);
-    kdtree_capacity = nonleaf_count;
-    kdtree_split = (float *) allocate (kdtree_capacity * sizeof (float));
-  }
+  kdtree_split = frame_arena.allocate_array <float> (nonleaf_count);
+  // Out of memory: skip collision detection (for this frame).
+  if (! kdtree_split) return;
+
+  kdtree_build (depth);
+  kdtree_bounce_objects (depth);
+  kdtree_bounce_walls (depth);
+}
 
-  // Phase 1: build the tree.
+// Phase 1: build the tree.
+ALWAYS_INLINE
+inline void model_t::kdtree_build (unsigned depth)
+{
+  PHASE_SCOPE (phase_kdtree_build);
   unsigned node = 0;
   std::uint8_t dim = 0;
   for (unsigned level = 0; level != depth; ++ level) {
@@ -157,12 +166,16 @@ inline void model_t::kdtree_search ()
     }
     dim = inc_mod3 [dim];
   }
+}
 
+// Phase 2: for each object, detect collisions with other objects.
+ALWAYS_INLINE
+inline void model_t::kdtree_bounce_objects (unsigned depth)
+{
+  PHASE_SCOPE (phase_kdtree_objects);
+  unsigned nonleaf_count = (1 << depth) - 1;
   // Enough stack to traverse a tree with more than 2^32 nodes.
-  unsigned stack [32];                   // Node index.
-  ALIGNED16 float stack_corner [32] [4]; // Extra space for wall phase.
-
-  // Phase 2: for each object, detect collisions with other objects.
+  unsigned stack [32]; // Node index.
 
   // The later a collision is processed, the greater its tendency to
   // increase the separation of the two objects involved, because
@@ -214,6 +227,7 @@ inline void model_t::kdtree_search ()
     unsigned top = 0;
     // Push node 0 onto the stack.
     stack [top ++] = 0;
+    COLLISION_COUNT (collision_object_pushes);
     // Traverse the tree discarding nodes not intersecting the search cube.
     unsigned first_node_of_current_level = 0;
     std::uint8_t dim = 0;
@@ -221,6 +235,7 @@ inline void model_t::kdtree_search ()
       // Pop a node from the stack.
       // This node's box certainly intersects the search box.
       unsigned node = stack [-- top];
+      COLLISION_COUNT (collision_object_pops);
       if (node < nonleaf_count) {
         // Visit a nonleaf node.
         // Ascend to the level that contains node.
@@ -236,8 +251,14 @@ inline void model_t::kdtree_search ()
         if (position * count < n * level_node_count) {
           // Push one or both child nodes onto the stack.
           float s = kdtree_split [node];
-          if (x [n1] [dim] + 2 * radius >= s) stack [top ++] = 2 * node + 2;
-          if (x [n1] [dim] - 2 * radius <= s) stack [top ++] = 2 * node + 1;
+          if (x [n1] [dim] + 2 * radius >= s) {
+            stack [top ++] = 2 * node + 2;
+            COLLISION_COUNT (collision_object_pushes);
+          }
+          if (x [n1] [dim] - 2 * radius <= s) {
+            stack [top ++] = 2 * node + 1;
+            COLLISION_COUNT (collision_object_pushes);
+          }
           // Descend one level to our children's level.
           dim = inc_mod3 [dim];
           first_node_of_current_level = 2 * first_node_of_current_level + 1;
@@ -245,6 +266,7 @@ inline void model_t::kdtree_search ()
       }
       else {
         // Visit a leaf node.
+        COLLISION_COUNT (collision_object_leaves);
         std::uint64_t position = node - nonleaf_count;
         unsigned points_begin = position * count >> depth;
         unsigned points_end = (position + 1) * count >> depth;
@@ -254,8 +276,16 @@ inline void model_t::kdtree_search ()
       }
     }
   }
+}
 
-  // Phase 3: detect collisions with walls.
+// Phase 3: detect collisions with walls.
+ALWAYS_INLINE
+inline void model_t::kdtree_bounce_walls (unsigned depth)
+{
+  PHASE_SCOPE (phase_kdtree_walls);
+  unsigned nonleaf_count = (1 << depth) - 1;
+  unsigned stack [32];                   // Node index.
+  ALIGNED16 float stack_corner [32] [4]; // Critical corner.
   for (unsigned iw = 0; iw != 6; ++ iw) {
     // Visit every node whose wall-distance is less than max_radius.
     // The "wall-distance" of a point x is dot(x - anchor, normal).
@@ -274,6 +304,7 @@ inline void model_t::kdtree_search ()
     store4f (stack_corner [top], critical_corner);
     stack [top] = 0;
     ++ top;
+    COLLISION_COUNT (collision_wall_pushes);
     // Traverse the tree.
     unsigned normal_sign_mask = _mm_movemask_ps (normal);
     unsigned first_node_of_current_level = 0;
@@ -281,6 +312,7 @@ inline void model_t::kdtree_search ()
     while (top) {
       // Pop a node from the stack.
       -- top;
+      COLLISION_COUNT (collision_wall_pops);
       v4f critical_corner = load4f (stack_corner [top]);
       unsigned node = stack [top];
       // Ascend to the level that contains node.
@@ -304,6 +336,7 @@ inline void model_t::kdtree_search ()
           // ...  push its node index (its critical corner is already in place).
           stack [top] = 2 * node + 1 + other;
           ++ top;
+          COLLISION_COUNT (collision_wall_pushes);
         }
         // Visit the favourite child now.
         node = 2 * node + 1 + favourite;
@@ -311,6 +344,7 @@ inline void model_t::kdtree_search ()
         dim = inc_mod3 [dim];
       }
       // Visit a leaf node.
+      COLLISION_COUNT (collision_wall_leaves);
       std::uint64_t position = node - nonleaf_count;
       unsigned points_begin = position * count >> depth;
       unsigned points_end = (position + 1) * count >> depth;
@@ -0,0 +1,167 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libpolymorph.h"
+#include "model.h"
+#include <cstddef>
+#include <new>
+
+#if defined (__GNUC__)
+#define EXPORT __attribute__ ((visibility ("default")))
+#else
+#define EXPORT
+#endif
+
+// The public object layout is object_t's, so the objects can be read in
+// place.
+static_assert (sizeof (polymorph_object_t) == sizeof (object_t),
+  "polymorph_object_t must match object_t");
+#define SAME_OFFSET(public_field, field) \
+  static_assert (offsetof (polymorph_object_t, public_field) \
+    == offsetof (object_t, field), "polymorph_object_t must match object_t")
+SAME_OFFSET (m, m);
+SAME_OFFSET (l, l);
+SAME_OFFSET (r, r);
+SAME_OFFSET (hue, hue);
+SAME_OFFSET (animation_time, animation_time);
+SAME_OFFSET (locus_length, locus_length);
+SAME_OFFSET (fade, fade);
+SAME_OFFSET (starting_point, starting_point);
+SAME_OFFSET (system, target.system);
+SAME_OFFSET (target_point, target.point);
+#undef SAME_OFFSET
+static_assert (sizeof (system_select_t) == sizeof (std::uint32_t),
+  "polymorph_object_t must match object_t");
+
+// Access to the model's arrays.
+struct model_access_t
+{
+  static const float * x (const model_t & m) { return & m.x [0] [0]; }
+  static const float * u (const model_t & m) { return & m.u [0] [0]; }
+  static const float * v (const model_t & m) { return & m.v [0] [0]; }
+  static const float * w (const model_t & m) { return & m.w [0] [0]; }
+  static const polymorph_object_t * objects (const model_t & m)
+  {
+    return reinterpret_cast <const polymorph_object_t *> (m.objects);
+  }
+};
+
+struct polymorph_t
+{
+  model_t model;
+};
+
+extern "C" {
+
+EXPORT unsigned polymorph_api_version (void)
+{
+  return POLYMORPH_API_VERSION;
+}
+
+EXPORT polymorph_t * polymorph_create (std::uint64_t seed, int width,
+  int height, const polymorph_settings_t * settings)
+{
+  settings_t s { { 50, 50, 50, 50 } };
+  if (settings) {
+    s.trackbar_pos [0] = settings->count;
+    s.trackbar_pos [1] = settings->heat;
+    s.trackbar_pos [2] = settings->speed;
+    s.trackbar_pos [3] = settings->radius;
+  }
+  for (DWORD & pos : s.trackbar_pos) {
+    if (pos > 100) pos = 100;
+  }
+  if (width <= 0 || height <= 0) return nullptr;
+  polymorph_t * simulation = new (std::nothrow) polymorph_t {};
+  if (! simulation) return nullptr;
+  simulation->model.initialize (seed);
+  if (! simulation->model.start (width, height, s)) {
+    delete simulation;
+    return nullptr;
+  }
+  return simulation;
+}
+
+EXPORT void polymorph_destroy (polymorph_t * simulation)
+{
+  delete simulation;
+}
+
+EXPORT void polymorph_step (polymorph_t * simulation, unsigned frames)
+{
+  if (frames) simulation->model.draw_next (frames);
+}
+
+EXPORT int polymorph_add_objects (polymorph_t * simulation, unsigned n)
+{
+  return simulation->model.add_objects (n);
+}
+
+EXPORT void polymorph_remove_object (polymorph_t * simulation,
+  unsigned index)
+{
+  simulation->model.remove_object (index);
+}
+
+EXPORT int polymorph_set_count (polymorph_t * simulation, unsigned count)
+{
+  return simulation->model.set_count (count);
+}
+
+EXPORT int polymorph_resize (polymorph_t * simulation, int width,
+  int height)
+{
+  if (width <= 0 || height <= 0) return 0;
+  return simulation->model.resize (width, height);
+}
+
+EXPORT int polymorph_set_setting (polymorph_t * simulation, unsigned index,
+  unsigned pos)
+{
+  return simulation->model.post_setting (index, pos);
+}
+
+EXPORT unsigned polymorph_count (const polymorph_t * simulation)
+{
+  return simulation->model.object_count ();
+}
+
+EXPORT const float * polymorph_positions (const polymorph_t * simulation)
+{
+  return model_access_t::x (simulation->model);
+}
+
+EXPORT const float * polymorph_orientations (const polymorph_t * simulation)
+{
+  return model_access_t::u (simulation->model);
+}
+
+EXPORT const float * polymorph_velocities (const polymorph_t * simulation)
+{
+  return model_access_t::v (simulation->model);
+}
+
+EXPORT const float * polymorph_angular_velocities (
+  const polymorph_t * simulation)
+{
+  return model_access_t::w (simulation->model);
+}
+
+EXPORT const polymorph_object_t * polymorph_objects (
+  const polymorph_t * simulation)
+{
+  return model_access_t::objects (simulation->model);
+}
+
+}
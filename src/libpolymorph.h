@@ -0,0 +1,115 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef libpolymorph_h
+#define libpolymorph_h
+
+// The simulation as a library, with a C interface, for embedding in other
+// programs. The host build makes .obj/host/libpolymorph.a and
+// .obj/host/libpolymorph.so (which exports only these functions); see
+// bench/embed.c for an example.
+
+// A simulation is a headless model (model.h): the same physics and
+// animation as the screensaver, without graphics. Each is independent, so
+// several can run at once, on different threads; calls for one simulation
+// must not overlap, except for polymorph_set_setting.
+
+// The state is read in place: the accessors return pointers to the
+// model's own arrays, with no copying. They stay valid, with the returned
+// count, until the next call for the same simulation other than an
+// accessor (stepping can remove objects that have faded out, and adding
+// objects can move the arrays).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POLYMORPH_API_VERSION 1
+
+// The library's POLYMORPH_API_VERSION, for comparison with the header's
+// when the library is loaded at run time.
+unsigned polymorph_api_version (void);
+
+typedef struct polymorph_t polymorph_t;
+
+// The configure dialog's settings, each from 0 to 100.
+typedef struct polymorph_settings_t
+{
+  uint32_t count;   // Fraction of the maximum count.
+  uint32_t heat;    // Speed of the objects.
+  uint32_t speed;   // Speed of the morph animation.
+  uint32_t radius;  // Object size.
+} polymorph_settings_t;
+
+// An object's scalar state (the same layout as object_t in object.h).
+typedef struct polymorph_object_t
+{
+  float m, l, r;            // Mass, moment of inertia, radius.
+  float hue;                // In [0, 6) (see hsv-to-rgb.h).
+  float animation_time;     // Time into the current morph cycle.
+  float locus_length;
+  float fade;               // Size in [0, 1], negative when fading out.
+  uint32_t starting_point;  // The polyhedron morphing from ...
+  uint32_t system;          // ... and to: the symmetry system (0 to 5,
+  uint32_t target_point;    // see systems.h) and point (0 to 7).
+} polymorph_object_t;
+
+// Create a simulation, with the random seed, the tank for a view of width
+// by height pixels (the front of the tank is a hundredth of that in
+// simulation units, see model_t::set_tank), and the settings (or null for
+// the defaults, 50 each). Returns null on failure.
+polymorph_t * polymorph_create (uint64_t seed, int width, int height,
+  const polymorph_settings_t * settings);
+void polymorph_destroy (polymorph_t * simulation);
+
+// Advance by "frames" frames.
+void polymorph_step (polymorph_t * simulation, unsigned frames);
+
+// Change the population (new objects grow from nothing over the next
+// frames). The functions returning int return 0 if memory is short.
+int polymorph_add_objects (polymorph_t * simulation, unsigned n);
+void polymorph_remove_object (polymorph_t * simulation, unsigned index);
+int polymorph_set_count (polymorph_t * simulation, unsigned count);
+
+// Change the tank without restarting (see model_t::resize).
+int polymorph_resize (polymorph_t * simulation, int width, int height);
+
+// Change setting "index" (0 count, 1 heat, 2 speed, 3 radius) to "pos",
+// from the next step. May be called from other threads while the
+// simulation steps; the latest position set before a step is the one it
+// takes (see commands.h). Returns 0 if the index is out of range.
+int polymorph_set_setting (polymorph_t * simulation, unsigned index,
+  unsigned pos);
+
+// Accessors. The vector arrays have four floats per object, the last
+// unused: x the position, u the orientation (a rotation vector, axis times
+// angle, see rodrigues.h), v the velocity and w the angular velocity.
+unsigned polymorph_count (const polymorph_t * simulation);
+const float * polymorph_positions (const polymorph_t * simulation);
+const float * polymorph_orientations (const polymorph_t * simulation);
+const float * polymorph_velocities (const polymorph_t * simulation);
+const float * polymorph_angular_velocities (const polymorph_t * simulation);
+const polymorph_object_t * polymorph_objects (
+  const polymorph_t * simulation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
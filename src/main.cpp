@@ -20,6 +20,7 @@
 #include "polymorph.h"
 #include "resources.h"
 #include "settings.h"
+#include "trace.h"
 #include <cstdint>
 #include <cstring>
 
@@ -58,6 +59,7 @@ int WINAPI _tWinMain (HINSTANCE hInstance, HINSTANCE, LPTSTR, int)
       ::DispatchMessage (& msg);
     }
   }
+  TRACE_WRITE ("polymorph-trace.json");
   return (int) msg.wParam;
 }
 
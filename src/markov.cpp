@@ -16,8 +16,10 @@
 
 #include "markov.h"
 #include "compiler.h"
+#include "object.h"
 #include "random.h"
 #include "rodrigues.h"
+#include "vector.h"
 
 // The procedure below gives rise to roughly the following relative polyhedron
 // abundancies.
@@ -80,72 +82,173 @@ ALIGNED16 const float rotations [3] [4] = {
   { +0x1.caf0fcP-002f, +0x1.448542P-001f, 0.0f, 0.0f }, // T7 -> T7*
 };
 
-inline bool bernoulli_trial (rng_t & rng, unsigned probability)
+namespace
 {
-  return (rng.get () & probability_mask) < probability;
-}
+  const unsigned coin_bits = 30;
+  const unsigned coin_one = 1u << coin_bits;
 
-inline void maybe_perform_replacement (rng_t & rng, float (& u) [4],
-  polyhedron_select_t & current, unsigned & starting_point)
-{
-  // Replacements are in terms of the primary representation so mask out the
-  // dual bit for now.
-  unsigned duality = current.system & 1;
-  current.system = system_select_t (current.system & ~1);
-  // If non-snub, maybe switch between dual representations, to permit either
-  // variety of any snub or desnub operation that follows. Not doing it now,
-  // before the replacements, makes some double-desnub combos impossible.
-  unsigned entropy = (unsigned) rng.get (); // Seems a shame to waste it.
-  duality ^= entropy & (current.point != 7);
-
-  unsigned m = 0;
-  for (const auto & r: replacements) {
-    if (r.before == current && bernoulli_trial (rng, r.probability)) {
-      break;
+  // Build an alias table for outcomes [0, n) with probabilities p [0, n)
+  // (Vose's method).
+  void build_alias_table (alias_table_t & table, const unsigned * outcomes,
+    const float * p, unsigned n)
+  {
+    float q [3];
+    unsigned small [3], large [3], small_count = 0, large_count = 0;
+    for (unsigned k = 0; k != n; ++ k) {
+      q [k] = p [k] * ui2f (n);
+      if (q [k] < 1.0f) small [small_count ++] = k;
+      else large [large_count ++] = k;
     }
-    ++ m;
-  }
-  if (m != replacement_count) {
-    current = replacements [m].after;
-    // Fixups after the replacement: avoid backtracking transitions
-    // by updating starting_point, and maybe appply a rotation.
-    if (m < 6) {
-      // Replacements 0 - 5 (tetrahedral <-> octahedral): do replacement
-      // on the starting point as well. For example, this prohibits
-      // T0 (octahedron) -> T6 = O5 (truncated octahedron) -> O1(octahedron).
-      // No rotation is needed for these replacements.
-      unsigned base = m - m % 3;
-      unsigned j = 0;
-      while (j != 3 && starting_point != replacements [base + j].before.point) {
-        ++ j;
+    table.count = n;
+    while (small_count && large_count) {
+      unsigned l = small [-- small_count];
+      unsigned g = large [large_count - 1];
+      table.threshold [l] = truncate (q [l] * ui2f (coin_one));
+      table.outcome [l] = (unsigned char) outcomes [l];
+      table.alias [l] = (unsigned char) outcomes [g];
+      q [g] -= 1.0f - q [l];
+      if (q [g] < 1.0f) {
+        -- large_count;
+        small [small_count ++] = g;
       }
-      starting_point = j == 3
-        ? current.point
-        : replacements [base + j].after.point;
     }
-    else {
-      // Replacements 6 - 8: apply a rotation (adjust the object's orientation).
-      v4f rotation = load4f (rotations [m - 6]);
-      if (duality) rotation = - rotation;
-      store4f (u, rotate (load4f (u), rotation));
-      // 6, 7 (tetrahedral <-> icosahedral): no transition forbidden.
-      // 8 (tetrahedral -> dual tetrahedral (both snub)): keep starting_point.
-      if (m != 8) starting_point = current.point;
+    // What is left has probability one, up to rounding.
+    while (large_count) {
+      unsigned g = large [-- large_count];
+      table.threshold [g] = coin_one;
+      table.outcome [g] = table.alias [g] = (unsigned char) outcomes [g];
+    }
+    while (small_count) {
+      unsigned l = small [-- small_count];
+      table.threshold [l] = coin_one;
+      table.outcome [l] = table.alias [l] = (unsigned char) outcomes [l];
     }
   }
 
-  // If non-snub, maybe switch between dual representations (again).
-  // Not doing this after the replacement rules out some double-snub combos.
-  duality ^= (entropy >> 1) & (current.point != 7);
-  // Restore the dual bit.
-  current.system = system_select_t (current.system ^ duality);
+  // Perform replacement m (or none, if m is replacement_count), and maybe
+  // switch between dual representations, according to the two low bits of
+  // entropy.
+  inline void perform_replacement (unsigned m, unsigned entropy,
+    float (& u) [4], polyhedron_select_t & current, unsigned & starting_point)
+  {
+    // Replacements are in terms of the primary representation so mask out
+    // the dual bit for now.
+    unsigned duality = current.system & 1;
+    current.system = system_select_t (current.system & ~1);
+    // If non-snub, maybe switch between dual representations, to permit
+    // either variety of any snub or desnub operation that follows. Not doing
+    // it now, before the replacements, makes some double-desnub combos
+    // impossible.
+    duality ^= entropy & (current.point != 7);
+
+    if (m != replacement_count) {
+      current = replacements [m].after;
+      // Fixups after the replacement: avoid backtracking transitions
+      // by updating starting_point, and maybe appply a rotation.
+      if (m < 6) {
+        // Replacements 0 - 5 (tetrahedral <-> octahedral): do replacement
+        // on the starting point as well. For example, this prohibits
+        // T0 (octahedron) -> T6 = O5 (truncated octahedron) -> O1
+        // (octahedron). No rotation is needed for these replacements.
+        unsigned base = m - m % 3;
+        unsigned j = 0;
+        while (j != 3
+          && starting_point != replacements [base + j].before.point) {
+          ++ j;
+        }
+        starting_point = j == 3
+          ? current.point
+          : replacements [base + j].after.point;
+      }
+      else {
+        // Replacements 6 - 8: apply a rotation (adjust the object's
+        // orientation).
+        v4f rotation = load4f (rotations [m - 6]);
+        if (duality) rotation = - rotation;
+        store4f (u, rotate (load4f (u), rotation));
+        // 6, 7 (tetrahedral <-> icosahedral): no transition forbidden.
+        // 8 (tetrahedral -> dual tetrahedral (both snub)): keep
+        // starting_point.
+        if (m != 8) starting_point = current.point;
+      }
+    }
+
+    // If non-snub, maybe switch between dual representations (again).
+    // Not doing this after the replacement rules out some double-snub combos.
+    duality ^= (entropy >> 1) & (current.point != 7);
+    // Restore the dual bit.
+    current.system = system_select_t (current.system ^ duality);
+  }
 }
 
-void transition (rng_t & rng, float (& u) [4], polyhedron_select_t & current,
-  unsigned & starting_point)
+void markov_t::initialize (const float (& abc) [system_count] [8] [4],
+  const float (& xyz) [system_count] [3] [4],
+  const float (& xyzinv) [system_count] [3] [4])
 {
-  maybe_perform_replacement (rng, u, current, starting_point);
+  // Loci. The arc from a point to itself is never used (and has no
+  // direction).
+  for (unsigned system = 0; system != system_count; ++ system) {
+    for (unsigned i = 0; i != 8; ++ i) {
+      for (unsigned j = 0; j != 8; ++ j) {
+        // g0: Coefficients for T0 in terms of xyz.
+        // g1: Coefficients for T1 in terms of xyz.
+        // T0: Beginning of locus (unit vector).
+        // T1: End of locus (also a unit vector).
+        // d:  Dot product of T0 and T1, i.e., cos s where s is the arc
+        //     length T0-T1.
+        // T2: Component of T1 perpendicular to T0, normalized to a unit
+        //     vector.
+        // g2: Coefficents for T2 in terms of xyz.
+        if (i == j) {
+          store4f (g2 [system] [i] [j], _mm_setzero_ps ());
+          length [system] [i] [j] = 0.0f;
+          cosine [system] [i] [j] = 1.0f;
+          continue;
+        }
+        v4f g0 = load4f (abc [system] [i]);
+        v4f g1 = load4f (abc [system] [j]);
+        v4f T0 = mapply (xyz [system], g0);
+        v4f T1 = mapply (xyz [system], g1);
+        // Find a unit vector T2 perpendicular to T0 and and an angle s such
+        // that T1 = (cos s) T0 + (sin s) T2.
+        v4f d = dot (T0, T1);
+        v4f T2 = normalize (T1 - d * T0);
+        // Any point T = (cos t) T0 + (sin t) T2 (where 0 <= t <= s) on the
+        // hemisemicircular arc T0-T1 has coefficients (cos t) g0 + (sin t)
+        // g2.
+        store4f (g2 [system] [i] [j], mapply (xyzinv [system], T2));
+        // Calculate the arc-length s = arccos(d) of the great circular arc
+        // T0-T1. Note: for allowed transitions we have d in [0.774596691,
+        // 0.990879238].
+        length [system] [i] [j] = _mm_cvtss_f32 (arccos (d));
+        cosine [system] [i] [j] = _mm_cvtss_f32 (d);
+      }
+    }
+  }
 
+  // Replacement outcomes: the replacements for each polyhedron, tried in
+  // order, and none.
+  for (unsigned primary = 0; primary != system_count / 2; ++ primary) {
+    for (unsigned point = 0; point != 8; ++ point) {
+      polyhedron_select_t current = { system_select_t (2 * primary), point };
+      unsigned outcomes [3], n = 0;
+      float p [3], remaining = 1.0f;
+      for (unsigned m = 0; m != replacement_count; ++ m) {
+        if (replacements [m].before == current) {
+          float q = ui2f (replacements [m].probability) * (1.0f / pmax);
+          outcomes [n] = m;
+          p [n ++] = remaining * q;
+          remaining -= remaining * q;
+        }
+      }
+      outcomes [n] = replacement_count;
+      p [n ++] = remaining;
+      build_alias_table (replacement [primary] [point], outcomes, p, n);
+    }
+  }
+
+  // Certain transitions are not allowed, and the next point must differ from
+  // the starting point.
   union
   {
     std::uint64_t data;
@@ -154,13 +257,53 @@ void transition (rng_t & rng, float (& u) [4], polyhedron_select_t & current,
 
   data = 0xf8c0bcbab927170f;
 
-  // Perform a Markov transition.
-  unsigned next;
-  do next = rng.get () & 7; /* PLEASE */
+  for (unsigned point = 0; point != 8; ++ point) {
+    for (unsigned start = 0; start != 8; ++ start) {
+      unsigned n = 0;
+      for (unsigned k = 0; k != 8; ++ k) {
+        if (k != start && ! (1 & disallowed [point] >> k)) {
+          next [point] [start] [n ++] = (unsigned char) k;
+        }
+      }
+      next_count [point] [start] = (unsigned char) n;
+    }
+  }
+}
+
+void markov_t::transition (rng_t & rng, const unsigned * indices,
+  unsigned n, object_t * objects, float (* u) [4], float (* e) [4]) const
+{
+  for (unsigned i = 0; i != n; ++ i) {
+    unsigned index = indices [i];
+    object_t & A = objects [index];
+    polyhedron_select_t & current = A.target;
 
-  // Certain transitions are not allowed:
-  while (next == starting_point || 1 & disallowed [current.point] >> next);
+    // Bits 0 and 1: duality; bits 2 to 31: the coin; bits 32 to 63: the
+    // column.
+    std::uint64_t r = rng.get ();
+    const alias_table_t & table = replacement [current.system >> 1]
+      [current.point];
+    unsigned k = (unsigned) (((r >> 32) * table.count) >> 32);
+    unsigned coin = ((unsigned) r >> 2) & (coin_one - 1);
+    unsigned m = coin < table.threshold [k] ? table.outcome [k]
+      : table.alias [k];
+    perform_replacement (m, (unsigned) r, u [index], current,
+      A.starting_point);
 
-  starting_point = current.point;
-  current.point = next;
+    // Perform a Markov transition.
+    unsigned point = current.point, start = A.starting_point;
+    unsigned count = next_count [point] [start];
+    unsigned j = (unsigned) (((rng.get () >> 32) * count) >> 32);
+    A.starting_point = point;
+    current.point = next [point] [start] [j];
+    locus (A, e [index]);
+  }
+}
+
+void markov_t::locus (object_t & object, float (& locus_end) [4]) const
+{
+  unsigned system = object.target.system;
+  unsigned i = object.starting_point, j = object.target.point;
+  store4f (locus_end, load4f (g2 [system] [i] [j]));
+  object.locus_length = length [system] [i] [j];
 }
@@ -17,9 +17,11 @@
 #ifndef markov_h
 #define markov_h
 
+#include "compiler.h"
 #include "systems.h"
 
 struct rng_t;
+struct object_t;
 
 struct polyhedron_select_t
 {
@@ -27,7 +29,51 @@ struct polyhedron_select_t
   unsigned point;
 };
 
-void transition (rng_t & rng, float (& u) [4], polyhedron_select_t & current,
-  unsigned & starting_point);
+// Markov transitions, in batches.
+
+// An object's locus (the arc its generator point follows during the morph)
+// depends only on the system, the starting point and the target point, so
+// markov_t::initialize tabulates g2 (the coefficients of the unit vector
+// perpendicular to the start, towards the end) and the arc length for all
+// 6 x 8 x 8 combinations, and a transition looks them up.
+
+// A transition first maybe replaces the current polyhedron by the same one
+// in another system (see markov.cpp). The outcome of the chain of Bernoulli
+// trials depends only on the current polyhedron, so it is drawn from an
+// alias table (Vose's method) for that polyhedron, in constant time. The
+// next point is then drawn uniformly from the precomputed list of points
+// allowed after the current and starting points, without rejection.
+
+// Each transition takes two random numbers.
+
+struct alias_table_t
+{
+  unsigned count;             // Number of outcomes (at most 3).
+  unsigned threshold [3];     // Column k gives outcome [k] if the 30-bit
+  unsigned char outcome [3];  // coin is below threshold [k], else
+  unsigned char alias [3];    // alias [k].
+};
+
+struct markov_t
+{
+  void initialize (const float (& abc) [system_count] [8] [4],
+    const float (& xyz) [system_count] [3] [4],
+    const float (& xyzinv) [system_count] [3] [4]);
+
+  // Perform a transition for each of the objects indices [0, n), with
+  // angular positions u, updating their loci e and locus lengths.
+  void transition (rng_t & rng, const unsigned * indices, unsigned n,
+    object_t * objects, float (* u) [4], float (* e) [4]) const;
+
+  // Set the locus end and locus length of an object from its Markov state.
+  void locus (object_t & object, float (& locus_end) [4]) const;
+
+  ALIGNED16 float g2 [system_count] [8] [8] [4];
+  float length [system_count] [8] [8];
+  float cosine [system_count] [8] [8];  // Of the length.
+  alias_table_t replacement [system_count / 2] [8];
+  unsigned char next [8] [8] [8];       // [point] [starting_point] [k]
+  unsigned char next_count [8] [8];
+};
 
 #endif
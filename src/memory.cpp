@@ -16,9 +16,100 @@
 
 #include "memory.h"
 
+#if MEMORY_STATS_ENABLED
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#endif
+
+namespace
+{
+  inline std::size_t round_up (std::size_t n, std::size_t m)
+  {
+    return (n + m - 1) & - m;
+  }
+
+  // Every pool block begins with a header (padded to pool_alignment) that
+  // describes the mapping.
+  struct pool_header_t
+  {
+    std::size_t size;
+    bool huge;
+  };
+
+#if MEMORY_STATS_ENABLED
+  struct memory_stats_t
+  {
+    std::atomic <bool> forbidden;
+    std::atomic <std::uint64_t> allocations;
+    std::atomic <std::uint64_t> bytes_requested;
+    std::atomic <std::uint64_t> pool_bytes;
+    std::atomic <std::uint64_t> pool_peak;
+    std::atomic <std::uint64_t> huge_bytes;
+    std::atomic <std::uint64_t> arena_peak;
+    std::atomic <std::uint64_t> frame_allocations;
+    std::uint64_t frames;
+    std::uint64_t frame_total;
+    std::uint64_t frame_max;
+    std::uint64_t frame_last;
+  };
+
+  memory_stats_t memory_stats;
+
+  void update_maximum (std::atomic <std::uint64_t> & maximum,
+    std::uint64_t value)
+  {
+    std::uint64_t old = maximum.load (std::memory_order_relaxed);
+    while (old < value && ! maximum.compare_exchange_weak (old, value,
+        std::memory_order_relaxed)) {
+    }
+  }
+
+  void count_allocation (const char * kind, std::size_t n)
+  {
+    memory_stats_t & stats = memory_stats;
+    if (stats.forbidden.load (std::memory_order_relaxed)) {
+      std::fprintf (stderr, "memory: %s allocation of %zu bytes during a "
+        "frame\n", kind, n);
+      std::abort ();
+    }
+    stats.allocations.fetch_add (1, std::memory_order_relaxed);
+    stats.frame_allocations.fetch_add (1, std::memory_order_relaxed);
+    stats.bytes_requested.fetch_add (n, std::memory_order_relaxed);
+  }
+
+  void count_pool (const pool_header_t & header, bool release)
+  {
+    memory_stats_t & stats = memory_stats;
+    if (release) {
+      stats.pool_bytes.fetch_sub (header.size, std::memory_order_relaxed);
+      if (header.huge) {
+        stats.huge_bytes.fetch_sub (header.size, std::memory_order_relaxed);
+      }
+      return;
+    }
+    std::uint64_t bytes = header.size + stats.pool_bytes.fetch_add (
+      header.size, std::memory_order_relaxed);
+    update_maximum (stats.pool_peak, bytes);
+    if (header.huge) {
+      stats.huge_bytes.fetch_add (header.size, std::memory_order_relaxed);
+    }
+  }
+
+#define COUNT_ALLOCATION(kind, n) count_allocation (kind, n)
+#define COUNT_POOL(header, release) count_pool (header, release)
+#else
+#define COUNT_ALLOCATION(kind, n)
+#define COUNT_POOL(header, release)
+#endif
+}
+
+#ifdef _WIN32
+
 void * allocate (std::size_t n)
 {
   if (! n) return nullptr;
+  COUNT_ALLOCATION ("heap", n);
   return ::HeapAlloc (::GetProcessHeap (), 0, n);
 }
 
@@ -26,3 +117,180 @@ void deallocate (void * p)
 {
   if (p) ::HeapFree (::GetProcessHeap (), 0, p);
 }
+
+namespace
+{
+  // Large pages need the "lock pages in memory" privilege, which we cannot
+  // expect to have, so use ordinary pages. The allocation granularity (64
+  // KiB) is more than enough alignment.
+  void * map (pool_header_t & header)
+  {
+    header.huge = false;
+    return ::VirtualAlloc (nullptr, header.size, MEM_RESERVE | MEM_COMMIT,
+      PAGE_READWRITE);
+  }
+
+  void unmap (void * p, std::size_t)
+  {
+    ::VirtualFree (p, 0, MEM_RELEASE);
+  }
+}
+
+#else
+
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void * allocate (std::size_t n)
+{
+  if (! n) return nullptr;
+  COUNT_ALLOCATION ("heap", n);
+  return std::malloc (n);
+}
+
+void deallocate (void * p)
+{
+  std::free (p);
+}
+
+namespace
+{
+  const std::size_t huge_page_size = std::size_t (2) << 20;
+
+  void * map (pool_header_t & header)
+  {
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    std::size_t & size = header.size;
+    header.huge = size >= huge_page_size;
+    if (! header.huge) {
+      size = round_up (size, (std::size_t) ::sysconf (_SC_PAGESIZE));
+      void * p = ::mmap (nullptr, size, prot, flags, -1, 0);
+      return p == MAP_FAILED ? nullptr : p;
+    }
+
+    // Explicit huge pages, if the administrator has reserved some.
+    size = round_up (size, huge_page_size);
+    void * p = ::mmap (nullptr, size, prot, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+
+    // Otherwise, ask for transparent huge pages. They are only used for
+    // aligned 2 MiB regions, so over-map and trim to a 2 MiB boundary.
+    p = ::mmap (nullptr, size + huge_page_size, prot, flags, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    char * begin = (char *) p;
+    char * aligned = (char *) round_up ((std::size_t) begin, huge_page_size);
+    char * end = begin + size + huge_page_size;
+    if (aligned != begin) ::munmap (begin, aligned - begin);
+    if (aligned + size != end) ::munmap (aligned + size, end - aligned - size);
+    ::madvise (aligned, size, MADV_HUGEPAGE);
+    return aligned;
+  }
+
+  void unmap (void * p, std::size_t size)
+  {
+    ::munmap (p, size);
+  }
+}
+
+#endif
+
+void * pool_allocate (std::size_t n)
+{
+  if (! n) return nullptr;
+  COUNT_ALLOCATION ("pool", n);
+  pool_header_t header = { n + pool_alignment, false };
+  char * base = (char *) map (header);
+  if (! base) return nullptr;
+  COUNT_POOL (header, false);
+  * (pool_header_t *) base = header;
+  return base + pool_alignment;
+}
+
+void pool_deallocate (void * p)
+{
+  if (! p) return;
+  char * base = (char *) p - pool_alignment;
+  pool_header_t header = * (pool_header_t *) base;
+  COUNT_POOL (header, true);
+  unmap (base, header.size);
+}
+
+bool arena_t::reserve (std::size_t n)
+{
+  n = round_up (n, pool_alignment);
+  used = 0;
+  if (n > capacity) {
+    char * p = (char *) pool_allocate (n);
+    if (! p) return false;
+    pool_deallocate (base);
+    base = p;
+    capacity = n;
+  }
+  return true;
+}
+
+void * arena_t::allocate (std::size_t n)
+{
+  n = round_up (n, pool_alignment);
+  if (n > capacity - used) {
+    COUNT_ALLOCATION ("arena", n);
+    return nullptr;
+  }
+  void * p = base + used;
+  used += n;
+#if MEMORY_STATS_ENABLED
+  update_maximum (memory_stats.arena_peak, used);
+#endif
+  return p;
+}
+
+#if MEMORY_STATS_ENABLED
+
+void memory_stats_end_frame ()
+{
+  memory_stats_t & stats = memory_stats;
+  std::uint64_t n = stats.frame_allocations.exchange (0,
+    std::memory_order_relaxed);
+  ++ stats.frames;
+  stats.frame_total += n;
+  if (n > stats.frame_max) stats.frame_max = n;
+  stats.frame_last = n;
+}
+
+void memory_stats_discard_frame ()
+{
+  memory_stats.frame_allocations.store (0, std::memory_order_relaxed);
+}
+
+std::uint64_t memory_stats_last_frame ()
+{
+  return memory_stats.frame_last;
+}
+
+void memory_stats_report (std::FILE * file)
+{
+  const memory_stats_t & stats = memory_stats;
+  const double MiB = 1.0 / (1 << 20);
+  std::fprintf (file, "Memory: %llu allocations, %.2f MiB requested; "
+    "pool %.2f MiB in use (%.2f MiB huge pages), peak %.2f MiB; "
+    "arena peak %.2f KiB.\n",
+    (unsigned long long) stats.allocations.load (),
+    stats.bytes_requested.load () * MiB, stats.pool_bytes.load () * MiB,
+    stats.huge_bytes.load () * MiB, stats.pool_peak.load () * MiB,
+    stats.arena_peak.load () / 1024.0);
+  if (stats.frames) {
+    std::fprintf (file, "Allocations per frame: mean %.3f, max %llu "
+      "(%llu frames).\n", double (stats.frame_total) / stats.frames,
+      (unsigned long long) stats.frame_max,
+      (unsigned long long) stats.frames);
+  }
+}
+
+void memory_forbid_allocations (bool forbid)
+{
+  memory_stats.forbidden.store (forbid, std::memory_order_relaxed);
+}
+
+#endif
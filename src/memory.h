@@ -17,9 +17,89 @@
 #ifndef memory_h
 #define memory_h
 
+//#define ENABLE_MEMORY_STATS
+
+#if defined (ENABLE_MEMORY_STATS) && ! defined (TINY)
+#define MEMORY_STATS_ENABLED 1
+#else
+#define MEMORY_STATS_ENABLED 0
+#endif
+
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Heap: small, short-lived or odd-sized blocks.
 
 void * allocate (std::size_t n);
 void deallocate (void * p);
 
+// Pool: long-lived blocks, such as the model's arrays, aligned to a cache
+// line. Blocks are mapped directly from the system. On Linux, blocks of
+// 2 MiB or more use huge pages where available (explicit huge pages if any
+// are reserved, otherwise transparent huge pages), so that large arrays do
+// not each need thousands of TLB entries.
+
+const std::size_t pool_alignment = 64;
+
+void * pool_allocate (std::size_t n);
+void pool_deallocate (void * p);
+
+// Arena: scratch memory for the duration of one frame. Space is reserved
+// outside the frame (reserve may allocate from the pool, and returns false,
+// keeping the space it had, if that fails); within the frame, allocate just
+// advances a pointer, and reset releases everything at once. Allocations
+// are aligned to a cache line. If the arena is exhausted (the caller did
+// not, or could not, reserve enough) allocate returns a null pointer.
+
+struct arena_t
+{
+  bool reserve (std::size_t n);
+  void * allocate (std::size_t n);
+  template <typename T> T * allocate_array (std::size_t count)
+  {
+    return static_cast <T *> (allocate (count * sizeof (T)));
+  }
+  void reset () { used = 0; }
+
+  char * base;
+  std::size_t capacity;
+  std::size_t used;
+};
+
+// Allocation statistics.
+
+// When enabled, every heap and pool allocation is counted with the bytes
+// requested, as are the pool's bytes in use (and how many of those are huge
+// pages), their peak, and the arenas' peak use. memory_stats_end_frame
+// records the number of allocations since the previous frame ended;
+// memory_stats_report prints the totals and the mean and maximum allocations
+// per frame; memory_stats_last_frame returns the allocations of the last
+// frame ended.
+
+// memory_forbid_allocations (true) arms the zero-allocations-per-frame
+// assertion: until it is disarmed, any heap or pool allocation, or an
+// exhausted arena, prints a message and aborts. Use it after warm-up to check
+// that the steady state does not allocate.
+
+// The state is process-wide. When disabled the macros expand to nothing.
+
+#if MEMORY_STATS_ENABLED
+void memory_stats_end_frame ();
+void memory_stats_discard_frame ();
+std::uint64_t memory_stats_last_frame ();
+void memory_stats_report (std::FILE * file);
+void memory_forbid_allocations (bool forbid);
+
+#define MEMORY_STATS_END_FRAME() memory_stats_end_frame ()
+#define MEMORY_STATS_DISCARD_FRAME() memory_stats_discard_frame ()
+#define MEMORY_STATS_REPORT(file) memory_stats_report (file)
+#define MEMORY_FORBID_ALLOCATIONS(forbid) memory_forbid_allocations (forbid)
+#else
+#define MEMORY_STATS_END_FRAME()
+#define MEMORY_STATS_DISCARD_FRAME()
+#define MEMORY_STATS_REPORT(file)
+#define MEMORY_FORBID_ALLOCATIONS(forbid)
+#endif
+
 #endif
@@ -17,16 +17,30 @@
 #include "model.h"
 #include "aligned-arrays.h"
 #include "bounce.h"
-#include "hsv-to-rgb.h"
+#include "checkpoint.h"
+#include "collision-stats.h"
+#include "fill.h"
 #include "kdtree.h"
 #include "markov.h"
 #include "memory.h"
 #include "partition.h"
+#include "phase.h"
+#include "placement.h"
 #include "print.h"
+#include "publish.h"
+#include "qpc.h"
 #include "random-util.h"
+#include "recording.h"
 #include "rodrigues.h"
+#include "spike.h"
+#include "trace.h"
 #include "vector.h"
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
+#ifndef TINY
+#include <thread>
+#endif
 
 __attribute__ ((optimize ("O3"))) float cube (float x)
 {
@@ -88,6 +102,23 @@ namespace usr {
   const float morph_start = 1.75f;
   const float morph_finish = 3.50f;
   const float cycle_duration = 4.25f;
+
+  // The radius at radius setting 100 (see get_radius).
+  const float max_radius = 1.5f;
+
+  // Time for an object to grow from nothing, or shrink away.
+  const float fade_time = 1.0f;
+
+  // Overlap-relaxation sweeps in a fast start (placement.h).
+  const unsigned relax_sweeps = 6;
+
+  // Frames between keyframes in a recording (recording.h).
+  const unsigned recording_keyframe_interval = 60;
+
+  // Threads for filling the uniform blocks: at most this many, and enough
+  // objects for each.
+  const unsigned fill_max_threads = 8;
+  const unsigned fill_min_objects_per_thread = 4096;
 }
 
 #if PRINT_ENABLED
@@ -101,8 +132,6 @@ const unsigned polyhedra [system_count] [8] = {
   { 12, 4, 5, 14, 10, 9, 16, 18 },
 };
 
-unsigned polyhedron_counts [18] = { 0 };
-
 const char * names [] = {
   "tetrahedron",
   "octahedron",
@@ -123,8 +152,6 @@ const char * names [] = {
   "snub cube",
   "snub dodecahedron",
 };
-
-float min_d = 1.0f, max_d = 0.0f;
 #endif
 
 // Argument: t in [0, 1]; result: a hue in [0, 6].
@@ -158,32 +185,64 @@ inline float rainbow_hue (float x)
   return polyeval7 (x, poly_lo, poly_hi);
 }
 
-bool model_t::start (int width, int height, const settings_t & settings)
+// Object circumradius is in [0.5, 1.5] (see usr::max_radius).
+inline float get_radius (const settings_t & settings)
 {
-  ALIGNED16 float view [4];
+  return 0.5f + 0.01f * ui2f (settings.trackbar_pos [3]);
+}
+
+// The factor applied to the annealed velocities for heat setting s.
+inline float get_heat_factor (DWORD s)
+{
+  float t = ui2f (s);
+  return t * (s <= 50 ? (0.125f / 50) : (0.125f / (50 * 50)) * t);
+}
 
+// The view frustum for the window size: x1, y1, z1 are the coordinates of
+// its bottom-right-front corner, and z2 the z-coordinate of its back.
+inline void get_frustum (int width, int height, float & x1, float & y1,
+  float & z1, float & z2)
+{
   float scale = 0.5f / usr::scale;
-  float line0 = usr::line_m;
-  float line1 = usr::line_c;
   float fwidth = width;
   float fheight = height;
-  // Adjust scale and line width for small windows (for parented mode).
+  // Adjust scale for small windows (for parented mode).
   if (width < 512) scale *= 512.0f / fwidth;
-  if (width < 256) line0 *= 256.0f / fwidth;
+  x1 = scale * fwidth;
+  y1 = scale * fheight;
+  z1 = -3.0f * std::max (x1, y1);
+  z2 = z1 - std::min (x1, y1);
+}
 
-  // x1, y1, z1: Coordinates of bottom-right-front corner of view frustum.
-  float x1 = view [0] = scale * fwidth;
-  float y1 = view [1] = scale * fheight;
-  float z1 = view [2] = -3.0f * std::max (x1, y1);
+// Set the view, the walls, the spawning box and the maximum count for the
+// window size (using the radius).
+void model_t::set_tank (int width, int height)
+{
+  ALIGNED16 float view [4];
+  tank_width = width;
+  tank_height = height;
+
+  float line0 = usr::line_m;
+  float line1 = usr::line_c;
+  // Adjust line width for small windows (for parented mode).
+  if (width < 256) line0 *= 256.0f / width;
+
+  float x1, y1, z1, z2;
+  get_frustum (width, height, x1, y1, z1, z2);
+  view [0] = x1;
+  view [1] = y1;
+  view [2] = z1;
+  view [3] = z2;
 
   float zd = std::min (x1, y1); // zd: Depth of view frustum.
   // x2, y2, z2: Coordinates of bottom-right-back corner of view frustum.
-  float z2 = view [3] = z1 - zd;
   float x2 = x1 * (z2 / z1);
   float y2 = y1 * (z2 / z1);
 
-  program.set_view (view, width, height, usr::fog_near, usr::fog_far,
-                    line0, line1);
+  if (graphics) {
+    program.set_view (view, width, height, usr::fog_near, usr::fog_far,
+                      line0, line1);
+  }
 
   // Calculate wall planes to fit the front of the viewing frustum.
   ALIGNED16 const float temp [6] [2] [4] = {
@@ -202,76 +261,35 @@ bool model_t::start (int width, int height, const settings_t & settings)
     store4f (walls [k] [1], normalize (normal));
   }
 
-  // Object circumradius is in [0.5, 1.5).
-  radius = 0.5f + 0.01f * ui2f (settings.trackbar_pos [3]);
-  float rsq = radius * radius;
-  float mass = usr::density * rsq;
-  float moment = 0.4f * usr::density * (rsq * rsq);
-  float phase_offset = get_float (rng, 1.0f, 2.0f);
-  // Trackbar positions 0, 1, 2 specify 1, 2, 3 objects respectively;
-  // subsequently the number of objects increases linearly with position.
-  unsigned max_count = std::max (3u,
-    truncate (usr::fill_factor * (x1 * y1 * zd) / (rsq * radius)));
-  DWORD pos = settings.trackbar_pos [0];
-  count = pos < 2 ? pos + 1 : 3 + (max_count - 3) * (pos - 2) / 98;
-  set_capacity (count);
-
   v4f c = { 0.0f, 0.0f, 0.5f * (z1 + z2), 0.0f };
   v4f m = { x2 - radius, y2 - radius, 0.5f * (z1 - z2) - radius, 0.0f };
+  store4f (spawn_box [0], c);
+  store4f (spawn_box [1], m);
 
-  // Add objects.
-  for (unsigned n = 0; n != count; ++ n) {
-    kdtree_index [n] = n;
-    object_order [n] = n;
+  float rsq = radius * radius;
+  max_count = std::max (3u,
+    truncate (usr::fill_factor * (x1 * y1 * zd) / (rsq * radius)));
+}
 
-  loop:
-    // Get a random point in the bounding cuboid of the viewing frustum.
-    v4f t = m * get_vector_in_box (rng) + c;
-    // Discard and try again if distance to any wall is less than radius.
-    // No need to check the first two walls (the front and rear).
-    for (unsigned k = 2; k != 6; ++ k) {
-      v4f anchor = load4f (walls [k] [0]);
-      v4f normal = load4f (walls [k] [1]);
-      float s = _mm_cvtss_f32 (dot (t - anchor, normal));
-      if (s < radius) {
-        goto loop;
-      }
-    }
-    // Moderately high initial temperature for rapid annealing.
-    store4f (x [n], t);
-    store4f (v [n], get_vector_in_ball (rng, 0.25f));
-    store4f (u [n], get_vector_in_ball (rng, 0x1.921fb4P+001f)); // pi
-    store4f (w [n], get_vector_in_ball (rng, 0.10f));
+// The count for count setting pos, in the current tank.
+unsigned model_t::get_count (DWORD pos) const
+{
+  // Trackbar positions 0, 1, 2 specify 1, 2, 3 objects respectively;
+  // subsequently the number of objects increases linearly with position.
+  return pos < 2 ? pos + 1 : 3 + (max_count - 3) * (pos - 2) / 98;
+}
 
-    object_t & A = objects [n];
-    A.m = mass;
-    A.l = moment;
-    A.r = radius;
-
-    float phase = ui2f (n) / ui2f (count);
-    A.hue = rainbow_hue (phase_offset - phase);
-    // Initial animation_time is in [T, 2T) to force an immediate transition.
-    A.animation_time = (1.0f + phase) * usr::cycle_duration;
-
-    // Get independent integers, d6 uniform on [0, 6) and d8 uniform on [0, 8).
-    std::uint32_t d = (std::uint32_t) rng.get ();
-    std::uint32_t d8 = d & 7u;
-    std::uint32_t d6 = (3u * (d >> 3u)) >> 28u;
-    A.target.system = (system_select_t) d6;
-    A.target.point = d8;
-    A.starting_point = A.target.point;
-  }
-
-  // Take the animation-speed s, an integer in the range 0 to 100, inclusive;
-  // every frame, the morph/fade animation time is advanced by the time interval
-  // kT, where k is an increasing continuous function of s, and the constant T
-  // is the default frame time.
-  DWORD s = settings.trackbar_pos [2];
+// Take the animation-speed s, an integer in the range 0 to 100, inclusive;
+// every frame, the morph/fade animation time is advanced by the time interval
+// kT, where k is an increasing continuous function of s, and the constant T
+// is the default frame time. Set k, and the bump functions for the lightness
+// and saturation fade animation.
+void model_t::set_animation_speed (DWORD s)
+{
   float k = 0.02f * ui2f (s);  // 0.0 <= k <= 2.0
   // Boost animation speed in the upper half of the range.
   animation_speed_constant = s <= 50 ? k : ((k * k) * (k * k));
 
-  // Initialize bump functions for the lightness and saturation fade animation.
   ALIGNED16 bump_specifier_t sbump = usr::sbump;
   ALIGNED16 bump_specifier_t vbump = usr::vbump;
   if (s >= 75) {
@@ -295,14 +313,83 @@ bool model_t::start (int width, int height, const settings_t & settings)
     vbump.t1 -= 0.15f;
   }
   bumps.initialize (sbump, vbump);
+}
 
-  // Allow the balls to jostle for space.
-  for (unsigned n = 0; n != 24; ++ n) nodraw_next ();
+bool model_t::start (int width, int height, const settings_t & settings,
+  const char * checkpoint, bool exact)
+{
+  TRACE_SCOPE ("start");
+  // Discard any settings changes posted for the previous run.
+  settings_t discarded;
+  commands.take (discarded);
+  current_settings = settings;
+  radius = get_radius (settings);
+  set_tank (width, height);
+  unsigned new_count = get_count (settings.trackbar_pos [0]);
+  count = 0;
+  fading = 0;
+  fading_out = 0;
+  if (! set_capacity (new_count)) return false;
+
+  bool resumed = false;
+  if constexpr (CHECKPOINTS_ENABLED) {
+    resumed = checkpoint
+      && resume (checkpoint, width, height, settings, new_count, exact);
+  }
+  bool placed = false;
+  if (! resumed) {
+    // Place the objects all at once, if possible (see placement.h).
+    if constexpr (FAST_START_ENABLED) {
+      placed = place_objects (rng, x, new_count, spawn_box, walls, radius);
+    }
+    // Add objects, with moderately high initial temperature for rapid
+    // annealing.
+    float phase_offset = get_float (rng, 1.0f, 2.0f);
+    for (unsigned n = 0; n != new_count; ++ n) {
+      float phase = ui2f (n) / ui2f (new_count);
+      // Initial animation_time is in [T, 2T) to force an immediate
+      // transition.
+      spawn (n, rainbow_hue (phase_offset - phase),
+        (1.0f + phase) * usr::cycle_duration, 0.25f, 0.10f, 1.0f, placed);
+    }
+#ifndef TINY
+    workers_t * helpers = & workers;
+#else
+    workers_t * helpers = nullptr;
+#endif
+    placed = placed && relax_overlaps (x, new_count, spawn_box, walls,
+      radius, usr::relax_sweeps, helpers);
+  }
+  else if (! exact) {
+    // Each warm start should look different: turn the colour wheel and
+    // choose new morph phases, from this model's own random stream.
+    float turn = get_float (rng, 0.0f, 6.0f);
+    for (unsigned n = 0; n != new_count; ++ n) {
+      object_t & A = objects [n];
+      A.hue += turn;
+      if (A.hue >= 6.0f) A.hue -= 6.0f;
+      A.animation_time = get_float (rng, 0.0f, usr::cycle_duration);
+    }
+  }
+  count = new_count;
+
+  set_animation_speed (settings.trackbar_pos [2]);
+
+  // Allow the balls to jostle for space (unless already relaxed).
+  if (! resumed) {
+    TRACE_SCOPE ("anneal");
+    if (! placed) for (unsigned n = 0; n != 24; ++ n) nodraw_next ();
+    if constexpr (CHECKPOINTS_ENABLED) {
+      if (checkpoint) save (checkpoint, width, height, settings);
+    }
+  }
+  PERF_DISCARD_FRAME ();
+  COLLISION_STATS_DISCARD_FRAME ();
+  PHASE_TIMES_DISCARD_FRAME ();
+  MEMORY_STATS_DISCARD_FRAME ();
 
   // Slow down to the configured speed.
-  s = settings.trackbar_pos [1];
-  v4f speedup = _mm_set1_ps (
-    ui2f (s) * (s <= 50 ? (0.125f / 50) : (0.125f / (50 * 50)) * ui2f (s)));
+  v4f speedup = _mm_set1_ps (get_heat_factor (settings.trackbar_pos [1]));
   for (unsigned n = 0; n != count; ++ n) {
     store4f (v [n], speedup * load4f (v [n]));
     store4f (w [n], speedup * load4f (w [n]));
@@ -315,126 +402,754 @@ bool model_t::start (int width, int height, const settings_t & settings)
   return true;
 }
 
-int model_t::initialize (std::uint64_t seed)
+// Fit the running simulation to a new window size. Along each axis on
+// which the tank grows, the positions are scaled from the old spawning box
+// to the new one (spreading the objects out); along each axis on which it
+// shrinks, they are only moved with the centre, and the objects now outside
+// the walls are removed (so the view is cropped, and the objects left are no
+// closer together). Those left within the radius of a wall are pushed off
+// it. Then the count is faded to that for the new size. Velocities,
+// rotations and animations carry on, and the depth order is still nearly
+// sorted (insertion_sort finishes the job in draw_next).
+bool model_t::resize (int width, int height)
+{
+  TRACE_SCOPE ("resize");
+  if (! count) return false;
+  std::uint8_t * marks = static_cast <std::uint8_t *> (pool_allocate (count));
+  if (! marks) return false;
+  v4f r = { radius, radius, radius, 1.0f };
+  v4f c0 = load4f (spawn_box [0]);
+  v4f m0 = load4f (spawn_box [1]) + r;
+  set_tank (width, height);
+  v4f c1 = load4f (spawn_box [0]);
+  v4f m1 = load4f (spawn_box [1]) + r;
+  // The last lane is 1, and the last lanes of c0 and c1 are 0.
+  v4f scale = _mm_max_ps (m1 / m0, _mm_set1_ps (1.0f));
+
+  bool crop = false;
+  for (unsigned n = 0; n != count; ++ n) {
+    v4f p = c1 + scale * (load4f (x [n]) - c0);
+    bool outside = false;
+    for (unsigned k = 0; k != 6; ++ k) {
+      v4f anchor = load4f (walls [k] [0]);
+      v4f normal = load4f (walls [k] [1]);
+      outside = outside || _mm_cvtss_f32 (dot (p - anchor, normal)) < 0.0f;
+    }
+    marks [n] = outside;
+    crop = crop || outside;
+    if (outside) continue;
+    // Pushing off a slanted side wall moves the object in depth too, which
+    // can push it through the front or the back, so repeat until it fits
+    // (in practice once or twice).
+    bool moved = true;
+    for (unsigned pass = 0; moved && pass != 8; ++ pass) {
+      moved = false;
+      for (unsigned k = 0; k != 6; ++ k) {
+        v4f anchor = load4f (walls [k] [0]);
+        v4f normal = load4f (walls [k] [1]);
+        float s = _mm_cvtss_f32 (dot (p - anchor, normal));
+        if (s < radius) {
+          p += _mm_set1_ps (radius - s) * normal;
+          moved = true;
+        }
+      }
+    }
+    store4f (x [n], p);
+  }
+  if (crop) remove_objects (marks);
+  pool_deallocate (marks);
+  PERF_DISCARD_FRAME ();
+  COLLISION_STATS_DISCARD_FRAME ();
+  PHASE_TIMES_DISCARD_FRAME ();
+  MEMORY_STATS_DISCARD_FRAME ();
+  return fade_to_count (get_count (current_settings.trackbar_pos [0]));
+}
+
+// Post a change of setting for the running model (see commands.h).
+bool model_t::post_setting (unsigned index, DWORD pos)
+{
+  if (index >= trackbar_count) return false;
+  commands.post (index, pos > 100 ? 100 : pos);
+  return true;
+}
+
+// Apply the posted changes (the latest position of each setting).
+void model_t::apply_commands ()
+{
+  settings_t settings = current_settings;
+  if (commands.take (settings)) apply_settings (settings);
+}
+
+// Change the settings of the running simulation in place. The radius goes
+// first, since the count depends on it.
+bool model_t::apply_settings (const settings_t & settings)
+{
+  TRACE_SCOPE ("apply settings");
+  const DWORD * old_pos = current_settings.trackbar_pos;
+  const DWORD * pos = settings.trackbar_pos;
+  bool ok = true;
+  if (pos [3] != old_pos [3]) {
+    // Give every object the mass and moment of inertia of the new radius.
+    // To grow, an object keeps its size and fades in to the new one (so
+    // that the objects don't suddenly overlap, and those about to fade out
+    // shrink away from their present size); to shrink, it takes the new
+    // size at once. The spawning box and the maximum count change too.
+    float ratio = radius / get_radius (settings);
+    radius = get_radius (settings);
+    float rsq = radius * radius;
+    for (unsigned n = 0; n != count; ++ n) {
+      object_t & A = objects [n];
+      A.m = usr::density * rsq;
+      A.l = 0.4f * usr::density * (rsq * rsq);
+      if (ratio < 1.0f) {
+        if (A.fade == 1.0f) ++ fading;
+        A.fade *= ratio;
+      }
+      A.r = radius * (A.fade < 0.0f ? - A.fade : A.fade);
+    }
+    set_tank (tank_width, tank_height);
+  }
+  if (pos [3] != old_pos [3] || pos [0] != old_pos [0]) {
+    ok = fade_to_count (get_count (pos [0]));
+    ++ generation;
+  }
+  if (pos [1] != old_pos [1]) {
+    // Scale the velocities and angular velocities. From rest (heat zero),
+    // draw them afresh, as spawn does before the anneal.
+    float old_factor = get_heat_factor (old_pos [1]);
+    float new_factor = get_heat_factor (pos [1]);
+    if (old_factor > 0.0f) {
+      v4f scale = _mm_set1_ps (new_factor / old_factor);
+      for (unsigned n = 0; n != count; ++ n) {
+        store4f (v [n], scale * load4f (v [n]));
+        store4f (w [n], scale * load4f (w [n]));
+      }
+    }
+    else {
+      for (unsigned n = 0; n != count; ++ n) {
+        store4f (v [n], get_vector_in_ball (rng, 0.25f * new_factor));
+        store4f (w [n], get_vector_in_ball (rng, 0.10f * new_factor));
+      }
+    }
+  }
+  if (pos [2] != old_pos [2]) set_animation_speed (pos [2]);
+  current_settings = settings;
+  return ok;
+}
+
+#if CHECKPOINTS_ENABLED
+// Load the first new_count objects (and, if exact, the RNG state) from a
+// checkpoint with the right key, if there is one.
+bool model_t::resume (const char * checkpoint, int width, int height,
+  const settings_t & settings, unsigned new_count, bool exact)
+{
+  TRACE_SCOPE ("resume");
+  checkpoint_map_t map;
+  if (! map.open (checkpoint)) return false;
+  const checkpoint_header_t & h = * map.header;
+  std::size_t n = h.count;
+  bool ok = h.object_size == sizeof (object_t)
+    && h.width == width && h.height == height
+    && h.radius_pos == settings.trackbar_pos [3]
+    && h.count >= new_count
+    && h.size [checkpoint_x] == n * sizeof x [0]
+    && h.size [checkpoint_v] == n * sizeof v [0]
+    && h.size [checkpoint_u] == n * sizeof u [0]
+    && h.size [checkpoint_w] == n * sizeof w [0]
+    && h.size [checkpoint_e] == n * sizeof e [0]
+    && h.size [checkpoint_objects] == n * sizeof (object_t)
+    && h.size [checkpoint_kdtree_index] == n * sizeof (unsigned);
+  // Check the fields used as indices, and that the objects are not fading
+  // (the population was saved after the anneal, with none fading).
+  const object_t * saved = static_cast <const object_t *>
+    (map.array (checkpoint_objects));
+  for (unsigned k = 0; ok && k != new_count; ++ k) {
+    const object_t & A = saved [k];
+    ok = (unsigned) A.target.system < system_count
+      && A.starting_point < 8 && A.target.point < 8 && A.fade == 1.0f;
+  }
+  if (ok) {
+    std::memcpy (x, map.array (checkpoint_x), new_count * sizeof x [0]);
+    std::memcpy (v, map.array (checkpoint_v), new_count * sizeof v [0]);
+    std::memcpy (u, map.array (checkpoint_u), new_count * sizeof u [0]);
+    std::memcpy (w, map.array (checkpoint_w), new_count * sizeof w [0]);
+    std::memcpy (e, map.array (checkpoint_e), new_count * sizeof e [0]);
+    std::memcpy (objects, saved, new_count * sizeof (object_t));
+    // The kd-tree permutation, less the objects not taken. It must be a
+    // permutation (object_order marks the objects seen).
+    const unsigned * index = static_cast <const unsigned *>
+      (map.array (checkpoint_kdtree_index));
+    for (unsigned k = 0; k != new_count; ++ k) object_order [k] = 0;
+    unsigned j = 0;
+    for (std::size_t k = 0; ok && k != n && j != new_count; ++ k) {
+      unsigned i = index [k];
+      if (i >= new_count) continue;
+      ok = ! object_order [i];
+      object_order [i] = 1;
+      kdtree_index [j ++] = i;
+    }
+    for (unsigned k = 0; k != new_count; ++ k) object_order [k] = k;
+    ok = ok && j == new_count;
+    if (ok && exact) rng.set_state (h.rng_state);
+  }
+  map.close ();
+  return ok;
+}
+
+void model_t::save (const char * checkpoint, int width, int height,
+  const settings_t & settings) const
+{
+  TRACE_SCOPE ("save");
+  checkpoint_header_t h = { };
+  h.magic = checkpoint_magic;
+  h.version = checkpoint_version;
+  h.header_size = sizeof (checkpoint_header_t);
+  h.object_size = sizeof (object_t);
+  h.width = width;
+  h.height = height;
+  h.radius_pos = settings.trackbar_pos [3];
+  h.count = count;
+  h.rng_state = rng.get_state ();
+  std::size_t n = count;
+  h.size [checkpoint_x] = n * sizeof x [0];
+  h.size [checkpoint_v] = n * sizeof v [0];
+  h.size [checkpoint_u] = n * sizeof u [0];
+  h.size [checkpoint_w] = n * sizeof w [0];
+  h.size [checkpoint_e] = n * sizeof e [0];
+  h.size [checkpoint_objects] = n * sizeof (object_t);
+  h.size [checkpoint_kdtree_index] = n * sizeof (unsigned);
+  const void * const arrays [checkpoint_array_count] = {
+    x, v, u, w, e, objects, kdtree_index,
+  };
+  // A failure costs only the next warm start.
+  checkpoint_write (checkpoint, h, arrays);
+}
+#else
+bool model_t::resume (const char *, int, int, const settings_t &, unsigned)
+{
+  return false;
+}
+
+void model_t::save (const char *, int, int, const settings_t &) const
+{
+}
+#endif
+
+void model_t::initialize (std::uint64_t seed)
 {
-  if (! initialize_graphics (program)) return -1; // Abort window creation.
   rng.initialize (seed);
   step.initialize (usr::morph_start, usr::morph_finish);
-  initialize_systems (abc, xyz, xyzinv, primitive_count, vao_ids);
-  return 0; // Continue window creation.
+  initialize_systems (abc, xyz, xyzinv, primitive_count);
+  markov.initialize (abc, xyz, xyzinv);
+  stats.min_d = 1.0f;
+  stats.max_d = 0.0f;
+}
+
+bool model_t::initialize_graphics ()
+{
+  if (! ::initialize_graphics (program)) return false;
+  initialize_vaos (xyz, vao_ids);
+  graphics = program.uniform_buffer.reserve (capacity);
+#ifndef TINY
+  // Helpers for the fill stage; without them, render fills on one thread.
+  unsigned threads = std::thread::hardware_concurrency ();
+  if (threads > usr::fill_max_threads) threads = usr::fill_max_threads;
+  if (graphics && threads > 1) workers.start (threads - 1);
+#endif
+  return graphics;
 }
 
 model_t::~model_t ()
 {
+  pool_deallocate (memory);
+  pool_deallocate (frame_arena.base);
 #if PRINT_ENABLED
+  if (! stats.frames) return;
   std::cout << std::scientific << std::setprecision (8)
-            << "Required range for arccos function: x in [" << min_d << ", "
-            << max_d << "].\n\n";
+            << "Required range for arccos function: x in [" << stats.min_d
+            << ", " << stats.max_d << "].\n\n";
 
   double total_polyhedron_count = 0.0;
   for (unsigned n = 0; n != 18; ++ n) {
-    total_polyhedron_count += polyhedron_counts [n];
+    total_polyhedron_count += stats.polyhedron_counts [n];
   }
 
   std::cout << std::fixed << std::setprecision (2);
   for (unsigned n = 0; n != 18; ++ n) {
     std::cout << std::setw (10)
-              << (100.0 * polyhedron_counts [n] / total_polyhedron_count)
+              << (100.0 * stats.polyhedron_counts [n] / total_polyhedron_count)
               << " % " << names [n] << "\n";
   }
 #endif
-  //deallocate (memory);
-  //deallocate (kdtree_split);
 }
 
-void model_t::set_capacity (std::size_t new_capacity)
+// Grow the arrays, preserving the objects [0, count).
+bool model_t::set_capacity (std::size_t new_capacity)
+{
+  // Reserve the frame's scratch memory: the kd-tree's split values, the
+  // list of objects making Markov transitions in advance, and the renaming
+  // table in update_fades. First, so that on failure nothing has changed;
+  // for the capacity the arrays will have (see aligned-arrays.h).
+  std::size_t n = std::max (capacity, (new_capacity + 15) & ~ 15);
+  unsigned nonleaf_count = (1 << required_depth ((unsigned) n)) - 1;
+  std::size_t line = pool_alignment - 1;
+  if (! frame_arena.reserve (((nonleaf_count * sizeof (float) + line) & ~ line)
+      + 2 * ((n * sizeof (unsigned) + line) & ~ line))) {
+    return false;
+  }
+  if (! reallocate_aligned_arrays (memory, capacity, new_capacity, count,
+      x, v, u, w, e, kdtree_index, kdtree_aux, objects, object_order)) {
+    return false;
+  }
+  // Staging memory for the uniform blocks of the whole frame (see render).
+  return ! graphics || program.uniform_buffer.reserve (capacity);
+}
+
+// Initialize object n (at the end of the permutations kdtree_index and
+// object_order), with a random position in the spawning box away from the
+// side walls (unless "placed", when x [n] is already set), random velocity
+// and angular velocity of magnitude at most speed and spin, and a random
+// target. If fade is less than 1, the object grows to full size over the
+// next frames.
+void model_t::spawn (unsigned n, float hue, float animation_time,
+  float speed, float spin, float fade, bool placed)
+{
+  kdtree_index [n] = n;
+  object_order [n] = n;
+
+  if (! placed) {
+    v4f c = load4f (spawn_box [0]);
+    v4f m = load4f (spawn_box [1]);
+  loop:
+    // Get a random point in the bounding cuboid of the viewing frustum.
+    v4f t = m * get_vector_in_box (rng) + c;
+    // Discard and try again if distance to any wall is less than radius.
+    // No need to check the first two walls (the front and rear).
+    for (unsigned k = 2; k != 6; ++ k) {
+      v4f anchor = load4f (walls [k] [0]);
+      v4f normal = load4f (walls [k] [1]);
+      float s = _mm_cvtss_f32 (dot (t - anchor, normal));
+      if (s < radius) {
+        goto loop;
+      }
+    }
+    store4f (x [n], t);
+  }
+  store4f (v [n], get_vector_in_ball (rng, speed));
+  store4f (u [n], get_vector_in_ball (rng, 0x1.921fb4P+001f)); // pi
+  store4f (w [n], get_vector_in_ball (rng, spin));
+
+  float rsq = radius * radius;
+  object_t & A = objects [n];
+  A.m = usr::density * rsq;
+  A.l = 0.4f * usr::density * (rsq * rsq);
+  A.r = radius * fade;
+  A.fade = fade;
+  if (fade != 1.0f) ++ fading;
+  A.hue = hue;
+  A.animation_time = animation_time;
+
+  // Get independent integers, d6 uniform on [0, 6) and d8 uniform on [0, 8).
+  std::uint32_t d = (std::uint32_t) rng.get ();
+  std::uint32_t d8 = d & 7u;
+  std::uint32_t d6 = (3u * (d >> 3u)) >> 28u;
+  A.target.system = (system_select_t) d6;
+  A.target.point = d8;
+  A.starting_point = A.target.point;
+}
+
+// Add n objects, at the temperature of the existing ones. Capacity grows
+// geometrically, so a sequence of additions takes amortized constant time
+// per object. New objects begin a new animation cycle at once, and grow from
+// nothing, pushing any overlapping objects aside.
+bool model_t::add_objects (unsigned n)
+{
+  if (! n) return true;
+  std::size_t new_count = std::size_t (count) + n;
+  if (new_count > capacity) {
+    if (! set_capacity (std::max (new_count, 2 * capacity))) return false;
+  }
+
+  // For velocities uniform in a ball of radius R, E|v|^2 = (3/5) R^2.
+  float speed = 0.25f, spin = 0.10f;
+  if (count) {
+    v4f vsq = _mm_setzero_ps (), wsq = _mm_setzero_ps ();
+    for (unsigned k = 0; k != count; ++ k) {
+      v4f a = load4f (v [k]), b = load4f (w [k]);
+      vsq += dot (a, a);
+      wsq += dot (b, b);
+    }
+    v4f scale = _mm_set1_ps ((5.0f / 3.0f) / ui2f (count));
+    speed = _mm_cvtss_f32 (sqrt (scale * vsq));
+    spin = _mm_cvtss_f32 (sqrt (scale * wsq));
+  }
+
+  for (unsigned k = count; k != new_count; ++ k) {
+    float hue = rainbow_hue (get_float (rng, 0.0f, 1.0f));
+    float t = get_float (rng, 1.0f, 2.0f) * usr::cycle_duration;
+    spawn (k, hue, t, speed, spin, 0.0f);
+  }
+  count = (unsigned) new_count;
+  return true;
+}
+
+// Remove object "index" by moving the last object into its place. The
+// permutations kdtree_index and object_order refer to objects by index, so
+// the entry for the last object is renamed, and the entry for the removed
+// object is deleted by moving the last entry into its place. The relative
+// order of the other entries is not important: the kd-tree is rebuilt each
+// frame, and the depth order is restored by insertion_sort.
+void model_t::remove_object (unsigned index)
+{
+  if (index >= count) return;
+  float fade = objects [index].fade;
+  if (fade != 1.0f) -- fading;
+  if (fade < 0.0f) -- fading_out;
+  unsigned last = count - 1;
+  if (index != last) {
+    store4f (x [index], load4f (x [last]));
+    store4f (v [index], load4f (v [last]));
+    store4f (u [index], load4f (u [last]));
+    store4f (w [index], load4f (w [last]));
+    store4f (e [index], load4f (e [last]));
+    objects [index] = objects [last];
+  }
+  unsigned * permutations [] = { kdtree_index, object_order };
+  for (unsigned * permutation : permutations) {
+    unsigned position = 0;
+    for (unsigned k = 0; k != count; ++ k) {
+      if (permutation [k] == index) position = k;
+      else if (permutation [k] == last) permutation [k] = index;
+    }
+    permutation [position] = permutation [last];
+  }
+  count = last;
+}
+
+// Add or remove (randomly chosen) objects to make the count new_count.
+// The objects removed are chosen by selection sampling and removed together
+// (see remove_objects), in time linear in the count.
+bool model_t::set_count (unsigned new_count)
+{
+  if (count > new_count) {
+    std::uint8_t * marks = static_cast <std::uint8_t *>
+      (pool_allocate (count));
+    if (marks) {
+      unsigned wanted = count - new_count;
+      for (unsigned n = 0; n != count; ++ n) {
+        // Remove this one with probability wanted / (objects left).
+        std::uint64_t left = count - n;
+        bool remove = ((rng.get () >> 32) * left) >> 32 < wanted;
+        marks [n] = remove;
+        wanted -= remove;
+      }
+      remove_objects (marks);
+      pool_deallocate (marks);
+    }
+    // Out of memory: one at a time.
+    while (count > new_count) {
+      remove_object ((unsigned) (((rng.get () >> 32) * count) >> 32));
+    }
+  }
+  return add_objects (new_count - count);
+}
+
+// Fade out randomly chosen objects, or fade back in objects that are fading
+// out and then add new ones, to make the active count new_count. Objects
+// that finish fading out are removed (see update_fades).
+bool model_t::fade_to_count (unsigned new_count)
+{
+  unsigned active = count - fading_out;
+  for (unsigned n = 0; n != count && active < new_count; ++ n) {
+    object_t & A = objects [n];
+    if (A.fade < 0.0f) {
+      // (Restored to full size if shed since the last frame.)
+      A.fade = - A.fade;
+      if (A.fade == 1.0f) -- fading;
+      -- fading_out;
+      ++ active;
+    }
+  }
+  if (active < new_count) return add_objects (new_count - active);
+  while (active > new_count) {
+    object_t & A = objects [((rng.get () >> 32) * count) >> 32];
+    if (A.fade < 0.0f) continue;
+    if (A.fade == 1.0f) ++ fading;
+    // Store the size negated (and nonzero, so the sign is kept).
+    A.fade = A.fade > 0.0f ? - A.fade : - 0x1.0P-24f;
+    ++ fading_out;
+    -- active;
+  }
+  return true;
+}
+
+void model_t::set_collision_interval (unsigned interval)
+{
+  collision_interval = interval;
+}
+
+// Advance the fades by one frame. An object's fade is its size as a fraction
+// of the full radius: 1 normally, increasing to 1 while fading in, and
+// negated while fading out. Objects that finish fading out are removed by
+// compacting the arrays (preserving order) and renaming the entries of
+// kdtree_index and object_order, in a single pass.
+void model_t::update_fades ()
+{
+  const float step = usr::frame_time / usr::fade_time;
+  const unsigned removed = ~ 0u;
+  unsigned * rename = frame_arena.allocate_array <unsigned> (count);
+  // Out of memory: hold the fades (for this frame).
+  if (! rename) return;
+  unsigned kept = 0;
+  for (unsigned n = 0; n != count; ++ n) {
+    object_t & A = objects [n];
+    float f = A.fade;
+    if (f != 1.0f) {
+      if (f >= 0.0f) {
+        f = std::min (f + step, 1.0f);
+        if (f == 1.0f) -- fading;
+      }
+      else if ((f += step) >= 0.0f) {
+        -- fading;
+        -- fading_out;
+        rename [n] = removed;
+        continue;
+      }
+      A.fade = f;
+      A.r = radius * (f < 0.0f ? - f : f);
+    }
+    rename [n] = kept;
+    if (kept != n) {
+      store4f (x [kept], load4f (x [n]));
+      store4f (v [kept], load4f (v [n]));
+      store4f (u [kept], load4f (u [n]));
+      store4f (w [kept], load4f (w [n]));
+      store4f (e [kept], load4f (e [n]));
+      objects [kept] = A;
+    }
+    ++ kept;
+  }
+  if (kept != count) rename_permutations (rename, kept);
+}
+
+// After a stable compaction of the object arrays, in which object n became
+// object rename [n], or was removed if rename [n] is ~0, rename the entries
+// of kdtree_index and object_order and delete those of the removed objects.
+void model_t::rename_permutations (const unsigned * rename, unsigned kept)
 {
-  reallocate_aligned_arrays (memory, capacity, new_capacity, x, v, u, w, e,
-    kdtree_index, kdtree_aux, objects, object_order);
+  const unsigned removed = ~ 0u;
+  unsigned * permutations [] = { kdtree_index, object_order };
+  for (unsigned * permutation : permutations) {
+    unsigned j = 0;
+    for (unsigned k = 0; k != count; ++ k) {
+      unsigned m = rename [permutation [k]];
+      if (m != removed) permutation [j ++] = m;
+    }
+  }
+  count = kept;
+}
+
+// Copy out the complete state of object "index".
+void model_t::export_object (unsigned index, object_state_t & state) const
+{
+  store4f (state.x, load4f (x [index]));
+  store4f (state.v, load4f (v [index]));
+  store4f (state.u, load4f (u [index]));
+  store4f (state.w, load4f (w [index]));
+  store4f (state.e, load4f (e [index]));
+  state.object = objects [index];
+}
+
+// Append n objects with the given states (at the ends of the permutations).
+bool model_t::import_objects (const object_state_t * states, unsigned n)
+{
+  std::size_t new_count = std::size_t (count) + n;
+  if (new_count > capacity) {
+    if (! set_capacity (std::max (new_count, 2 * capacity))) return false;
+  }
+  for (unsigned k = 0; k != n; ++ k) {
+    const object_state_t & state = states [k];
+    unsigned i = count + k;
+    store4f (x [i], load4f (state.x));
+    store4f (v [i], load4f (state.v));
+    store4f (u [i], load4f (state.u));
+    store4f (w [i], load4f (state.w));
+    store4f (e [i], load4f (state.e));
+    objects [i] = state.object;
+    if (state.object.fade != 1.0f) ++ fading;
+    if (state.object.fade < 0.0f) ++ fading_out;
+    kdtree_index [i] = i;
+    object_order [i] = i;
+  }
+  count = (unsigned) new_count;
+  return true;
+}
+
+// Remove the objects n for which remove [n] is nonzero, preserving the order
+// of the others (memory permitting), in one pass. Call between frames (the
+// renaming table is frame scratch memory).
+void model_t::remove_objects (const std::uint8_t * remove)
+{
+  const unsigned removed = ~ 0u;
+  frame_arena.reset ();
+  unsigned * rename = frame_arena.allocate_array <unsigned> (count);
+  if (! rename) {
+    // Out of memory: remove them one at a time instead, from the end (each
+    // is replaced by the last object, which has already been considered),
+    // not preserving the order.
+    for (unsigned n = count; n --; ) if (remove [n]) remove_object (n);
+    return;
+  }
+  unsigned kept = 0;
+  for (unsigned n = 0; n != count; ++ n) {
+    if (remove [n]) {
+      float fade = objects [n].fade;
+      if (fade != 1.0f) -- fading;
+      if (fade < 0.0f) -- fading_out;
+      rename [n] = removed;
+      continue;
+    }
+    rename [n] = kept;
+    if (kept != n) {
+      store4f (x [kept], load4f (x [n]));
+      store4f (v [kept], load4f (v [n]));
+      store4f (u [kept], load4f (u [n]));
+      store4f (w [kept], load4f (w [n]));
+      store4f (e [kept], load4f (e [n]));
+      objects [kept] = objects [n];
+    }
+    ++ kept;
+  }
+  if (kept != count) rename_permutations (rename, kept);
 }
 
 void model_t::recalculate_locus (unsigned index)
 {
   object_t & object = objects [index];
-  float (& locus_end) [4] = e [index];
-
-  system_select_t system = object.target.system;
-
-  // g0: Coefficients for T0 in terms of xyz.
-  // g1: Coefficients for T1 in terms of xyz.
-  // T0: Beginning of locus (unit vector).
-  // T1: End of locus (also a unit vector).
-  // d:  Dot product of T0 and T1, i.e., cos s where s is the arc length T0-T1.
-  // T2: Component of T1 perpendicular to T0, normalized to a unit vector.
-  // g2: Coefficents for T2 in terms of xyz.
-
-  v4f g0 = load4f (abc [system] [object.starting_point]);
-  v4f g1 = load4f (abc [system] [object.target.point]);
-  v4f T0 = mapply (xyz [system], g0);
-  v4f T1 = mapply (xyz [system], g1);
-  // Find a unit vector T2 perpendicular to T0 and and an angle s such that
-  // T1 = (cos s) T0 + (sin s) T2.
-  v4f d = dot (T0, T1);
-  v4f T2 = normalize (T1 - d * T0);
-  v4f g2 = mapply (xyzinv [system], T2);
-  // Any point T = (cos t) T0 + (sin t) T2 (where 0 <= t <= s) on the
-  // hemisemicircular arc T0-T1 has coefficients (cos t) g0 + (sin t) g2.
-  store4f (locus_end, g2);
-  // Calculate the arc-length s = arccos(d) of the great circular arc T0-T1.
-  // Note: for allowed transitions we have d in [0.774596691, 0.990879238].
-  object.locus_length = _mm_cvtss_f32 (arccos (d));
-
+  markov.locus (object, e [index]);
 #if PRINT_ENABLED
-  float df = _mm_cvtss_f32 (d);
-  if (min_d > df) min_d = df;
-  if (max_d < df) max_d = df;
+  float df = markov.cosine [object.target.system] [object.starting_point]
+    [object.target.point];
+  if (stats.min_d > df) stats.min_d = df;
+  if (stats.max_d < df) stats.max_d = df;
 #endif
 }
 
 void model_t::nodraw_next ()
 {
+  TRACE_SCOPE ("nodraw_next");
+  frame_arena.reset ();
   // Advance the simulation without updating the angular position.
-  if (count) {
+  if (count && ++ collision_phase >= collision_interval) {
     // Collision detection.
+    collision_phase = 0;
     kdtree_search ();
   }
 
+  PHASE_SCOPE (phase_advance_linear);
   advance_linear (x, v, count);
 }
 
-void model_t::draw_next ()
+// Advance the simulation, including the angular position, and the animation
+// by one frame.
+void model_t::advance ()
 {
-  // Advance the simulation including the angular position.
   nodraw_next ();
-  advance_angular (u, w, count);
+  ++ stats.frames;
+  {
+    PHASE_SCOPE (phase_advance_angular);
+    advance_angular (u, w, count);
+  }
 
   // Advance the animation by one frame.
   const float dt = animation_speed_constant * usr::frame_time;
 
-  for (unsigned n = 0; n != count; ++ n) {
-    object_t & A = objects [n];
-    float t = A.animation_time + dt;
-    if (t >= usr::cycle_duration) {
-      t -= usr::cycle_duration;
-      // We must perform a Markov transition.
-      transition (rng, u [n], A.target, A.starting_point);
-      recalculate_locus (n);
+  {
+    PHASE_SCOPE (phase_animate);
+    // Collect the objects whose animation cycle ends this frame, and perform
+    // their Markov transitions together (or one at a time, should the arena
+    // be exhausted).
+    unsigned * wrapped = frame_arena.allocate_array <unsigned> (count);
+    unsigned wrapped_count = 0;
+    for (unsigned n = 0; n != count; ++ n) {
+      object_t & A = objects [n];
+      float t = A.animation_time + dt;
+      if (t >= usr::cycle_duration) {
+        t -= usr::cycle_duration;
+        if (wrapped) wrapped [wrapped_count ++] = n;
+        else markov.transition (rng, & n, 1, objects, u, e);
+        ++ stats.transitions;
+      }
+      A.animation_time = t;
+    }
+    if (wrapped) markov.transition (rng, wrapped, wrapped_count, objects, u, e);
 #if PRINT_ENABLED
+    for (unsigned k = 0; k != wrapped_count; ++ k) {
+      object_t & A = objects [wrapped [k]];
+      float df = markov.cosine [A.target.system] [A.starting_point]
+        [A.target.point];
+      if (stats.min_d > df) stats.min_d = df;
+      if (stats.max_d < df) stats.max_d = df;
       int wenninger_num = polyhedra [(int) A.target.system] [A.target.point];
-      ++ polyhedron_counts [wenninger_num - 1];
-#endif
+      ++ stats.polyhedron_counts [wenninger_num - 1];
     }
-    A.animation_time = t;
+#endif
+    if (fading) update_fades ();
   }
+}
+
+void model_t::draw_next (unsigned steps)
+{
+  TRACE_SCOPE ("draw_next");
+#if SPIKE_DETECTOR_ENABLED
+  // From before the settings changes, whose reallocations and re-placement
+  // are among the stalls to catch.
+  std::uint64_t frame_begin = qpc ();
+#endif
+  apply_commands ();
+  for (unsigned n = 0; n != steps; ++ n) advance ();
 
   if (count) {
     // Restore the z-order which we have just perturbed.
     // Insertion sort is an adaptive sort algorithm.
+    PHASE_SCOPE (phase_sort);
     insertion_sort (object_order, x, 2, 0, count);
   }
 
+  render ();
+
+  PERF_END_FRAME (count);
+  COLLISION_STATS_END_FRAME (count);
+  PHASE_TIMES_END_FRAME ();
+  MEMORY_STATS_END_FRAME ();
+#if SPIKE_DETECTOR_ENABLED
+  if (spike_detect (qpc () - frame_begin)) capture_spike ();
+#endif
+}
+
+// Clear the window and draw the objects in the order object_order.
+void model_t::render ()
+{
+  if (! graphics) return;
   clear ();
 
+  // Fill the uniform blocks of all the objects, in reverse depth order.
+#ifndef TINY
+  unsigned threads = workers.count () + 1;
+  unsigned most = count / usr::fill_min_objects_per_thread;
+  if (threads > most) threads = most;
+  if (threads > 1) {
+    // The phase times are the calling thread's, so they cover its share and
+    // the wait for the others.
+    workers.begin (& model_t::stage_part, this, threads);
+    stage (0, count / threads);
+    PHASE_SCOPE (phase_fill);
+    workers.wait ();
+  }
+  else
+#endif
+  stage (0, count);
+
   // Draw all the shapes, one uniform buffer at a time, in reverse depth order.
   unsigned buffer_count = (unsigned) program.uniform_buffer.count ();
   unsigned begin = 0, end = buffer_count;
@@ -446,42 +1161,206 @@ void model_t::draw_next ()
   draw (begin, count - begin);
 }
 
-void model_t::draw (unsigned begin, unsigned count)
+#if RECORDING_ENABLED
+recording_header_t model_t::recording_header (int width, int height,
+  int max_width, int max_height) const
 {
-  uniform_buffer_t & uniform_buffer = program.uniform_buffer;
+  recording_header_t h = { };
+  h.width = width;
+  h.height = height;
+  h.keyframe_interval = usr::recording_keyframe_interval;
+  // Positions, over the tanks of this window, the largest and the smallest
+  // (and so of any size between, as the tank gets wider and deeper, and
+  // further away, with the window), with a margin of the largest radius;
+  // so the recording can follow the window as it is resized, and the
+  // radius setting as it changes (see model_t::resize and apply_settings).
+  if (max_width < width) max_width = width;
+  if (max_height < height) max_height = height;
+  const int sizes [3] [2] = {
+    { width, height }, { max_width, max_height }, { 1, 1 },
+  };
+  float lo [3], hi [3];
+  for (unsigned j = 0; j != 3; ++ j) {
+    float x1, y1, z1, z2;
+    get_frustum (sizes [j] [0], sizes [j] [1], x1, y1, z1, z2);
+    float r = usr::max_radius;
+    float x = x1 * (z2 / z1) + r, y = y1 * (z2 / z1) + r;
+    float z0 = z2 - r, z = z1 + r;
+    if (! j || hi [0] < x) hi [0] = x;
+    if (! j || hi [1] < y) hi [1] = y;
+    if (! j || lo [2] > z0) lo [2] = z0;
+    if (! j || hi [2] < z) hi [2] = z;
+  }
+  lo [0] = - hi [0];
+  lo [1] = - hi [1];
+  for (unsigned k = 0; k != 3; ++ k) {
+    h.lo [plane_x0 + k] = lo [k];
+    h.step [plane_x0 + k] = (hi [k] - lo [k]) / 65535.0f;
+    // Rotation vectors have length at most a little over pi.
+    h.lo [plane_u0 + k] = -3.5f;
+    h.step [plane_u0 + k] = 7.0f / 65535.0f;
+  }
+  h.lo [plane_hue] = 0.0f;
+  h.step [plane_hue] = 6.0f / 65535.0f;
+  h.lo [plane_time] = 0.0f;
+  h.step [plane_time] = 2.0f * usr::cycle_duration / 65535.0f;
+  h.lo [plane_r] = 0.0f;
+  h.step [plane_r] = usr::max_radius / 65535.0f;
+  h.lo [plane_state] = 0.0f;
+  h.step [plane_state] = 1.0f;
+  return h;
+}
 
-  // Set the modelview matrix, m.
-  compute (reinterpret_cast <char *> (& uniform_buffer [0].m),
-    uniform_buffer.stride (), x, u, & (object_order [begin]), count);
+bool model_t::record (recorder_t & recorder) const
+{
+  return recorder.capture (count, x, u, objects);
+}
 
-  const v4f alpha = { 0.0f, 0.0f, 0.0f, usr::alpha };
+// Draw the player's next frame: no physics, and no animation beyond
+// recalculating the locus of any object whose Markov state has changed.
+bool model_t::replay (player_t & player)
+{
+  TRACE_SCOPE ("replay");
+  if (! player.next ()) return false;
+  unsigned n = player.count;
+  if (n > capacity && ! set_capacity (n)) return false;
+  bool reset = player.keyframe;
+  if (n != count) {
+    // Start both permutations afresh (a resize during the replay crops
+    // through them, see remove_objects).
+    for (unsigned k = 0; k != n; ++ k) {
+      object_order [k] = k;
+      kdtree_index [k] = k;
+    }
+  }
+  count = n;
+  fading = 0;
+  fading_out = 0;
+  for (unsigned k = 0; k != n; ++ k) {
+    v4f t = {
+      player.value (plane_x0, k), player.value (plane_x1, k),
+      player.value (plane_x2, k), 0.0f,
+    };
+    v4f r = {
+      player.value (plane_u0, k), player.value (plane_u1, k),
+      player.value (plane_u2, k), 0.0f,
+    };
+    store4f (x [k], t);
+    store4f (u [k], r);
+    object_t & A = objects [k];
+    A.hue = player.value (plane_hue, k);
+    A.animation_time = player.value (plane_time, k);
+    A.r = player.value (plane_r, k);
+    unsigned state = player.state (k);
+    if (reset || state != pack_state (A)) {
+      unsigned system = state >> 6;
+      A.target.system = (system_select_t) (system < system_count ? system : 0);
+      A.starting_point = state >> 3 & 7;
+      A.target.point = state & 7;
+      recalculate_locus (k);
+    }
+  }
+  if (count) insertion_sort (object_order, x, 2, 0, count);
+  render ();
+  return true;
+}
+#endif
+
+#if PUBLISH_ENABLED
+static_assert (offsetof (published_object_t, d) == offsetof (object_data_t, d)
+  && offsetof (published_object_t, g) == offsetof (object_data_t, g)
+  && offsetof (published_object_t, m) == offsetof (object_data_t, m)
+  && offsetof (published_object_t, s) == offsetof (object_data_t, s),
+  "published_object_t must begin with an object_data_t");
+
+// Fill the publisher's next slot with the same kernels that fill the
+// uniform blocks, in object index order.
+bool model_t::publish (publisher_t & publisher) const
+{
+  TRACE_SCOPE ("publish");
+  unsigned n;
+  published_object_t * p = publisher.begin_frame (count, n);
+  char * base = reinterpret_cast <char *> (p);
+  const std::size_t stride = sizeof (published_object_t);
+  compute (base + offsetof (published_object_t, m), stride, x, u,
+    publisher.order (), n);
+  fill_blocks (base, stride, publisher.order (), n, objects, e, abc, bumps,
+    step, usr::alpha);
+  for (unsigned k = 0; k != n; ++ k) {
+    store4f (p [k].x, load4f (x [k]));
+    store4f (p [k].u, load4f (u [k]));
+  }
+  publisher.end_frame ();
+  return n == count;
+}
+#endif
+
+#if SPIKE_DETECTOR_ENABLED
+void model_t::capture_spike ()
+{
+  std::FILE * file = spike_begin_bundle (count);
+  if (! file) return;
+  // Per object: position, velocity, angular velocity, animation time, target
+  // system and point.
+  std::fprintf (file, "\"state\":{\"radius\":%.9g,\"objects\":[", radius);
   for (unsigned n = 0; n != count; ++ n) {
-    unsigned m = object_order [begin + n];
-    const object_t & obj = objects [m];
-    object_data_t & block = uniform_buffer [n];
+    const object_t & A = objects [n];
+    std::fprintf (file, "%s\n[%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+      "%.9g,%u,%u]", n ? "," : "", x [n] [0], x [n] [1], x [n] [2],
+      v [n] [0], v [n] [1], v [n] [2], w [n] [0], w [n] [1], w [n] [2],
+      A.animation_time, (unsigned) A.target.system, A.target.point);
+  }
+  std::fprintf (file, "]}\n");
+  spike_end_bundle (file);
+}
+#endif
 
-    // Snub?
-    block.s = (GLuint) (obj.starting_point == 7 || obj.target.point == 7);
+#ifndef TINY
+// Part "part" of "parts" of the fill stage, on a worker thread.
+void model_t::stage_part (void * context, unsigned part, unsigned parts)
+{
+  model_t & model = * static_cast <model_t *> (context);
+  unsigned begin = (unsigned) ((std::uint64_t) model.count * part / parts);
+  unsigned end = (unsigned) ((std::uint64_t) model.count * (part + 1) / parts);
+  model.stage (begin, end);
+}
+#endif
 
-    // Set the diffuse material reflectance, d.
-    v4f satval = bumps (obj.animation_time);
-    v4f sat = _mm_moveldup_ps (satval);
-    v4f val = _mm_movehdup_ps (satval);
-    _mm_stream_ps (block.d, hsv_to_rgb (obj.hue, sat, val, alpha));
+// Fill the uniform blocks of the objects object_order [begin, end).
+void model_t::stage (unsigned begin, unsigned end)
+{
+  TRACE_SCOPE ("stage");
+  uniform_buffer_t & uniform_buffer = program.uniform_buffer;
+  unsigned n = end - begin;
 
-    // Set the vertex coefficients g.
-    system_select_t system = obj.target.system;
-    v4f t = step (obj.animation_time) * _mm_set1_ps (obj.locus_length);
-    v4f sc = sincos (t);
-    v4f s = _mm_moveldup_ps (sc);
-    v4f c = _mm_movehdup_ps (sc);
-    v4f g0 = load4f (abc [system] [obj.starting_point]);
-    v4f g = c * g0 + s * load4f (e [m]);
-    _mm_stream_ps (block.g, _mm_set1_ps (obj.r) * g);
+  // Set the modelview matrix, m.
+  {
+    PHASE_SCOPE (phase_compute);
+    compute (reinterpret_cast <char *> (& uniform_buffer [begin].m),
+      uniform_buffer.stride (), x, u, & (object_order [begin]), n);
   }
 
-  uniform_buffer.update ();
+  // Set the diffuse material reflectance, d, the vertex coefficients g and
+  // the snub flag s (see fill.h).
+  PHASE_SCOPE (phase_fill);
+  fill_blocks (reinterpret_cast <char *> (& uniform_buffer [begin]),
+    uniform_buffer.stride (), & (object_order [begin]), n, objects, e, abc,
+    bumps, step, usr::alpha);
+}
+
+// Upload the blocks of the objects object_order [begin, begin + count), and
+// draw them.
+void model_t::draw (unsigned begin, unsigned count)
+{
+  TRACE_SCOPE ("draw");
+  uniform_buffer_t & uniform_buffer = program.uniform_buffer;
+
+  {
+    TRACE_SCOPE ("update");
+    uniform_buffer.update (begin);
+  }
 
+  TRACE_SCOPE ("paint");
   for (unsigned n = 0; n != count; ++ n) {
     unsigned m = object_order [begin + n];
     const object_t & obj = objects [m];
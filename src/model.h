@@ -18,28 +18,146 @@
 #define model_h
 
 #include "bump.h"
+#include "commands.h"
 #include "compiler.h"
 #include "graphics.h"
+#include "memory.h"
 #include "object.h"
 #include "random.h"
 #include "settings.h"
+#include "workers.h"
 #include <cstdint>
 
+struct player_t;
+struct publisher_t;
+struct recorder_t;
+struct recording_header_t;
+
+// An object's complete state, for moving objects between models (see
+// domain.h).
+struct object_state_t
+{
+  ALIGNED16 float x [4];
+  ALIGNED16 float v [4];
+  ALIGNED16 float u [4];
+  ALIGNED16 float w [4];
+  ALIGNED16 float e [4];
+  object_t object;
+};
+
+// Counts kept by each model (see model_t::statistics).
+struct model_statistics_t
+{
+  std::uint64_t frames;       // Frames advanced.
+  std::uint64_t transitions;  // Markov transitions (morphs begun).
+  // With ENABLE_PRINT only: the polyhedra morphed to, by Wenninger number
+  // (less one), and the range of the arccos argument in the loci.
+  std::uint64_t polyhedron_counts [18];
+  float min_d, max_d;
+};
+
+// A model holds no global state, so several can run at once, one per
+// thread (see ensemble.h). Call initialize, then (unless the model is to
+// run headless) initialize_graphics, then start.
+
 struct model_t
 {
   ~model_t ();
 
-  int initialize (std::uint64_t seed);
-  bool start (int width, int height, const settings_t & settings);
-  void draw_next ();
+  // Set up the simulation (no graphics calls).
+  void initialize (std::uint64_t seed);
+  // Compile the shader program and make the vertex arrays and the uniform
+  // buffer. Returns false on failure. A model without graphics simulates,
+  // but draw_next does not draw.
+  bool initialize_graphics ();
+  // If "checkpoint" names a file, resume the population saved there if
+  // possible, otherwise save the new population there (see checkpoint.h).
+  // A resumed model keeps its own random stream and varies the saved
+  // colours and morph phases, unless "exact", when it takes the saved
+  // random state and continues exactly as the saved model did.
+  bool start (int width, int height, const settings_t & settings,
+    const char * checkpoint = nullptr, bool exact = false);
+  // Fit the running simulation to a new window size without restarting
+  // it (costs less than a frame). Returns false if the model has not been
+  // started or memory is short (then call start instead).
+  bool resize (int width, int height);
+  // Advance by "steps" frames (see scheduler.h) and draw the last.
+  void draw_next (unsigned steps = 1);
+
+  // Change the population between frames, without restarting.
+  unsigned object_count () const { return count; }
+  unsigned maximum_count () const { return max_count; }
+  bool add_objects (unsigned n);
+  void remove_object (unsigned index);
+  bool set_count (unsigned new_count);
+
+  // Change the population gradually, by fading objects in or out.
+  unsigned active_count () const { return count - fading_out; }
+  bool fade_to_count (unsigned new_count);
+
+  // Change a setting (trackbar "index", see settings.h) without restarting:
+  // post_setting posts the change, from any thread, and the next draw_next
+  // applies the latest position posted (see commands.h); it returns false
+  // only if "index" is out of range. apply_settings applies a whole set of
+  // settings now, between frames.
+  bool post_setting (unsigned index, DWORD pos);
+  bool apply_settings (const settings_t & settings);
+  const settings_t & settings () const { return current_settings; }
+  // Changes so far to the count or radius setting (which set the count),
+  // whether applied directly or posted; see governor_t::update.
+  unsigned settings_generation () const { return generation; }
+
+  // Detect collisions only every "interval" frames.
+  void set_collision_interval (unsigned interval);
+  unsigned get_collision_interval () const { return collision_interval; }
+
+  // Record the frame just drawn, or draw the player's next frame instead of
+  // simulating one (see recording.h). The recording header is for a window
+  // of width by height that may be resized up to max_width by max_height.
+  recording_header_t recording_header (int width, int height,
+    int max_width = 0, int max_height = 0) const;
+  bool record (recorder_t & recorder) const;
+  bool replay (player_t & player);
+
+  // Publish the frame just drawn to other processes (see publish.h).
+  bool publish (publisher_t & publisher) const;
+
+  const model_statistics_t & statistics () const { return stats; }
 private:
+  friend struct model_access_t; // For the programs in bench.
+  friend struct domain_t;
   void nodraw_next ();
-  void set_capacity (std::size_t new_capacity);
+  void advance ();
+  void render ();
+  void set_tank (int width, int height);
+  unsigned get_count (DWORD pos) const;
+  void set_animation_speed (DWORD s);
+  void apply_commands ();
+  bool set_capacity (std::size_t new_capacity);
+  void spawn (unsigned n, float hue, float animation_time, float speed,
+    float spin, float fade, bool placed = false);
+  void update_fades ();
+  bool resume (const char * checkpoint, int width, int height,
+    const settings_t & settings, unsigned new_count, bool exact);
+  void save (const char * checkpoint, int width, int height,
+    const settings_t & settings) const;
+  void rename_permutations (const unsigned * rename, unsigned kept);
+  void export_object (unsigned index, object_state_t & state) const;
+  bool import_objects (const object_state_t * states, unsigned n);
+  void remove_objects (const std::uint8_t * remove);
   void recalculate_locus (unsigned index);
+  void stage (unsigned begin, unsigned end);
+#ifndef TINY
+  static void stage_part (void * context, unsigned part, unsigned parts);
+#endif
   void draw (unsigned begin, unsigned count);
   void bounce (unsigned ix, unsigned iy);
   void wall_bounce (unsigned iw, unsigned iy);
   void kdtree_search ();
+  void kdtree_build (unsigned depth);
+  void kdtree_bounce_objects (unsigned depth);
+  void kdtree_bounce_walls (unsigned depth);
+  void capture_spike ();
 
   void * memory;
   object_t * objects;
@@ -58,20 +176,36 @@ private:
   float animation_speed_constant;
 
   std::size_t capacity;
-  std::size_t kdtree_capacity;
+  unsigned max_count;   // For the tank and radius (count setting 100).
   unsigned count;
+  unsigned fading;      // Objects fading in or out.
+  unsigned fading_out;  // Objects fading out.
+  unsigned collision_interval;
+  unsigned collision_phase;
   unsigned primitive_count [system_count]; // = { 12, 24, 60 }
   std::uint32_t vao_ids [system_count];
+  bool graphics;        // initialize_graphics succeeded.
+  int tank_width, tank_height;
+  settings_t current_settings;
+  setting_slots_t commands;
+  unsigned generation;
 
   ALIGNED16 float walls [6] [2] [4];
+  ALIGNED16 float spawn_box [2] [4]; // Centre and half-size.
   ALIGNED16 float abc [system_count] [8] [4];
   ALIGNED16 float xyz [system_count] [3] [4];
   ALIGNED16 float xyzinv [system_count] [3] [4];
+  ALIGNED16 markov_t markov;
   ALIGNED16 bumps_t bumps;
   ALIGNED16 step_t step;
 
   program_t program;
   rng_t rng;
+  arena_t frame_arena;
+  model_statistics_t stats;
+#ifndef TINY
+  workers_t workers;    // For the fill stage (see render).
+#endif
 };
 
 #endif
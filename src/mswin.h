@@ -17,6 +17,8 @@
 #ifndef mswin_h
 #define mswin_h
 
+#ifdef _WIN32
+
 #ifdef UNICODE
 #define _UNICODE
 #endif
@@ -71,4 +73,13 @@
 
 #include <commctrl.h>
 
+#else
+
+// Enough for the simulation core to build on other platforms (see the host
+// section of the Makefile).
+#include <cstdint>
+typedef std::uint32_t DWORD;
+
+#endif
+
 #endif
@@ -25,6 +25,7 @@ struct object_t
   float hue;
   float animation_time;
   float locus_length;
+  float fade;           // Size in [0, 1] (see model_t::update_fades).
   unsigned starting_point;
   polyhedron_select_t target;
 };
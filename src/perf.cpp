@@ -0,0 +1,224 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "perf.h"
+
+#if PERF_COUNTERS_ENABLED
+
+#include "phase.h"
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+  const struct perf_counter_definition_t
+  {
+    const char * name;
+    std::uint32_t type;
+    std::uint64_t config;
+  } perf_counter_definitions [perf_counter_count] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1D misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+    { "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+
+  enum { cycles, instructions };
+
+  struct perf_state_t
+  {
+    bool initialized;
+    int leader;                     // Group leader, or -1 if none opened.
+    int slot [perf_counter_count];  // Index in the group read, or -1.
+    int fd [perf_counter_count];    // Or -1.
+    std::FILE * csv;
+    std::uint64_t frames;
+    std::uint64_t objects;
+    std::uint64_t frame [phase_count] [perf_counter_count];
+    std::uint64_t total [phase_count] [perf_counter_count];
+
+    // Close the counters when the thread exits.
+    ~perf_state_t ()
+    {
+      if (! initialized) return;
+      for (unsigned k = 0; k != perf_counter_count; ++ k) {
+        if (fd [k] != -1) ::close (fd [k]);
+      }
+    }
+  };
+
+  thread_local perf_state_t perf_state;
+
+  void open_counters (perf_state_t & state)
+  {
+    state.initialized = true;
+    state.leader = -1;
+    unsigned open_count = 0;
+    for (unsigned k = 0; k != perf_counter_count; ++ k) {
+      perf_event_attr attr;
+      std::memset (& attr, 0, sizeof attr);
+      attr.size = sizeof attr;
+      attr.type = perf_counter_definitions [k].type;
+      attr.config = perf_counter_definitions [k].config;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.disabled = state.leader == -1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      // This thread, any CPU.
+      int fd = (int) ::syscall (__NR_perf_event_open, & attr, 0, -1,
+        state.leader, 0);
+      state.fd [k] = fd;
+      state.slot [k] = fd == -1 ? -1 : (int) open_count ++;
+      if (fd != -1 && state.leader == -1) state.leader = fd;
+    }
+    if (state.leader != -1) {
+      ::ioctl (state.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+  }
+
+  void read_counters (perf_state_t & state,
+    std::uint64_t (& values) [perf_counter_count])
+  {
+    // Layout for PERF_FORMAT_GROUP: nr, then nr values in order of opening.
+    std::uint64_t data [1 + perf_counter_count] = { 0 };
+    if (state.leader != -1) {
+      if (::read (state.leader, data, sizeof data) <= 0) data [0] = 0;
+    }
+    for (unsigned k = 0; k != perf_counter_count; ++ k) {
+      int slot = state.slot [k];
+      values [k] = slot != -1 && (unsigned) slot < data [0]
+        ? data [1 + slot]
+        : 0;
+    }
+  }
+
+  void print_row (std::FILE * file, const char * name,
+    const perf_state_t & state,
+    const std::uint64_t (& sum) [perf_counter_count], double divisor)
+  {
+    std::fprintf (file, "%-16s", name);
+    for (unsigned k = 0; k != perf_counter_count; ++ k) {
+      if (state.slot [k] == -1) std::fprintf (file, " %14s", "n/a");
+      else std::fprintf (file, " %14.1f", sum [k] / divisor);
+    }
+    if (state.slot [cycles] != -1 && state.slot [instructions] != -1
+        && sum [cycles]) {
+      double ipc = double (sum [instructions]) / sum [cycles];
+      std::fprintf (file, " %6.2f\n", ipc);
+    }
+    else {
+      std::fprintf (file, " %6s\n", "n/a");
+    }
+  }
+
+  void print_table (std::FILE * file, const char * title,
+    const perf_state_t & state, double divisor)
+  {
+    std::fprintf (file, "\n%-16s", title);
+    for (const auto & definition : perf_counter_definitions) {
+      std::fprintf (file, " %14s", definition.name);
+    }
+    std::fprintf (file, " %6s\n", "IPC");
+    std::uint64_t all [perf_counter_count] = { 0 };
+    for (unsigned p = 0; p != phase_count; ++ p) {
+      print_row (file, phase_names [p], state, state.total [p], divisor);
+      for (unsigned k = 0; k != perf_counter_count; ++ k) {
+        all [k] += state.total [p] [k];
+      }
+    }
+    print_row (file, "total", state, all, divisor);
+  }
+}
+
+perf_scope_t::perf_scope_t (phase_t phase)
+  : phase (phase)
+{
+  perf_state_t & state = perf_state;
+  if (! state.initialized) open_counters (state);
+  read_counters (state, begin);
+}
+
+perf_scope_t::~perf_scope_t ()
+{
+  perf_state_t & state = perf_state;
+  std::uint64_t end [perf_counter_count];
+  read_counters (state, end);
+  for (unsigned k = 0; k != perf_counter_count; ++ k) {
+    state.frame [phase] [k] += end [k] - begin [k];
+  }
+}
+
+void perf_csv (std::FILE * file)
+{
+  perf_state.csv = file;
+  if (file) {
+    std::fprintf (file, "frame,phase,objects");
+    for (const auto & definition : perf_counter_definitions) {
+      std::fprintf (file, ",%s", definition.name);
+    }
+    std::fprintf (file, "\n");
+  }
+}
+
+void perf_end_frame (unsigned object_count)
+{
+  perf_state_t & state = perf_state;
+  for (unsigned p = 0; p != phase_count; ++ p) {
+    if (state.csv) {
+      std::fprintf (state.csv, "%llu,%s,%u",
+        (unsigned long long) state.frames, phase_names [p], object_count);
+      for (unsigned k = 0; k != perf_counter_count; ++ k) {
+        std::fprintf (state.csv, ",%llu",
+          (unsigned long long) state.frame [p] [k]);
+      }
+      std::fprintf (state.csv, "\n");
+    }
+    for (unsigned k = 0; k != perf_counter_count; ++ k) {
+      state.total [p] [k] += state.frame [p] [k];
+      state.frame [p] [k] = 0;
+    }
+  }
+  ++ state.frames;
+  state.objects += object_count;
+}
+
+void perf_discard_frame ()
+{
+  std::memset (perf_state.frame, 0, sizeof perf_state.frame);
+}
+
+void perf_report (std::FILE * file)
+{
+  const perf_state_t & state = perf_state;
+  if (! state.frames) return;
+  if (state.leader == -1) {
+    std::fprintf (file, "Hardware performance counters unavailable.\n");
+    return;
+  }
+  std::fprintf (file, "Hardware performance counters, %llu frames, "
+    "%.1f objects per frame.\n", (unsigned long long) state.frames,
+    double (state.objects) / state.frames);
+  print_table (file, "per frame", state, double (state.frames));
+  if (state.objects) {
+    print_table (file, "per object", state, double (state.objects));
+  }
+}
+
+#endif
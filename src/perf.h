@@ -0,0 +1,84 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef perf_h
+#define perf_h
+
+//#define ENABLE_PERF_COUNTERS
+
+#if defined (ENABLE_PERF_COUNTERS) && defined (__linux__)
+#define PERF_COUNTERS_ENABLED 1
+#else
+#define PERF_COUNTERS_ENABLED 0
+#endif
+
+// Hardware performance counters per phase (Linux only; see phase.h).
+
+// The first time a thread enters a phase it opens a group of counters on
+// itself with perf_event_open: cycles, instructions, L1 data cache read
+// misses, last-level cache misses and branch misses. Entering and leaving a
+// phase each read the whole group (one system call) and the difference is
+// added to the current frame's count for that phase. perf_end_frame folds the
+// frame into the running totals (and writes it as CSV, see perf_csv), and
+// perf_report prints the totals per frame and per object.
+
+// Counters the kernel refuses (under a restrictive perf_event_paranoid, or in
+// a virtual machine without a virtual PMU) are reported as unavailable.
+
+// All state is per thread.
+
+#include <cstdio>
+
+enum phase_t : unsigned;
+
+#if PERF_COUNTERS_ENABLED
+#include <cstdint>
+
+const unsigned perf_counter_count = 5;
+
+struct perf_scope_t
+{
+  perf_scope_t (phase_t phase);
+  ~perf_scope_t ();
+private:
+  phase_t phase;
+  std::uint64_t begin [perf_counter_count];
+  perf_scope_t (const perf_scope_t &) = delete;
+  perf_scope_t & operator = (const perf_scope_t &) = delete;
+};
+
+void perf_csv (std::FILE * file);
+void perf_end_frame (unsigned object_count);
+void perf_discard_frame ();
+void perf_report (std::FILE * file);
+
+#define PERF_CONCAT0(a, b) a ## b
+#define PERF_CONCAT(a, b) PERF_CONCAT0 (a, b)
+#define PERF_SCOPE(phase) \
+  perf_scope_t PERF_CONCAT (perf_scope_, __LINE__) (phase)
+#define PERF_CSV(file) perf_csv (file)
+#define PERF_END_FRAME(object_count) perf_end_frame (object_count)
+#define PERF_DISCARD_FRAME() perf_discard_frame ()
+#define PERF_REPORT(file) perf_report (file)
+#else
+#define PERF_SCOPE(phase)
+#define PERF_CSV(file)
+#define PERF_END_FRAME(object_count)
+#define PERF_DISCARD_FRAME()
+#define PERF_REPORT(file)
+#endif
+
+#endif
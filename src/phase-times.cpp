@@ -0,0 +1,44 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "phase-times.h"
+
+#if PHASE_TIMES_ENABLED
+
+#include <cstring>
+
+thread_local phase_times_t phase_times_frame;
+
+namespace
+{
+  thread_local phase_times_t phase_times_last;
+}
+
+void phase_times_end_frame ()
+{
+  phase_times_last = phase_times_frame;
+  phase_times_discard_frame ();
+}
+
+void phase_times_discard_frame ()
+{
+  std::memset (& phase_times_frame, 0, sizeof phase_times_frame);
+}
+
+const phase_times_t & phase_times_last_frame ()
+{
+  return phase_times_last;
+}
+
+#endif
@@ -0,0 +1,79 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef phase_times_h
+#define phase_times_h
+
+//#define ENABLE_PHASE_TIMES
+
+// The spike detector (spike.h) and telemetry (telemetry.h) report phase
+// times.
+#if (defined (ENABLE_PHASE_TIMES) || defined (ENABLE_SPIKE_DETECTOR) \
+  || defined (ENABLE_TELEMETRY)) && ! defined (TINY)
+#define PHASE_TIMES_ENABLED 1
+#else
+#define PHASE_TIMES_ENABLED 0
+#endif
+
+// Wall-clock time per phase (see phase.h), in qpc ticks.
+
+// PHASE_TIMER (phase) adds the time spent in the rest of the enclosing block
+// to the current frame's time for the phase. phase_times_end_frame keeps the
+// frame's times (see phase_times_last_frame) and starts a new frame.
+
+// All state is per thread. When disabled the macros expand to nothing.
+
+#include "phase.h"
+
+#if PHASE_TIMES_ENABLED
+#include "qpc.h"
+#include <cstdint>
+
+struct phase_times_t
+{
+  std::uint64_t ticks [phase_count];
+};
+
+extern thread_local phase_times_t phase_times_frame;
+
+struct phase_timer_t
+{
+  phase_timer_t (phase_t phase) : phase (phase), begin (qpc ()) { }
+  ~phase_timer_t () { phase_times_frame.ticks [phase] += qpc () - begin; }
+private:
+  phase_t phase;
+  std::uint64_t begin;
+  phase_timer_t (const phase_timer_t &) = delete;
+  phase_timer_t & operator = (const phase_timer_t &) = delete;
+};
+
+void phase_times_end_frame ();
+void phase_times_discard_frame ();
+const phase_times_t & phase_times_last_frame ();
+
+#define PHASE_TIMES_CONCAT0(a, b) a ## b
+#define PHASE_TIMES_CONCAT(a, b) PHASE_TIMES_CONCAT0 (a, b)
+#define PHASE_TIMER(phase) \
+  phase_timer_t PHASE_TIMES_CONCAT (phase_timer_, __LINE__) (phase)
+#define PHASE_TIMES_END_FRAME() phase_times_end_frame ()
+#define PHASE_TIMES_DISCARD_FRAME() phase_times_discard_frame ()
+#else
+#define PHASE_TIMER(phase)
+#define PHASE_TIMES_END_FRAME()
+#define PHASE_TIMES_DISCARD_FRAME()
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef phase_h
+#define phase_h
+
+// The hot phases of a frame. PHASE_SCOPE (phase) marks the rest of the
+// enclosing block as belonging to the phase, for each instrumentation backend
+// that is enabled (see trace.h, perf.h and phase-times.h); with none enabled
+// it expands to nothing. Phases do not nest.
+
+enum phase_t : unsigned
+{
+  phase_kdtree_build,     // kd-tree construction (partition)
+  phase_kdtree_objects,   // kd-tree traversal and bounce
+  phase_kdtree_walls,     // kd-tree traversal and wall_bounce
+  phase_advance_linear,
+  phase_advance_angular,
+  phase_animate,          // animation clock and Markov transitions
+  phase_sort,             // depth sort
+  phase_compute,          // modelview matrices
+  phase_fill,             // per-object uniform data
+  phase_count
+};
+
+const char * const phase_names [phase_count] = {
+  "kdtree_build",
+  "kdtree_objects",
+  "kdtree_walls",
+  "advance_linear",
+  "advance_angular",
+  "animate",
+  "sort",
+  "compute",
+  "fill",
+};
+
+#include "perf.h"
+#include "phase-times.h"
+#include "trace.h"
+
+#define PHASE_SCOPE(phase) \
+  TRACE_SCOPE (phase_names [phase]); PERF_SCOPE (phase); PHASE_TIMER (phase)
+
+#endif
@@ -0,0 +1,332 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "placement.h"
+#include "memory.h"
+#include "random-util.h"
+#include "trace.h"
+#include "vector.h"
+
+#ifndef TINY
+#include "workers.h"
+#include <thread>
+#endif
+
+namespace usr
+{
+  // Each sweep moves an object by this fraction of half its overlap with
+  // each neighbour (less than one, to damp the oscillation of a crowd).
+  const float relax_factor = 0.8f;
+
+  // Threads for the sweeps: at most this many, and enough objects for each.
+  const unsigned relax_max_threads = 8;
+  const unsigned relax_min_objects_per_thread = 2048;
+}
+
+namespace
+{
+  // Cube root of a positive number, by Newton's method.
+  float cube_root (float v)
+  {
+    float y = v > 1.0f ? v : 1.0f;
+    for (unsigned k = 0; k != 64; ++ k) {
+      y = (2.0f * y + v / (y * y)) * (1.0f / 3.0f);
+    }
+    return y;
+  }
+
+  // At least "radius" inside the side walls?
+  bool inside (v4f p, const float (& walls) [6] [2] [4], float radius)
+  {
+    for (unsigned k = 2; k != 6; ++ k) {
+      v4f anchor = load4f (walls [k] [0]);
+      v4f normal = load4f (walls [k] [1]);
+      if (_mm_cvtss_f32 (dot (p - anchor, normal)) < radius) return false;
+    }
+    return true;
+  }
+
+  // Uniformly distributed on [0, n).
+  unsigned get_index (rng_t & rng, unsigned n)
+  {
+    return (unsigned) (((rng.get () >> 32) * n) >> 32);
+  }
+
+  struct grid_t
+  {
+    v4f lo, scale;
+    unsigned n [3];
+
+    unsigned coordinate (v4f p, unsigned k) const
+    {
+      ALIGNED16 float f [4];
+      store4f (f, (p - lo) * scale);
+      if (f [k] < 0.0f) return 0;
+      unsigned i = truncate (f [k]);
+      return i < n [k] ? i : n [k] - 1;
+    }
+  };
+
+#ifndef TINY
+  // A sweep's displacements, as a job for the workers.
+  struct displace_job_t
+  {
+    const float (* x) [4];
+    float (* d) [4];
+    unsigned count;
+    const grid_t * grid;
+    const unsigned * start;
+    const unsigned * sorted;
+    float diameter;
+  };
+#endif
+
+  // Displacements of objects begin to end, away from their neighbours.
+  void displace (const float (* x) [4], float (* d) [4], unsigned begin,
+    unsigned end, const grid_t & grid, const unsigned * start,
+    const unsigned * sorted, float diameter)
+  {
+    v4f dsq = _mm_set1_ps (diameter * diameter);
+    v4f half = _mm_set1_ps (0.5f * usr::relax_factor);
+    v4f zero = _mm_setzero_ps ();
+    for (unsigned i = begin; i != end; ++ i) {
+      v4f p = load4f (x [i]);
+      v4f push = zero;
+      unsigned c [3];
+      for (unsigned k = 0; k != 3; ++ k) c [k] = grid.coordinate (p, k);
+      unsigned z0 = c [2] ? c [2] - 1 : 0, z1 = c [2] + 2;
+      unsigned y0 = c [1] ? c [1] - 1 : 0, y1 = c [1] + 2;
+      unsigned x0 = c [0] ? c [0] - 1 : 0, x1 = c [0] + 2;
+      if (z1 > grid.n [2]) z1 = grid.n [2];
+      if (y1 > grid.n [1]) y1 = grid.n [1];
+      if (x1 > grid.n [0]) x1 = grid.n [0];
+      for (unsigned iz = z0; iz != z1; ++ iz) {
+        for (unsigned iy = y0; iy != y1; ++ iy) {
+          unsigned row = (iz * grid.n [1] + iy) * grid.n [0];
+          // The cells of a row are contiguous in "sorted".
+          for (unsigned k = start [row + x0]; k != start [row + x1]; ++ k) {
+            unsigned j = sorted [k];
+            v4f dx = p - load4f (x [j]);
+            v4f rsq = dot (dx, dx);
+            if (_mm_comilt_ss (rsq, dsq) && _mm_comigt_ss (rsq, zero)) {
+              v4f r = sqrt_nonzero (rsq);
+              v4f overlap = _mm_set1_ps (diameter) - r;
+              push += dx * (half * overlap / r);
+            }
+          }
+        }
+      }
+      store4f (d [i], push);
+    }
+  }
+}
+
+bool place_objects (rng_t & rng, float (* x) [4], unsigned count,
+  const float (& box) [2] [4], const float (& walls) [6] [2] [4],
+  float radius)
+{
+  TRACE_SCOPE ("place objects");
+  if (! count) return true;
+  v4f c = load4f (box [0]);
+  v4f m = load4f (box [1]);
+  const float * half = box [1];
+  if (! (half [0] > 0.0f && half [1] > 0.0f && half [2] > 0.0f)) return false;
+
+  // Find the coarsest grid with enough cells inside the tank.
+  float h = cube_root (8.0f * half [0] * half [1] * half [2] / ui2f (count));
+  unsigned n [3], valid = 0;
+  v4f lo = c - m, size, centre0;
+  for (;;) {
+    for (unsigned k = 0; k != 3; ++ k) {
+      n [k] = truncate (2.0f * half [k] / h);
+      if (! n [k]) n [k] = 1;
+    }
+    // Give up (the caller places the objects one at a time) if the tank
+    // is too thin for a grid.
+    if (n [0] * n [1] * n [2] > 64 * count) return false;
+    v4f nf = { ui2f (n [0]), ui2f (n [1]), ui2f (n [2]), 1.0f };
+    size = (m + m) / nf;
+    centre0 = lo + _mm_set1_ps (0.5f) * size;
+    valid = 0;
+    for (unsigned iz = 0; iz != n [2]; ++ iz) {
+      for (unsigned iy = 0; iy != n [1]; ++ iy) {
+        for (unsigned ix = 0; ix != n [0]; ++ ix) {
+          v4f i = { ui2f (ix), ui2f (iy), ui2f (iz), 0.0f };
+          valid += inside (centre0 + i * size, walls, radius);
+        }
+      }
+    }
+    if (valid >= count) break;
+    h *= 0.97f;
+  }
+
+  unsigned * cells = static_cast <unsigned *>
+    (pool_allocate (valid * sizeof (unsigned)));
+  if (! cells) return false;
+  unsigned k = 0;
+  for (unsigned iz = 0; iz != n [2]; ++ iz) {
+    for (unsigned iy = 0; iy != n [1]; ++ iy) {
+      for (unsigned ix = 0; ix != n [0]; ++ ix) {
+        v4f i = { ui2f (ix), ui2f (iy), ui2f (iz), 0.0f };
+        if (inside (centre0 + i * size, walls, radius)) {
+          cells [k ++] = (iz * n [1] + iy) * n [0] + ix;
+        }
+      }
+    }
+  }
+
+  // Take "count" of the cells at random (a partial Fisher-Yates shuffle),
+  // and a random point in each (or its centre, if the point is too close to
+  // a wall). The points come from four streams of their own, a vector per
+  // call.
+  ALIGNED16 rng4_t rng4;
+  rng4.initialize (rng.get ());
+  v4f jitter = _mm_set1_ps (0.5f) * size;
+  for (unsigned i = 0; i != count; ++ i) {
+    unsigned j = i + get_index (rng, valid - i);
+    unsigned cell = cells [j];
+    cells [j] = cells [i];
+    unsigned ix = cell % n [0];
+    unsigned iy = cell / n [0] % n [1];
+    unsigned iz = cell / n [0] / n [1];
+    v4f index = { ui2f (ix), ui2f (iy), ui2f (iz), 0.0f };
+    v4f centre = centre0 + index * size;
+    v4f p = centre;
+    for (unsigned t = 0; t != 4; ++ t) {
+      v4f q = centre + jitter * get_vector_in_box (rng4);
+      if (inside (q, walls, radius)) {
+        p = q;
+        break;
+      }
+    }
+    store4f (x [i], p);
+  }
+  pool_deallocate (cells);
+  return true;
+}
+
+#ifndef TINY
+// Part "part" of "parts" of a sweep's displacements.
+static void displace_part (void * context, unsigned part, unsigned parts)
+{
+  const displace_job_t & job = * static_cast <displace_job_t *> (context);
+  unsigned begin = (unsigned) ((std::uint64_t) job.count * part / parts);
+  unsigned end = (unsigned) ((std::uint64_t) job.count * (part + 1) / parts);
+  displace (job.x, job.d, begin, end, * job.grid, job.start, job.sorted,
+    job.diameter);
+}
+#endif
+
+bool relax_overlaps (float (* x) [4], unsigned count,
+  const float (& box) [2] [4], const float (& walls) [6] [2] [4],
+  float radius, unsigned sweeps, workers_t * workers)
+{
+  TRACE_SCOPE ("relax overlaps");
+  if (count < 2) return true;
+  float diameter = 2.0f * radius;
+
+  // A grid of cells one diameter wide, over the spawning box and a margin.
+  grid_t grid;
+  v4f r = { radius, radius, radius, 0.0f };
+  v4f m = load4f (box [1]) + r;
+  grid.lo = load4f (box [0]) - m;
+  grid.scale = _mm_set1_ps (1.0f / diameter);
+  ALIGNED16 float extent [4];
+  store4f (extent, (m + m) * grid.scale);
+  for (unsigned k = 0; k != 3; ++ k) {
+    grid.n [k] = extent [k] > 0.0f ? truncate (extent [k]) + 1 : 1;
+  }
+  unsigned cell_count = grid.n [0] * grid.n [1] * grid.n [2];
+
+  // Scratch: displacements, each object's cell, the start of each cell's
+  // run in "sorted" (and a cursor for filling it), and the objects sorted
+  // by cell.
+  std::size_t line = pool_alignment - 1;
+  std::size_t d_size = (count * sizeof (float [4]) + line) & ~ line;
+  std::size_t cell_size = (count * sizeof (unsigned) + line) & ~ line;
+  std::size_t start_size = ((cell_count + 1) * sizeof (unsigned) + line)
+    & ~ line;
+  char * memory = static_cast <char *> (pool_allocate (d_size
+      + 2 * cell_size + 2 * start_size));
+  if (! memory) return false;
+  float (* d) [4] = reinterpret_cast <float (*) [4]> (memory);
+  unsigned * cell = reinterpret_cast <unsigned *> (memory + d_size);
+  unsigned * sorted = reinterpret_cast <unsigned *> (memory + d_size
+    + cell_size);
+  unsigned * start = reinterpret_cast <unsigned *> (memory + d_size
+    + 2 * cell_size);
+  unsigned * cursor = reinterpret_cast <unsigned *> (memory + d_size
+    + 2 * cell_size + start_size);
+
+#ifndef TINY
+  unsigned threads = std::thread::hardware_concurrency ();
+  unsigned most = count / usr::relax_min_objects_per_thread;
+  if (threads > most) threads = most;
+  if (threads > usr::relax_max_threads) threads = usr::relax_max_threads;
+  if (! threads) threads = 1;
+  // The caller's threads, or our own for all the sweeps.
+  workers_t own {};
+  if (! workers || ! workers->count ()) {
+    workers = & own;
+    if (threads > 1 && ! own.start (threads - 1)) threads = 1;
+  }
+  if (threads > workers->count () + 1) threads = workers->count () + 1;
+  displace_job_t job = { x, d, count, & grid, start, sorted, diameter };
+#else
+  (void) workers;
+#endif
+
+  for (unsigned sweep = 0; sweep != sweeps; ++ sweep) {
+    // Sort the objects by cell (a counting sort).
+    for (unsigned k = 0; k != cell_count + 1; ++ k) start [k] = 0;
+    for (unsigned i = 0; i != count; ++ i) {
+      v4f p = load4f (x [i]);
+      unsigned ix = grid.coordinate (p, 0);
+      unsigned iy = grid.coordinate (p, 1);
+      unsigned iz = grid.coordinate (p, 2);
+      cell [i] = (iz * grid.n [1] + iy) * grid.n [0] + ix;
+      ++ start [cell [i] + 1];
+    }
+    for (unsigned k = 0; k != cell_count; ++ k) {
+      start [k + 1] += start [k];
+      cursor [k] = start [k];
+    }
+    for (unsigned i = 0; i != count; ++ i) sorted [cursor [cell [i]] ++] = i;
+
+    // Find every object's displacement from the old positions.
+#ifndef TINY
+    if (threads > 1) {
+      workers->begin (& displace_part, & job, threads);
+      displace_part (& job, 0, threads);
+      workers->wait ();
+    }
+    else
+#endif
+      displace (x, d, 0, count, grid, start, sorted, diameter);
+
+    // Move, and stay inside the walls.
+    for (unsigned i = 0; i != count; ++ i) {
+      v4f p = load4f (x [i]) + load4f (d [i]);
+      for (unsigned k = 0; k != 6; ++ k) {
+        v4f anchor = load4f (walls [k] [0]);
+        v4f normal = load4f (walls [k] [1]);
+        float s = _mm_cvtss_f32 (dot (p - anchor, normal));
+        if (s < radius) p += _mm_set1_ps (radius - s) * normal;
+      }
+      store4f (x [i], p);
+    }
+  }
+  pool_deallocate (memory);
+  return true;
+}
@@ -0,0 +1,73 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef placement_h
+#define placement_h
+
+#define ENABLE_FAST_START
+
+#ifdef ENABLE_FAST_START
+#define FAST_START_ENABLED 1
+#else
+#define FAST_START_ENABLED 0
+#endif
+
+// Fast initial placement, for model_t::start.
+
+// Placing the objects one at a time at random leaves many of them deeply
+// overlapping, and letting 24 frames of collisions push them apart costs as
+// much as 24 frames of simulation (at the highest counts, most of the start
+// time). Instead:
+
+// 1. place_objects divides the spawning box into a grid of cells, just fine
+//    enough that at least "count" cell centres lie inside the tank (at least
+//    the radius from each wall), picks "count" of those cells at random and
+//    puts one object at a random point in each (stratified sampling). The
+//    objects are then spread about as evenly as the grid allows, without
+//    the clumps of independent uniform placement.
+
+// 2. relax_overlaps moves overlapping spheres apart. In each sweep every
+//    object is moved by half its overlap with each neighbour (found with a
+//    uniform grid of cells one diameter wide), all at once from the old
+//    positions (a Jacobi iteration, so the objects can be processed in any
+//    order, in parallel), and then kept inside the walls. At the highest
+//    counts the spheres cannot all be separated (their total volume exceeds
+//    that of the closest packing), but a few sweeps remove the deep
+//    overlaps that make the first frames expensive.
+
+// Both allocate their scratch memory from the pool, and return false if
+// that fails (then model_t::start falls back to the old way). The sweeps
+// share out the objects among the caller's workers (workers.h), if it has
+// any, or else among threads started once for all the sweeps. In the tiny
+// build they use one thread.
+
+// Velocities are drawn just as before. The collisions of the anneal are
+// elastic, so skipping them leaves the same total kinetic energy, only not
+// yet shared out between the linear and angular motion.
+
+#include "random.h"
+
+struct workers_t;
+
+bool place_objects (rng_t & rng, float (* x) [4], unsigned count,
+  const float (& box) [2] [4], const float (& walls) [6] [2] [4],
+  float radius);
+
+bool relax_overlaps (float (* x) [4], unsigned count,
+  const float (& box) [2] [4], const float (& walls) [6] [2] [4],
+  float radius, unsigned sweeps, workers_t * workers = nullptr);
+
+#endif
@@ -14,10 +14,12 @@
 
 #include "polymorph.h"
 #include "aligned-arrays.h"
+#include "checkpoint.h"
 #include "compiler.h"
 #include "glinit.h"
 #include "qpc.h"
 #include "resources.h"
+#include "trace.h"
 #include <windowsx.h>
 
 #define WC_MAIN TEXT ("M")
@@ -62,6 +64,37 @@ void get_rect (RECT & rect, const arguments_t & arguments)
   rect.bottom = ::GetSystemMetrics (SM_CYVIRTUALSCREEN);
 }
 
+#if SCHEDULER_ENABLED
+#define FRAME_TIMER_ID 1
+
+schedule_mode_t get_schedule_mode (run_mode_t mode)
+{
+  return
+    mode == parented ? schedule_preview :
+    mode == persistent ? schedule_persistent : schedule_screensaver;
+}
+
+visibility_t get_visibility (HWND hwnd, HDC hdc)
+{
+  // IsWindowVisible is false if the preview's dialog page is hidden.
+  if (::IsIconic (::GetAncestor (hwnd, GA_ROOT)) || ! ::IsWindowVisible (hwnd))
+    return window_minimized;
+  // Detects a covered window only without desktop composition.
+  RECT rect;
+  if (::GetClipBox (hdc, & rect) == NULLREGION) return window_occluded;
+  return window_visible;
+}
+#endif
+
+#if RECORDING_ENABLED || PUBLISH_ENABLED
+// Get a non-empty environment variable.
+bool get_environment (const char * name, char (& value) [MAX_PATH])
+{
+  DWORD n = ::GetEnvironmentVariableA (name, value, MAX_PATH);
+  return n && n < MAX_PATH;
+}
+#endif
+
 ALIGN_STACK
 LRESULT CALLBACK MainWndProc (HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -87,7 +120,8 @@ LRESULT CALLBACK MainWndProc (HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
           ::SetWindowLongPtr (hwnd, GWLP_USERDATA, LONG_PTR (ws));
           // Once-only model/graphics allocation and initialization.
           // Abort window creation if shader program compilation fails.
-          result = ws->model.initialize (qpc ());
+          ws->model.initialize (qpc ());
+          if (ws->model.initialize_graphics ()) result = 0;
         }
       }
     }
@@ -124,18 +158,134 @@ LRESULT CALLBACK MainWndProc (HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     case WM_WINDOWPOSCHANGED: {
       WINDOWPOS * wp = (WINDOWPOS *) lParam;
       if (! (wp->flags & SWP_NOSIZE) || wp->flags & SWP_SHOWWINDOW) {
-        ws->model.start (wp->cx, wp->cy, ws->settings);
+        // Start the model when the window is first shown. After that (when
+        // the window is resized, or the configure dialog's preview is shown
+        // again), carry on in the new tank, with any settings changed in
+        // the dialog meanwhile (see model_t::post_setting), and keep the
+        // recording, replay and publication going.
+        bool started = false;
+        if (! ws->model.resize (wp->cx, wp->cy)) {
+          const char * checkpoint = nullptr;
+#if CHECKPOINTS_ENABLED
+          // Warm start from the last population annealed for this window
+          // size and radius setting.
+          char path [MAX_PATH + 64];
+          if (checkpoint_default_path (path, sizeof path, wp->cx, wp->cy,
+              ws->settings.trackbar_pos [3])) {
+            checkpoint = path;
+          }
+#endif
+          started = ws->model.start (wp->cx, wp->cy, ws->settings,
+            checkpoint);
+        }
+#if RECORDING_ENABLED
+        // POLYMORPH_REPLAY names a recording to draw instead of simulating;
+        // otherwise, POLYMORPH_RECORD names a file to record to. Positions
+        // are recorded over the tank of a window covering all the screens
+        // (the largest the window can become).
+        if (started) {
+          char name [MAX_PATH];
+          if (get_environment ("POLYMORPH_REPLAY", name)) {
+            if (! ws->player.is_open ()) ws->player.open (name);
+          }
+          else if (get_environment ("POLYMORPH_RECORD", name)
+              && ! ws->recorder.is_open ()) {
+            int max_width = ::GetSystemMetrics (SM_CXVIRTUALSCREEN);
+            int max_height = ::GetSystemMetrics (SM_CYVIRTUALSCREEN);
+            ws->recorder.open (name, ws->model.recording_header (wp->cx,
+              wp->cy, max_width, max_height));
+          }
+        }
+#endif
+#if PUBLISH_ENABLED
+        {
+          // POLYMORPH_PUBLISH names a shared-memory publication of the
+          // frames, for other processes to read (see publish.h).
+          char name [MAX_PATH];
+          if (started && get_environment ("POLYMORPH_PUBLISH", name)) {
+            ws->publisher.open (name, ws->model.maximum_count ());
+          }
+        }
+#endif
+        unsigned rate = 0;
+#if SCHEDULER_ENABLED
+        ws->scheduler.reset (system_clock (), get_schedule_mode (mode),
+          wp->cx, wp->cy);
+        rate = ws->scheduler.rate;
+#endif
+#if GOVERNOR_ENABLED
+        // Budget: the frame interval, if capped, otherwise the display's
+        // refresh interval.
+        int refresh = ::GetDeviceCaps (ws->hdc, VREFRESH);
+        if (refresh <= 1) refresh = 60;
+        ws->governor.allow_interval = true;
+        ws->governor.reset (ws->model, 1.0f / (rate ? rate : refresh));
+        ws->last_paint = 0;
+#endif
+        (void) rate;
+        (void) started;
       }
       break;
     }
 
     case WM_PAINT: {
-      ws->model.draw_next ();
-      ::SwapBuffers (ws->hdc);
-      ::InvalidateRect (hwnd, nullptr, FALSE);
+      unsigned steps = 1, wait = 0;
+      bool visible = true;
+#if SCHEDULER_ENABLED
+      visibility_t visibility = get_visibility (hwnd, ws->hdc);
+      visible = visibility == window_visible;
+      steps = ws->scheduler.poll (visibility, wait);
+      ::ValidateRect (hwnd, nullptr);
+#endif
+      if (steps) {
+#if GOVERNOR_ENABLED
+        std::uint64_t paint_begin = qpc ();
+#endif
+#if RECORDING_ENABLED
+        if (ws->player.is_open ()) {
+          // Loop.
+          if (! ws->model.replay (ws->player) && ws->player.seek (0)) {
+            ws->model.replay (ws->player);
+          }
+        }
+        else
+#endif
+          ws->model.draw_next (steps);
+#if RECORDING_ENABLED
+        if (ws->recorder.is_open ()) ws->model.record (ws->recorder);
+#endif
+#if PUBLISH_ENABLED
+        if (ws->publisher.is_open ()) ws->model.publish (ws->publisher);
+#endif
+#if GOVERNOR_ENABLED
+        std::uint64_t paint_end = qpc ();
+#endif
+        {
+          TRACE_SCOPE ("SwapBuffers");
+          ::SwapBuffers (ws->hdc);
+        }
+#if GOVERNOR_ENABLED
+        // (Signed conversions, to avoid a libgcc call in the x86 tiny build.)
+        float tick = 1.0f / (std::int64_t) qpf ();
+        float work = tick * (std::int64_t) (paint_end - paint_begin);
+        float period = ws->last_paint
+          ? tick * (std::int64_t) (paint_begin - ws->last_paint) : work;
+        ws->governor.update (ws->model, work, period);
+        ws->last_paint = paint_begin;
+#endif
+      }
+#if GOVERNOR_ENABLED
+      // Don't count the time spent hidden as a late frame.
+      if (! visible) ws->last_paint = 0;
+#endif
+      (void) visible;
+#if SCHEDULER_ENABLED
+      if (wait) ::SetTimer (hwnd, FRAME_TIMER_ID, wait, nullptr);
+      else
+#endif
+        ::InvalidateRect (hwnd, nullptr, FALSE);
 #if TIMING_ENABLED
-      ++ ws->frame_counter;
-      if (! (ws->frame_counter & 1023)) {
+      if (steps && ! (++ ws->frame_counter & 1023)) {
         LARGE_INTEGER pc;
         ::QueryPerformanceCounter (& pc);
         float frame_time = ws->pf * (pc.QuadPart - ws->last_pc.QuadPart);
@@ -147,6 +297,14 @@ LRESULT CALLBACK MainWndProc (HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       break;
     }
 
+#if SCHEDULER_ENABLED
+    case WM_TIMER:
+      // One-shot: the next WM_PAINT sets it again if need be.
+      ::KillTimer (hwnd, wParam);
+      ::InvalidateRect (hwnd, nullptr, FALSE);
+      break;
+#endif
+
     case WM_SETCURSOR:
       ::SetCursor (mode == screensaver || mode == configure
                      ? nullptr
@@ -201,6 +359,13 @@ LRESULT CALLBACK MainWndProc (HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       break;
 
     case WM_DESTROY:
+#if RECORDING_ENABLED
+      ws->recorder.close ();
+      ws->player.close ();
+#endif
+#if PUBLISH_ENABLED
+      ws->publisher.close ();
+#endif
       ::wglMakeCurrent (nullptr, nullptr);
       ::wglDeleteContext (ws->hglrc);
       ::PostQuitMessage (0);
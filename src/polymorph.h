@@ -20,7 +20,11 @@
 #include "mswin.h"
 
 #include "arguments.h"
+#include "governor.h"
 #include "model.h"
+#include "publish.h"
+#include "recording.h"
+#include "scheduler.h"
 #include "settings.h"
 #include "print.h"
 
@@ -48,6 +52,20 @@ struct window_struct_t
   LARGE_INTEGER last_pc;
   float pf;
   unsigned frame_counter;
+#endif
+#if GOVERNOR_ENABLED
+  governor_t governor;
+  std::uint64_t last_paint; // Zero after a pause.
+#endif
+#if SCHEDULER_ENABLED
+  scheduler_t scheduler;
+#endif
+#if RECORDING_ENABLED
+  recorder_t recorder;
+  player_t player;
+#endif
+#if PUBLISH_ENABLED
+  publisher_t publisher;
 #endif
   model_t model;
 };
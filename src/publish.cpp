@@ -0,0 +1,302 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mswin.h"
+
+#include "publish.h"
+
+#if PUBLISH_ENABLED
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace usr
+{
+  // Slots in the ring.
+  const unsigned publication_slots = 4;
+  // Attempts at a consistent copy, per read.
+  const unsigned publication_read_attempts = 4;
+}
+
+static_assert (std::atomic <std::uint64_t>::is_always_lock_free
+  && std::atomic <std::uint32_t>::is_always_lock_free,
+  "shared-memory atomics must be lock-free");
+static_assert (sizeof (publication_header_t) == 64, "header layout");
+static_assert (sizeof (publication_slot_t) == 64, "slot layout");
+static_assert (sizeof (published_object_t) % 16 == 0, "object alignment");
+
+namespace
+{
+  publication_slot_t * get_slot (const publication_header_t * header,
+    std::uint64_t k)
+  {
+    char * base = (char *) header + header->header_size;
+    return (publication_slot_t *) (base + k * header->slot_size);
+  }
+
+  published_object_t * get_objects (const publication_slot_t * slot)
+  {
+    return (published_object_t *) (slot + 1);
+  }
+
+  std::size_t slot_size (unsigned capacity)
+  {
+    return sizeof (publication_slot_t)
+      + (std::size_t) capacity * sizeof (published_object_t);
+  }
+
+  bool valid (const publication_header_t & h, std::size_t size)
+  {
+    return size >= sizeof h
+      && h.magic == publication_magic
+      && h.version == publication_version
+      && h.header_size == sizeof h
+      && h.object_size == sizeof (published_object_t)
+      && h.slot_count >= 2
+      && h.slot_size == slot_size (h.capacity)
+      && size >= h.header_size + h.slot_count * h.slot_size;
+  }
+
+  // The system's name for publication "name".
+  bool system_name (char (& buffer) [64], const char * name)
+  {
+#ifdef _WIN32
+    const char * format = "%s";
+#else
+    const char * format = "/%s";
+#endif
+    if (std::strchr (name, '/')) return false;
+    int n = std::snprintf (buffer, sizeof buffer, format, name);
+    return n > 0 && std::size_t (n) < sizeof buffer;
+  }
+}
+
+bool publisher_t::open (const char * name, unsigned capacity)
+{
+  char buffer [64];
+  if (! system_name (buffer, name)) return false;
+#ifdef _WIN32
+  // Keep an open publication of the same name even if it is too small: a
+  // new mapping cannot take the name while readers hold the old one, so
+  // replacing it would end the publication.
+  if (header && ! std::strcmp (buffer, name_buffer)) return true;
+#else
+  if (header && ! std::strcmp (buffer, name_buffer)
+      && capacity <= header->capacity) {
+    return true;
+  }
+#endif
+  close ();
+  if (! capacity) capacity = 1;
+
+  unsigned * order = new (std::nothrow) unsigned [capacity];
+  if (! order) return false;
+  for (unsigned n = 0; n != capacity; ++ n) order [n] = n;
+
+  std::size_t new_size = sizeof (publication_header_t)
+    + usr::publication_slots * slot_size (capacity);
+  void * p = nullptr;
+#ifdef _WIN32
+  HANDLE m = ::CreateFileMappingA (INVALID_HANDLE_VALUE, nullptr,
+    PAGE_READWRITE, (DWORD) ((std::uint64_t) new_size >> 32),
+    (DWORD) new_size, buffer);
+  if (m && ::GetLastError () == ERROR_ALREADY_EXISTS) {
+    // Someone else's.
+    ::CloseHandle (m);
+    m = nullptr;
+  }
+  if (m) {
+    p = ::MapViewOfFile (m, FILE_MAP_WRITE, 0, 0, new_size);
+    if (p) mapping = m;
+    else ::CloseHandle (m);
+  }
+#else
+  // Replace any stale publication (its readers keep their mappings).
+  ::shm_unlink (buffer);
+  int fd = ::shm_open (buffer, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd >= 0) {
+    if (! ::ftruncate (fd, new_size)) {
+      p = ::mmap (nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+        0);
+      if (p == MAP_FAILED) p = nullptr;
+    }
+    ::close (fd);
+    if (! p) ::shm_unlink (buffer);
+  }
+#endif
+  if (! p) {
+    delete [] order;
+    return false;
+  }
+
+  // The memory is zero-filled. Readers check the magic number, which is
+  // written last.
+  publication_header_t * h = new (p) publication_header_t ();
+  h->version = publication_version;
+  h->header_size = sizeof (publication_header_t);
+  h->object_size = sizeof (published_object_t);
+  h->slot_count = usr::publication_slots;
+  h->capacity = capacity;
+  h->slot_size = slot_size (capacity);
+  for (unsigned k = 0; k != usr::publication_slots; ++ k) {
+    new (get_slot (h, k)) publication_slot_t ();
+  }
+  std::atomic_thread_fence (std::memory_order_release);
+  h->magic = publication_magic;
+
+  header = h;
+  slot = nullptr;
+  identity = order;
+  size = new_size;
+  frames = 0;
+  std::strcpy (name_buffer, buffer);
+  return true;
+}
+
+void publisher_t::close ()
+{
+  if (! header) return;
+  header->closed.store (1, std::memory_order_release);
+#ifdef _WIN32
+  ::UnmapViewOfFile (header);
+  ::CloseHandle (mapping);
+#else
+  ::munmap (header, size);
+  ::shm_unlink (name_buffer);
+#endif
+  delete [] identity;
+  header = nullptr;
+  identity = nullptr;
+}
+
+published_object_t * publisher_t::begin_frame (unsigned total,
+  unsigned & count)
+{
+  std::uint64_t frame = frames + 1;
+  slot = get_slot (header, frame % header->slot_count);
+  std::uint64_t sequence = slot->sequence.load (std::memory_order_relaxed);
+  slot->sequence.store (sequence + 1, std::memory_order_relaxed);
+  // The writes to the slot may not be seen before the odd sequence number.
+  std::atomic_thread_fence (std::memory_order_release);
+  count = total < header->capacity ? total : header->capacity;
+  slot->frame.store (frame, std::memory_order_relaxed);
+  slot->count.store (count, std::memory_order_relaxed);
+  slot->total.store (total, std::memory_order_relaxed);
+  return get_objects (slot);
+}
+
+void publisher_t::end_frame ()
+{
+  std::uint64_t sequence = slot->sequence.load (std::memory_order_relaxed);
+  slot->sequence.store (sequence + 1, std::memory_order_release);
+  header->frame.store (++ frames, std::memory_order_release);
+}
+
+bool subscriber_t::open (const char * name)
+{
+  close ();
+  char buffer [64];
+  if (! system_name (buffer, name)) return false;
+  const void * p = nullptr;
+  std::size_t mapped = 0;
+#ifdef _WIN32
+  HANDLE h = ::OpenFileMappingA (FILE_MAP_READ, FALSE, buffer);
+  if (! h) return false;
+  p = ::MapViewOfFile (h, FILE_MAP_READ, 0, 0, 0);
+  ::CloseHandle (h);
+  MEMORY_BASIC_INFORMATION info;
+  if (p && ::VirtualQuery (p, & info, sizeof info)) mapped = info.RegionSize;
+#else
+  int fd = ::shm_open (buffer, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) return false;
+  struct stat st;
+  if (! ::fstat (fd, & st)
+      && std::size_t (st.st_size) >= sizeof (publication_header_t)) {
+    p = ::mmap (nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) p = nullptr;
+    else mapped = st.st_size;
+  }
+  ::close (fd);
+#endif
+  if (! p) return false;
+  header = static_cast <const publication_header_t *> (p);
+  size = mapped;
+  last_frame = 0;
+  torn = 0;
+  std::atomic_thread_fence (std::memory_order_acquire);
+  if (! valid (* header, size)) {
+    close ();
+    return false;
+  }
+  return true;
+}
+
+void subscriber_t::close ()
+{
+  if (! header) return;
+#ifdef _WIN32
+  ::UnmapViewOfFile (header);
+#else
+  ::munmap (const_cast <publication_header_t *> (header), size);
+#endif
+  header = nullptr;
+}
+
+bool subscriber_t::closed () const
+{
+  return ! header || header->closed.load (std::memory_order_acquire);
+}
+
+bool subscriber_t::read (published_object_t * objects, std::uint64_t & frame,
+  unsigned & count, unsigned & total)
+{
+  if (! header) return false;
+  for (unsigned k = 0; k != usr::publication_read_attempts; ++ k) {
+    std::uint64_t f = header->frame.load (std::memory_order_acquire);
+    if (f == last_frame) return false;
+    const publication_slot_t * s = get_slot (header, f % header->slot_count);
+    std::uint64_t sequence = s->sequence.load (std::memory_order_acquire);
+    if (sequence & 1) {
+      ++ torn;
+      continue;
+    }
+    std::uint64_t slot_frame = s->frame.load (std::memory_order_relaxed);
+    unsigned n = s->count.load (std::memory_order_relaxed);
+    unsigned t = s->total.load (std::memory_order_relaxed);
+    if (n > header->capacity) n = header->capacity;
+    std::memcpy (objects, get_objects (s), n * sizeof (published_object_t));
+    // The copy must be complete before the sequence number is checked.
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (s->sequence.load (std::memory_order_relaxed) != sequence
+        || slot_frame != f) {
+      ++ torn;
+      continue;
+    }
+    frame = last_frame = f;
+    count = n;
+    total = t;
+    return true;
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,155 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef publish_h
+#define publish_h
+
+#define ENABLE_PUBLISH
+
+#if defined (ENABLE_PUBLISH) && ! defined (TINY)
+#define PUBLISH_ENABLED 1
+#else
+#define PUBLISH_ENABLED 0
+#endif
+
+// Live publication of the drawn frames in shared memory, for other
+// processes (a recorder, an analytics sidecar, a second renderer) to
+// observe the running simulation.
+
+// The publisher (publisher_t, see model_t::publish) owns a named
+// shared-memory object (POSIX shm_open, or a named file mapping on
+// Windows) holding a header and a ring of slots. Each frame goes into the
+// next slot: for each object, its uniform block exactly as the renderer
+// gets it (diffuse colour d, morph coefficients g, modelview matrix m and
+// snub flag s, see object_data_t) and its position x and angular position
+// u, in object index order.
+
+// Each slot is guarded by a sequence lock: the publisher makes the slot's
+// sequence number odd, writes the slot, makes it even again and then
+// advances the header's frame number. It never waits for the readers,
+// which need no write access. A reader (subscriber_t) copies the newest
+// slot and checks that its sequence number was even and unchanged
+// throughout, otherwise the copy may be torn and it tries again; a reader
+// slower than the publisher sees only some of the frames, and one slower
+// than a whole turn of the ring rarely gets a consistent copy.
+
+// The reader side (subscriber_t) uses nothing from the simulation, so a
+// consumer needs only publish.h and publish.cpp; bench/observe.cpp is an
+// example, and a test.
+
+#if PUBLISH_ENABLED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+const std::uint32_t publication_magic = 0x504d504du; // "MPMP"
+const std::uint32_t publication_version = 1;
+
+// One object. The first 100 bytes have the layout of object_data_t.
+struct published_object_t
+{
+  float d [4];              // Diffuse reflectance (RGBA).
+  float g [4];              // Morph (vertex generator) coefficients.
+  float m [4] [4];          // Modelview matrix, column-major.
+  std::uint32_t s;          // Snub?
+  std::uint32_t reserved [3];
+  float x [4];              // Position.
+  float u [4];              // Angular position (rotation vector).
+};
+
+struct publication_header_t
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t header_size;  // sizeof (publication_header_t)
+  std::uint32_t object_size;  // sizeof (published_object_t)
+  std::uint32_t slot_count;
+  std::uint32_t capacity;     // Objects per slot.
+  std::uint64_t slot_size;    // Bytes per slot, including its header.
+  std::atomic <std::uint64_t> frame;  // The newest complete frame (from 1).
+  std::atomic <std::uint32_t> closed; // The publisher has gone.
+  std::uint32_t reserved [5];
+};
+
+// The slot header, followed by "capacity" objects.
+struct publication_slot_t
+{
+  std::atomic <std::uint64_t> sequence;  // Odd while being written.
+  std::atomic <std::uint64_t> frame;
+  std::atomic <std::uint32_t> count;     // Objects in the slot.
+  std::atomic <std::uint32_t> total;     // Objects in the frame.
+  std::uint32_t reserved [10];
+};
+
+struct publisher_t
+{
+  // Create the shared-memory object "name" for frames of up to "capacity"
+  // objects (objects beyond that are left out). Keeps an existing
+  // publication if it has the same name and enough capacity; otherwise
+  // replaces it, and readers of the old one see it closed. On Windows an
+  // existing publication with the same name is kept whatever its capacity
+  // (its name stays taken while readers have it open).
+  bool open (const char * name, unsigned capacity);
+  void close ();
+  bool is_open () const { return header; }
+
+  // Claim the next slot for a frame of "total" objects, of which "count"
+  // fit, and return them. The caller fills in object n from object
+  // order () [n] (the identity), then calls end_frame.
+  published_object_t * begin_frame (unsigned total, unsigned & count);
+  void end_frame ();
+  const unsigned * order () const { return identity; }
+
+  std::uint64_t frames;  // Published.
+private:
+  publication_header_t * header;
+  publication_slot_t * slot;
+  unsigned * identity;
+  std::size_t size;
+  char name_buffer [64];
+#ifdef _WIN32
+  void * mapping;
+#endif
+};
+
+struct subscriber_t
+{
+  // Open the publication "name" for reading.
+  bool open (const char * name);
+  void close ();
+  bool is_open () const { return header; }
+  unsigned capacity () const { return header ? header->capacity : 0; }
+  // The publisher has closed the publication (reopen to follow it).
+  bool closed () const;
+
+  // Copy the newest frame, if newer than the last one read, into
+  // "objects" (room for capacity () objects). Returns false if there is
+  // no new frame, or no consistent copy was made in a few attempts. Never
+  // waits.
+  bool read (published_object_t * objects, std::uint64_t & frame,
+    unsigned & count, unsigned & total);
+
+  std::uint64_t last_frame;  // Read.
+  std::uint64_t torn;        // Copies discarded as inconsistent.
+private:
+  const publication_header_t * header;
+  std::size_t size;
+};
+
+#endif
+
+#endif
@@ -19,6 +19,10 @@
 
 #include "mswin.h"
 
+#include <cstdint>
+
+#ifdef _WIN32
+
 inline std::uint64_t qpc ()
 {
   LARGE_INTEGER qpc;
@@ -26,4 +30,30 @@ inline std::uint64_t qpc ()
   return qpc.QuadPart;
 }
 
+// Ticks per second of qpc.
+inline std::uint64_t qpf ()
+{
+  LARGE_INTEGER qpf;
+  ::QueryPerformanceFrequency (& qpf);
+  return qpf.QuadPart;
+}
+
+#else
+
+#include <ctime>
+
+inline std::uint64_t qpc ()
+{
+  timespec ts;
+  ::clock_gettime (CLOCK_MONOTONIC, & ts);
+  return ts.tv_sec * std::uint64_t (1000000000) + ts.tv_nsec;
+}
+
+inline std::uint64_t qpf ()
+{
+  return 1000000000;
+}
+
+#endif
+
 #endif
@@ -43,6 +43,76 @@ std::uint64_t rng_t::get ()
   return state * 2685821657736338717ull;
 }
 
+// The streams of rng4_t are the generator "xorshift128+" of [3], with
+// shifts (23, 18, 5), and its jump function (which advances the state by
+// 2^64 steps, by adding up the states at the set bits of the jump
+// polynomial). The seed is expanded to the first state by SplitMix64 [4].
+
+// [3] Sebastiano Vigna (2017)
+// https://doi.org/10.1016/j.cam.2016.11.006
+
+// [4] Guy L. Steele Jr., Doug Lea and Christine H. Flood (2014)
+// https://doi.org/10.1145/2714064.2660195
+
+namespace
+{
+  const std::uint64_t jump_polynomial [2] = {
+    0x8a5cd789635d2dffull, 0x121fd2155c472f96ull,
+  };
+
+  std::uint64_t splitmix64 (std::uint64_t & x)
+  {
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // Advance both streams in a pair of registers by 2^64 steps.
+  void jump_pair (__m128i & s0, __m128i & s1)
+  {
+    __m128i t0 = _mm_setzero_si128 (), t1 = _mm_setzero_si128 ();
+    for (std::uint64_t word : jump_polynomial) {
+      for (unsigned b = 0; b != 64; ++ b) {
+        if (word >> b & 1) {
+          t0 = _mm_xor_si128 (t0, s0);
+          t1 = _mm_xor_si128 (t1, s1);
+        }
+        rng4_t::step (s0, s1);
+      }
+    }
+    s0 = t0;
+    s1 = t1;
+  }
+}
+
+void rng4_t::initialize (std::uint64_t seed, unsigned set)
+{
+  std::uint64_t x = seed;
+  std::uint64_t a = splitmix64 (x), b = splitmix64 (x);
+  // Streams 0 to 3 are 0 to 3 jumps along; both lanes of t are one stream.
+  __m128i t0 = _mm_set1_epi64x ((long long) a);
+  __m128i t1 = _mm_set1_epi64x ((long long) b);
+  __m128i u0 [4], u1 [4];
+  for (unsigned k = 0; k != 4; ++ k) {
+    u0 [k] = t0;
+    u1 [k] = t1;
+    if (k != 3) jump_pair (t0, t1);
+  }
+  s0 [0] = _mm_unpacklo_epi64 (u0 [0], u0 [1]);
+  s1 [0] = _mm_unpacklo_epi64 (u1 [0], u1 [1]);
+  s0 [1] = _mm_unpacklo_epi64 (u0 [2], u0 [3]);
+  s1 [1] = _mm_unpacklo_epi64 (u1 [2], u1 [3]);
+  for (unsigned n = 0; n != set; ++ n) jump ();
+}
+
+void rng4_t::jump ()
+{
+  for (unsigned k = 0; k != 2; ++ k) {
+    for (unsigned n = 0; n != 4; ++ n) jump_pair (s0 [k], s1 [k]);
+  }
+}
+
 // Random floating-point number uniformly distributed on the interval [a, b).
 // Undefined behaviour due to signed integer overflow if |a| >= 32767 * |b - a|.
 float get_float (rng_t & rng, float a, float b)
@@ -79,3 +149,9 @@ v4f get_vector_in_box (rng_t & rng)
   v4f v = _mm_cvtepi32_ps (_mm_set_epi64x (rng.get (), rng.get ()));
   return _mm_set1_ps (0x1.000000P-031f) * v;
 }
+
+v4f get_vector_in_box (rng4_t & rng)
+{
+  v4f v = _mm_cvtepi32_ps (rng.get32 ());
+  return _mm_set1_ps (0x1.000000P-031f) * v;
+}
@@ -18,16 +18,67 @@
 #define random_h
 
 #include <cstdint>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+// rng_t is a single xorshift64* stream, used by the serial code.
+
+// rng4_t runs four xorshift128+ streams side by side in SSE2 registers, and
+// a call returns one number from each. Stream k of a seed starts k * 2^64
+// steps along one sequence (of period 2^128 - 1), so streams never overlap
+// in practice. A worker thread (or a batch of objects) n gets its own
+// reproducible streams 4 n to 4 n + 3 with initialize (seed, n), or by
+// calling jump n times.
 
 struct rng_t
 {
   rng_t () = default;
   void initialize (std::uint64_t seed);
   std::uint64_t get ();
+  // For checkpoints (see checkpoint.h).
+  std::uint64_t get_state () const { return state; }
+  void set_state (std::uint64_t new_state) { state = new_state; }
 private:
   std::uint64_t state;
   rng_t (const rng_t &) = delete;
   rng_t & operator = (const rng_t &) = delete;
 };
 
+struct rng4_t
+{
+  rng4_t () = default;
+  void initialize (std::uint64_t seed, unsigned set = 0);
+  // Four random 64-bit numbers: streams 0 and 1 in r [0], 2 and 3 in r [1].
+  void get (__m128i (& r) [2])
+  {
+    for (unsigned k = 0; k != 2; ++ k) {
+      r [k] = _mm_add_epi64 (s0 [k], s1 [k]);
+      step (s0 [k], s1 [k]);
+    }
+  }
+  // Four random 32-bit numbers (the high halves), stream k in lane k.
+  __m128i get32 ()
+  {
+    __m128i r [2];
+    get (r);
+    return _mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (r [0]),
+        _mm_castsi128_ps (r [1]), _MM_SHUFFLE (3, 1, 3, 1)));
+  }
+  // Move on to the next set of four streams (4 * 2^64 steps further).
+  void jump ();
+  // One step of the two streams in a pair of registers.
+  static void step (__m128i & s0, __m128i & s1)
+  {
+    __m128i x = s0, y = s1;
+    s0 = y;
+    x = _mm_xor_si128 (x, _mm_slli_epi64 (x, 23));
+    s1 = _mm_xor_si128 (_mm_xor_si128 (x, y),
+      _mm_xor_si128 (_mm_srli_epi64 (x, 18), _mm_srli_epi64 (y, 5)));
+  }
+private:
+  __m128i s0 [2], s1 [2];
+  rng4_t (const rng4_t &) = delete;
+  rng4_t & operator = (const rng4_t &) = delete;
+};
+
 #endif
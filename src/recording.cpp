@@ -0,0 +1,514 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "recording.h"
+
+#if RECORDING_ENABLED
+
+#include "memory.h"
+#include "trace.h"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace usr
+{
+  // Frames quantized but not yet written.
+  const unsigned recording_queue_length = 4;
+}
+
+namespace
+{
+  struct frame_header_t
+  {
+    std::uint32_t size;     // Of the payload, which follows.
+    std::uint32_t count;    // Objects.
+    std::uint32_t keyframe;
+  };
+
+  struct footer_t
+  {
+    std::uint64_t index_offset;
+    std::uint32_t keyframes;
+    std::uint32_t frames;
+    std::uint32_t magic;
+    std::uint32_t reserved;
+  };
+
+  const std::uint32_t footer_magic = 0x58524d50u; // "PMRX"
+
+  // Longest encoding of a 16-bit value.
+  const std::size_t max_varint = 3;
+
+  inline unsigned char * put (unsigned char * p, unsigned v)
+  {
+    while (v >= 0x80) {
+      * p ++ = (unsigned char) (v | 0x80);
+      v >>= 7;
+    }
+    * p ++ = (unsigned char) v;
+    return p;
+  }
+
+  inline bool get (const unsigned char * & p, const unsigned char * end,
+    unsigned & v)
+  {
+    v = 0;
+    for (unsigned shift = 0; shift != 7 * max_varint; shift += 7) {
+      if (p == end) return false;
+      unsigned b = * p ++;
+      v |= (b & 0x7f) << shift;
+      if (! (b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  inline unsigned zigzag (std::uint16_t value, std::uint16_t reference)
+  {
+    std::int16_t d = (std::int16_t) (std::uint16_t) (value - reference);
+    return (std::uint16_t) ((d << 1) ^ (d >> 15));
+  }
+
+  inline std::uint16_t unzigzag (unsigned v, std::uint16_t reference)
+  {
+    return (std::uint16_t) (reference + ((v >> 1) ^ - (v & 1)));
+  }
+
+  inline std::uint16_t quantize (float v, float lo, float scale)
+  {
+    float q = (v - lo) * scale + 0.5f;
+    q = q < 0.0f ? 0.0f : q > 65535.0f ? 65535.0f : q;
+    return (std::uint16_t) (int) q;
+  }
+
+  bool seek_to (std::FILE * file, std::uint64_t offset)
+  {
+#ifdef _WIN32
+    return ! ::_fseeki64 (file, (long long) offset, SEEK_SET);
+#else
+    return ! ::fseeko (file, (off_t) offset, SEEK_SET);
+#endif
+  }
+
+  std::uint64_t tell (std::FILE * file)
+  {
+#ifdef _WIN32
+    return (std::uint64_t) ::_ftelli64 (file);
+#else
+    return (std::uint64_t) ::ftello (file);
+#endif
+  }
+
+  // Reallocate an array of uint16 planes, if it is too small.
+  bool grow_planes (std::uint16_t * & planes, unsigned & capacity,
+    unsigned count)
+  {
+    if (count <= capacity) return true;
+    deallocate (planes);
+    capacity = count + count / 2;
+    planes = static_cast <std::uint16_t *> (allocate (recording_plane_count
+        * capacity * sizeof (std::uint16_t)));
+    if (! planes) capacity = 0;
+    return planes;
+  }
+}
+
+struct recorder_state_t
+{
+  struct slot_t
+  {
+    std::uint16_t * planes;  // [recording_plane_count] [capacity]
+    unsigned capacity;
+    unsigned count;
+  };
+
+  std::FILE * file;
+  recording_header_t header;
+  float scale [recording_plane_count];
+
+  // The queue: slots [tail] to slots [head] (exclusive) are full.
+  slot_t slots [usr::recording_queue_length];
+  unsigned head, tail, filled;
+  bool closing;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::thread writer;
+
+  // The writer's.
+  std::uint16_t * previous;
+  unsigned previous_capacity;
+  unsigned previous_count;
+  unsigned char * out;
+  std::size_t out_size;
+  recording_keyframe_t * keyframes;
+  unsigned keyframe_count, keyframe_capacity;
+  std::uint64_t offset;
+  std::uint64_t raw_bytes;
+  unsigned written;
+  bool error;
+
+  void write_loop ();
+  bool write_frame (const slot_t & slot);
+};
+
+bool recorder_t::open (const char * path, const recording_header_t & header)
+{
+  frames = 0;
+  dropped = 0;
+  bytes = 0;
+  raw_bytes = 0;
+  state = new (std::nothrow) recorder_state_t ();
+  if (! state) return false;
+  recorder_state_t & s = * state;
+  s.header = header;
+  s.header.magic = recording_magic;
+  s.header.version = recording_version;
+  s.header.header_size = sizeof (recording_header_t);
+  for (unsigned k = 0; k != recording_plane_count; ++ k) {
+    s.scale [k] = 1.0f / header.step [k];
+  }
+  s.file = std::fopen (path, "wb");
+  if (! s.file || std::fwrite (& s.header, sizeof s.header, 1, s.file) != 1) {
+    if (s.file) std::fclose (s.file);
+    delete state;
+    state = nullptr;
+    return false;
+  }
+  s.offset = sizeof s.header;
+  s.writer = std::thread (& recorder_state_t::write_loop, state);
+  return true;
+}
+
+bool recorder_t::capture (unsigned count, const float (* x) [4],
+  const float (* u) [4], const object_t * objects)
+{
+  if (! state) return false;
+  TRACE_SCOPE ("capture");
+  recorder_state_t & s = * state;
+  recorder_state_t::slot_t * slot;
+  {
+    std::lock_guard <std::mutex> lock (s.mutex);
+    if (s.filled == usr::recording_queue_length) {
+      ++ dropped;
+      return false;
+    }
+    slot = & s.slots [s.head];
+  }
+  // The slot is ours until it is queued.
+  if (! grow_planes (slot->planes, slot->capacity, count)) {
+    ++ dropped;
+    return false;
+  }
+  std::uint16_t * q [recording_plane_count];
+  for (unsigned k = 0; k != recording_plane_count; ++ k) {
+    q [k] = slot->planes + k * slot->capacity;
+  }
+  const float * lo = s.header.lo;
+  const float * scale = s.scale;
+  for (unsigned n = 0; n != count; ++ n) {
+    const object_t & A = objects [n];
+    for (unsigned k = 0; k != 3; ++ k) {
+      q [plane_x0 + k] [n] = quantize (x [n] [k], lo [plane_x0 + k],
+        scale [plane_x0 + k]);
+      q [plane_u0 + k] [n] = quantize (u [n] [k], lo [plane_u0 + k],
+        scale [plane_u0 + k]);
+    }
+    q [plane_hue] [n] = quantize (A.hue, lo [plane_hue], scale [plane_hue]);
+    q [plane_time] [n] = quantize (A.animation_time, lo [plane_time],
+      scale [plane_time]);
+    q [plane_r] [n] = quantize (A.r, lo [plane_r], scale [plane_r]);
+    q [plane_state] [n] = (std::uint16_t) pack_state (A);
+  }
+  slot->count = count;
+  {
+    std::lock_guard <std::mutex> lock (s.mutex);
+    s.head = (s.head + 1) % usr::recording_queue_length;
+    ++ s.filled;
+  }
+  s.ready.notify_one ();
+  return true;
+}
+
+void recorder_t::close ()
+{
+  if (! state) return;
+  recorder_state_t & s = * state;
+  {
+    std::lock_guard <std::mutex> lock (s.mutex);
+    s.closing = true;
+  }
+  s.ready.notify_one ();
+  s.writer.join ();
+
+  // The index, and the footer that locates it.
+  footer_t footer = { s.offset, s.keyframe_count, s.written, footer_magic, 0 };
+  std::size_t n = s.keyframe_count;
+  if (! s.error && (std::fwrite (s.keyframes, sizeof (recording_keyframe_t),
+        n, s.file) != n || std::fwrite (& footer, sizeof footer, 1, s.file)
+      != 1)) {
+    s.error = true;
+  }
+  if (! s.error) s.offset += n * sizeof (recording_keyframe_t) + sizeof footer;
+  std::fclose (s.file);
+
+  frames = s.written;
+  bytes = s.offset;
+  raw_bytes = s.raw_bytes;
+  for (auto & slot : s.slots) deallocate (slot.planes);
+  deallocate (s.previous);
+  deallocate (s.out);
+  deallocate (s.keyframes);
+  delete state;
+  state = nullptr;
+}
+
+void recorder_state_t::write_loop ()
+{
+  TRACE_THREAD_NAME ("recording writer");
+  for (;;) {
+    const slot_t * slot;
+    {
+      std::unique_lock <std::mutex> lock (mutex);
+      ready.wait (lock, [this] { return filled || closing; });
+      if (! filled) return;
+      slot = & slots [tail];
+    }
+    if (! error) error = ! write_frame (* slot);
+    {
+      std::lock_guard <std::mutex> lock (mutex);
+      tail = (tail + 1) % usr::recording_queue_length;
+      -- filled;
+    }
+  }
+}
+
+bool recorder_state_t::write_frame (const slot_t & slot)
+{
+  TRACE_SCOPE ("write frame");
+  unsigned count = slot.count;
+  bool key = ! (written % header.keyframe_interval)
+    || count != previous_count;
+
+  std::size_t size = sizeof (frame_header_t)
+    + std::size_t (count) * recording_plane_count * max_varint;
+  if (size > out_size) {
+    deallocate (out);
+    out_size = size + size / 2;
+    out = static_cast <unsigned char *> (allocate (out_size));
+    if (! out) return false;
+  }
+  if (! grow_planes (previous, previous_capacity, count)) return false;
+  if (key && keyframe_count == keyframe_capacity) {
+    unsigned new_capacity = keyframe_capacity ? 2 * keyframe_capacity : 64;
+    void * p = allocate (new_capacity * sizeof (recording_keyframe_t));
+    if (! p) return false;
+    if (keyframe_count) {
+      std::memcpy (p, keyframes, keyframe_count * sizeof * keyframes);
+    }
+    deallocate (keyframes);
+    keyframes = static_cast <recording_keyframe_t *> (p);
+    keyframe_capacity = new_capacity;
+  }
+
+  // Each value, relative to the last frame's value (or in a keyframe, to
+  // the previous object's).
+  unsigned char * p = out + sizeof (frame_header_t);
+  for (unsigned k = 0; k != recording_plane_count; ++ k) {
+    const std::uint16_t * q = slot.planes + k * slot.capacity;
+    std::uint16_t * r = previous + k * previous_capacity;
+    std::uint16_t last = 0;
+    for (unsigned n = 0; n != count; ++ n) {
+      p = put (p, zigzag (q [n], key ? last : r [n]));
+      last = r [n] = q [n];
+    }
+  }
+  frame_header_t h = {
+    (std::uint32_t) (p - out - sizeof h), count, key,
+  };
+  std::memcpy (out, & h, sizeof h);
+  std::size_t n = p - out;
+  if (std::fwrite (out, 1, n, file) != n) return false;
+
+  if (key) keyframes [keyframe_count ++] = { offset, written, 0 };
+  offset += n;
+  raw_bytes += std::uint64_t (count) * recording_plane_count * sizeof (float);
+  previous_count = count;
+  ++ written;
+  return true;
+}
+
+bool player_t::open (const char * path)
+{
+  file = std::fopen (path, "rb");
+  if (! file) return false;
+  for (auto & plane : planes) plane = nullptr;
+  capacity = 0;
+  buffer = nullptr;
+  buffer_size = 0;
+  keyframes = nullptr;
+  keyframe_count = 0;
+  frames = 0;
+  count = 0;
+
+  bool ok = std::fread (& header, sizeof header, 1, file) == 1
+    && header.magic == recording_magic
+    && header.version == recording_version
+    && header.header_size == sizeof header;
+  if (! ok) {
+    close ();
+    return false;
+  }
+
+  // Read the index, if the file has one.
+  footer_t footer;
+  std::uint64_t end = 0;
+  if (! std::fseek (file, - (long) sizeof footer, SEEK_END)) end = tell (file);
+  if (end > sizeof header
+      && std::fread (& footer, sizeof footer, 1, file) == 1
+      && footer.magic == footer_magic
+      && footer.index_offset >= sizeof header
+      && footer.index_offset <= end
+      && (end - footer.index_offset) / sizeof (recording_keyframe_t)
+        == footer.keyframes
+      && footer.keyframes) {
+    std::size_t n = footer.keyframes;
+    keyframes = static_cast <recording_keyframe_t *>
+      (allocate (n * sizeof (recording_keyframe_t)));
+    ok = keyframes && seek_to (file, footer.index_offset)
+      && std::fread (keyframes, sizeof * keyframes, n, file) == n;
+    keyframe_count = footer.keyframes;
+    frames = footer.frames;
+  }
+  else {
+    ok = scan ();
+  }
+  if (! ok || ! frames || ! seek (0)) {
+    close ();
+    return false;
+  }
+  return true;
+}
+
+// Find the frames and keyframes by reading the frame headers.
+bool player_t::scan ()
+{
+  unsigned keyframe_capacity = 0;
+  std::uint64_t offset = sizeof header;
+  frame_header_t h;
+  while (seek_to (file, offset) && std::fread (& h, sizeof h, 1, file) == 1) {
+    if (h.keyframe) {
+      if (keyframe_count == keyframe_capacity) {
+        keyframe_capacity = keyframe_capacity ? 2 * keyframe_capacity : 64;
+        void * p = allocate (keyframe_capacity * sizeof * keyframes);
+        if (! p) return false;
+        if (keyframe_count) {
+          std::memcpy (p, keyframes, keyframe_count * sizeof * keyframes);
+        }
+        deallocate (keyframes);
+        keyframes = static_cast <recording_keyframe_t *> (p);
+      }
+      keyframes [keyframe_count ++] = { offset, frames, 0 };
+    }
+    else if (! keyframe_count) {
+      return false;
+    }
+    offset += sizeof h + h.size;
+    ++ frames;
+  }
+  // A frame cut short by a crash is dropped by "next".
+  return true;
+}
+
+void player_t::close ()
+{
+  if (file) std::fclose (file);
+  file = nullptr;
+  deallocate (planes [0]);
+  for (auto & plane : planes) plane = nullptr;
+  deallocate (buffer);
+  buffer = nullptr;
+  deallocate (keyframes);
+  keyframes = nullptr;
+}
+
+bool player_t::grow (unsigned new_capacity, std::size_t new_buffer_size)
+{
+  if (new_capacity > capacity) {
+    std::uint16_t * p = planes [0];
+    if (! grow_planes (p, capacity, new_capacity)) return false;
+    for (unsigned k = 0; k != recording_plane_count; ++ k) {
+      planes [k] = p + k * capacity;
+    }
+  }
+  if (new_buffer_size > buffer_size) {
+    deallocate (buffer);
+    buffer_size = new_buffer_size + new_buffer_size / 2;
+    buffer = static_cast <unsigned char *> (allocate (buffer_size));
+    if (! buffer) {
+      buffer_size = 0;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool player_t::next ()
+{
+  if (frame == frames) return false;
+  TRACE_SCOPE ("decode frame");
+  frame_header_t h;
+  if (std::fread (& h, sizeof h, 1, file) != 1) return false;
+  // Only a keyframe can change the count.
+  if (! h.keyframe && h.count != count) return false;
+  if (! grow (h.count, h.size)) return false;
+  if (std::fread (buffer, 1, h.size, file) != h.size) return false;
+
+  const unsigned char * p = buffer;
+  const unsigned char * end = buffer + h.size;
+  for (unsigned k = 0; k != recording_plane_count; ++ k) {
+    std::uint16_t * q = planes [k];
+    std::uint16_t last = 0;
+    for (unsigned n = 0; n != h.count; ++ n) {
+      unsigned v;
+      if (! get (p, end, v)) return false;
+      last = q [n] = unzigzag (v, h.keyframe ? last : q [n]);
+    }
+  }
+  count = h.count;
+  keyframe = h.keyframe;
+  ++ frame;
+  return true;
+}
+
+bool player_t::seek (unsigned new_frame)
+{
+  if (new_frame >= frames) return false;
+  // The last keyframe at or before new_frame.
+  unsigned lo = 0, hi = keyframe_count;
+  while (hi - lo > 1) {
+    unsigned mid = (lo + hi) / 2;
+    if (keyframes [mid].frame <= new_frame) lo = mid;
+    else hi = mid;
+  }
+  if (! seek_to (file, keyframes [lo].offset)) return false;
+  frame = keyframes [lo].frame;
+  while (frame != new_frame) {
+    if (! next ()) return false;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,156 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef recording_h
+#define recording_h
+
+#define ENABLE_RECORDING
+
+#if defined (ENABLE_RECORDING) && ! defined (TINY)
+#define RECORDING_ENABLED 1
+#else
+#define RECORDING_ENABLED 0
+#endif
+
+// Compressed recordings of the drawn frames, and replay.
+
+// A recording holds, for each frame drawn, what the renderer needs of each
+// object: its position x, angular position u, hue, animation time, size
+// and Markov state (system, starting point and target). Replaying a
+// recording (model_t::replay) draws the same pictures without the physics,
+// for playback on weak hardware, repros of visual bugs, and benchmarks of
+// the renderer alone.
+
+// Each value is quantized to 16 bits over a fixed range given in the header
+// (positions over every tank the window can have, up to a largest size, so
+// that the recording carries on through resizes; rotation vectors
+// over [-3.5, 3.5], and so on), which is visually exact. Frames are stored
+// as planes (all the x [0] values, then all the x [1] values, ...), each
+// value as the difference from the same object's value in the previous frame
+// (a keyframe: from the previous object's value), zig-zag encoded as a
+// varint, so slowly moving objects take about a byte per value. Every
+// keyframe_interval-th frame is a keyframe, as is any frame where the object
+// count changes; an index of the keyframes at the end of the file makes
+// seeking cheap (without it, as when the recording was not closed, the
+// player scans the file instead).
+
+// The recorder quantizes each frame into one of a few queue slots on the
+// caller's thread; a background thread does the encoding and the writing.
+// If the writer falls behind, frames are dropped (and counted), so the
+// frame loop never waits for the disk.
+
+#if RECORDING_ENABLED
+
+#include "object.h"
+#include <cstdint>
+#include <cstdio>
+
+enum recording_plane_t
+{
+  plane_x0, plane_x1, plane_x2, plane_u0, plane_u1, plane_u2,
+  plane_hue, plane_time, plane_r, plane_state, recording_plane_count
+};
+
+const std::uint32_t recording_magic = 0x524d504du; // "MPMR"
+const std::uint32_t recording_version = 1;
+
+struct recording_header_t
+{
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t header_size;  // sizeof (recording_header_t)
+  std::int32_t width, height;
+  std::uint32_t keyframe_interval;
+  // Value = lo + step * quantized value.
+  float lo [recording_plane_count];
+  float step [recording_plane_count];
+};
+
+// The state plane holds the Markov state, packed.
+inline unsigned pack_state (const object_t & object)
+{
+  return (unsigned) object.target.system << 6 | object.starting_point << 3
+    | object.target.point;
+}
+
+struct recorder_state_t;
+
+struct recorder_t
+{
+  // Create the file and start the writer thread.
+  bool open (const char * path, const recording_header_t & header);
+  // Quantize the frame, in which objects [n] has position x [n] and angular
+  // position u [n], and queue it for the writer. Returns false if the frame
+  // was dropped.
+  bool capture (unsigned count, const float (* x) [4], const float (* u) [4],
+    const object_t * objects);
+  // Write the queued frames and the index, and close the file.
+  void close ();
+  bool is_open () const { return state; }
+
+  // Totals, up to date after close.
+  unsigned frames, dropped;
+  std::uint64_t bytes;      // Size of the file.
+  std::uint64_t raw_bytes;  // Size of the frames as 32-bit floats.
+private:
+  recorder_state_t * state;
+};
+
+struct recording_keyframe_t
+{
+  std::uint64_t offset;
+  std::uint32_t frame;
+  std::uint32_t reserved;
+};
+
+struct player_t
+{
+  bool open (const char * path);
+  void close ();
+  bool is_open () const { return file; }
+  // Decode the next frame. Returns false at the end of the recording, or on
+  // a read error.
+  bool next ();
+  // Make "frame" the next frame, decoding from the keyframe before it.
+  bool seek (unsigned frame);
+
+  float value (unsigned plane, unsigned n) const
+  {
+    return header.lo [plane] + header.step [plane] * planes [plane] [n];
+  }
+  unsigned state (unsigned n) const { return planes [plane_state] [n]; }
+
+  recording_header_t header;
+  unsigned frames;    // In the recording.
+  unsigned frame;     // Of the next frame.
+  unsigned count;     // Objects in the current frame.
+  bool keyframe;      // The current frame is a keyframe.
+private:
+  bool grow (unsigned new_capacity, std::size_t new_buffer_size);
+  bool scan ();
+
+  std::FILE * file;
+  std::uint16_t * planes [recording_plane_count];
+  unsigned capacity;
+  unsigned char * buffer;
+  std::size_t buffer_size;
+  recording_keyframe_t * keyframes;
+  unsigned keyframe_count;
+};
+
+#endif
+
+#endif
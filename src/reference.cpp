@@ -0,0 +1,181 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "reference.h"
+#include <cmath>
+
+namespace
+{
+  struct quaternion_t
+  {
+    double s;   // scalar part
+    vec3_t v;   // vector part
+  };
+
+  quaternion_t operator * (quaternion_t p, quaternion_t q)
+  {
+    return { p.s * q.s - dot (p.v, q.v),
+             p.s * q.v + q.s * p.v + cross (p.v, q.v) };
+  }
+
+  quaternion_t to_quaternion (vec3_t u)
+  {
+    double angle = std::sqrt (dot (u, u));
+    if (angle == 0.0) return { 1.0, { 0.0, 0.0, 0.0 } };
+    return { std::cos (angle / 2), (std::sin (angle / 2) / angle) * u };
+  }
+
+  vec3_t to_axis_angle (quaternion_t q)
+  {
+    if (q.s < 0.0) q = { - q.s, - q.v };
+    double sine = std::sqrt (dot (q.v, q.v));
+    if (sine == 0.0) return { 0.0, 0.0, 0.0 };
+    double angle = 2.0 * std::atan2 (sine, q.s);
+    return (angle / sine) * q.v;
+  }
+}
+
+bool reference_bounce (body_t & A, body_t & B, double friction)
+{
+  vec3_t dx = B.x - A.x;
+  double distance = std::sqrt (dot (dx, dx));
+  if (distance >= A.r + B.r) return false;
+
+  // Velocity of B's contact point relative to A's.
+  vec3_t n = (1.0 / distance) * dx;
+  vec3_t contact_A = A.v + cross (A.w, A.r * n);
+  vec3_t contact_B = B.v + cross (B.w, - B.r * n);
+  vec3_t relative = contact_B - contact_A;
+  if (dot (dx, B.v - A.v) >= 0.0) return false;
+
+  // Normal and tangential (slip) parts.
+  vec3_t normal = dot (relative, n) * n;
+  vec3_t slip = relative - normal;
+
+  // The impulse on B is lambda * u (and on A, - lambda * u).
+  vec3_t u = - (normal + friction * slip);
+  vec3_t nu = cross (n, u);
+  double inverse_mass = dot (u, u) * (1.0 / A.m + 1.0 / B.m)
+    + dot (nu, nu) * (A.r * A.r / A.l + B.r * B.r / B.l);
+  double lambda = -2.0 * dot (u, relative) / inverse_mass;
+
+  vec3_t J = lambda * u;
+  A.v = A.v - (1.0 / A.m) * J;
+  B.v = B.v + (1.0 / B.m) * J;
+  A.w = A.w + (1.0 / A.l) * cross (A.r * n, - J);
+  B.w = B.w + (1.0 / B.l) * cross (- B.r * n, J);
+  return true;
+}
+
+bool reference_wall_bounce (body_t & A, const wall_t & wall, double friction)
+{
+  const vec3_t & n = wall.normal;
+  if (dot (A.x - wall.anchor, n) >= A.r) return false;
+  if (dot (A.v, n) >= 0.0) return false;
+
+  // Velocity of the contact point, and its normal and tangential parts.
+  vec3_t contact = A.v + cross (A.w, - A.r * n);
+  vec3_t normal = dot (A.v, n) * n;
+  vec3_t slip = contact - normal;
+
+  // The impulse on A is - lambda * u.
+  vec3_t u = normal + friction * slip;
+  vec3_t ru = cross (A.r * n, u);
+  double inverse_mass = dot (u, u) / A.m + dot (ru, ru) / A.l;
+  double lambda = 2.0 * dot (u, contact) / inverse_mass;
+
+  vec3_t J = - lambda * u;
+  A.v = A.v + (1.0 / A.m) * J;
+  A.w = A.w + (1.0 / A.l) * cross (- A.r * n, J);
+  return true;
+}
+
+void reference_advance_linear (body_t & A)
+{
+  A.x = A.x + A.v;
+}
+
+// The angular velocity is in world co-ordinates, so the frame's rotation
+// is applied after the current one.
+void reference_advance_angular (body_t & A)
+{
+  A.u = to_axis_angle (to_quaternion (A.w) * to_quaternion (A.u));
+}
+
+void reference_rotation (vec3_t u, double (& m) [3] [3])
+{
+  // Rodrigues' formula, R = I + sin(t) K + (1 - cos(t)) K^2, where t is the
+  // angle and K the cross-product matrix of the unit axis.
+  double angle = std::sqrt (dot (u, u));
+  vec3_t k = angle == 0.0 ? vec3_t { 0.0, 0.0, 0.0 } : (1.0 / angle) * u;
+  double K [3] [3] = {
+    {  0.0, - k.z,   k.y },
+    {  k.z,   0.0, - k.x },
+    { - k.y,  k.x,   0.0 },
+  };
+  double s = std::sin (angle), c = 1.0 - std::cos (angle);
+  for (unsigned i = 0; i != 3; ++ i) {
+    for (unsigned j = 0; j != 3; ++ j) {
+      double KK = 0.0;
+      for (unsigned p = 0; p != 3; ++ p) KK += K [i] [p] * K [p] [j];
+      m [i] [j] = (i == j ? 1.0 : 0.0) + s * K [i] [j] + c * KK;
+    }
+  }
+}
+
+void reference_modelview (const body_t & A, double (& f) [16])
+{
+  double m [3] [3];
+  reference_rotation (A.u, m);
+  for (unsigned j = 0; j != 3; ++ j) {
+    for (unsigned i = 0; i != 3; ++ i) f [4 * j + i] = m [i] [j];
+    f [4 * j + 3] = 0.0;
+  }
+  f [12] = A.x.x;
+  f [13] = A.x.y;
+  f [14] = A.x.z;
+  f [15] = 1.0;
+}
+
+double kinetic_energy (const body_t & A)
+{
+  return 0.5 * (A.m * dot (A.v, A.v) + A.l * dot (A.w, A.w));
+}
+
+vec3_t momentum (const body_t & A)
+{
+  return A.m * A.v;
+}
+
+void reference_step (body_t * bodies, unsigned count,
+  const wall_t (& walls) [6], const unsigned * index, const unsigned * order,
+  double balls_friction, double walls_friction)
+{
+  for (unsigned m = 0; m != count; ++ m) {
+    unsigned n = order [m];
+    for (unsigned i = 0; i != n; ++ i) {
+      body_t & A = bodies [index [n]], & B = bodies [index [i]];
+      reference_bounce (A, B, balls_friction);
+    }
+  }
+  for (unsigned k = 0; k != 6; ++ k) {
+    for (unsigned n = 0; n != count; ++ n) {
+      reference_wall_bounce (bodies [n], walls [k], walls_friction);
+    }
+  }
+  for (unsigned n = 0; n != count; ++ n) {
+    reference_advance_linear (bodies [n]);
+    reference_advance_angular (bodies [n]);
+  }
+}
@@ -0,0 +1,118 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef reference_h
+#define reference_h
+
+// Reference implementation of one simulation step, in plain scalar double
+// precision, written for clarity rather than speed. It is the specification
+// that the optimized kernels (kdtree.h, bounce.h, rodrigues.cpp) are checked
+// against; see bench/check.cpp.
+
+// Bodies are uniform spheres, with position x, velocity v, angular position
+// u (axis-angle: the direction of u is the axis and its length the angle of
+// rotation) and angular velocity w; mass m, moment of inertia l and radius r.
+// Time is measured in frames.
+
+// Collisions exchange an impulse along a direction that opposes both the
+// approach along the line of centres and (in proportion to a coefficient of
+// friction) the slip at the point of contact. The size of the impulse is
+// whatever makes the collision elastic, so kinetic energy (linear and
+// rotational) is conserved, and so is linear momentum in collisions between
+// bodies.
+
+struct vec3_t
+{
+  double x, y, z;
+};
+
+inline vec3_t operator + (vec3_t a, vec3_t b)
+{
+  return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+inline vec3_t operator - (vec3_t a, vec3_t b)
+{
+  return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+inline vec3_t operator - (vec3_t a)
+{
+  return { - a.x, - a.y, - a.z };
+}
+
+inline vec3_t operator * (double k, vec3_t a)
+{
+  return { k * a.x, k * a.y, k * a.z };
+}
+
+inline double dot (vec3_t a, vec3_t b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline vec3_t cross (vec3_t a, vec3_t b)
+{
+  return {
+    a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x
+  };
+}
+
+struct body_t
+{
+  vec3_t x, v, u, w;
+  double m, l, r;
+};
+
+// A wall is the plane through anchor with unit normal pointing into the tank.
+struct wall_t
+{
+  vec3_t anchor, normal;
+};
+
+// Collide two bodies if they interpenetrate and approach. Returns true if an
+// impulse was exchanged.
+bool reference_bounce (body_t & A, body_t & B, double friction);
+
+// Collide a body with a wall if it penetrates and approaches the wall.
+bool reference_wall_bounce (body_t & A, const wall_t & wall, double friction);
+
+// Inertial motion for one frame.
+void reference_advance_linear (body_t & A);
+void reference_advance_angular (body_t & A);
+
+// Rotation matrix for axis-angle vector u (m [row] [column]).
+void reference_rotation (vec3_t u, double (& m) [3] [3]);
+
+// OpenGL modelview matrix (column-major) for a body.
+void reference_modelview (const body_t & A, double (& f) [16]);
+
+double kinetic_energy (const body_t & A);
+vec3_t momentum (const body_t & A);
+
+// One step, as model_t::nodraw_next followed by advance_angular. The order of
+// collisions is given by the kd-tree permutation "index" (the position of
+// each body in tree order) and "order" (the order in which those positions
+// are visited): for each m, the body at position n = order [m] is bounced
+// against every body at a position before n, in position order. The kd-tree
+// only prunes pairs that cannot interpenetrate, so testing every such pair
+// gives the same collisions in the same order. Then each wall is bounced
+// against every body.
+void reference_step (body_t * bodies, unsigned count,
+  const wall_t (& walls) [6], const unsigned * index, const unsigned * order,
+  double balls_friction, double walls_friction);
+
+#endif
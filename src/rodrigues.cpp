@@ -326,6 +326,26 @@ v4f sincos (const v4f x)
   return oioi - sc;                // sin(x) cos(x) sin(x) cos(x)
 }
 
+// Range [-pi/2, pi/2].
+// Argument x0 x1 x2 x3, results sin(xk) and cos(xk) in lane k.
+// The same polynomials as the one-lane sincos, one argument per lane.
+void sincos (const v4f x, v4f & s, v4f & c)
+{
+  v4f xsq = x * x;
+  v4f xsqsq = xsq * xsq;
+  // The two polynomials, by Estrin's method as in polyeval.
+  v4f f = (SHUFPS (fpoly, fpoly, (0, 0, 0, 0))
+    + SHUFPS (fpoly, fpoly, (1, 1, 1, 1)) * xsq)
+    + (SHUFPS (fpoly, fpoly, (2, 2, 2, 2))
+      + SHUFPS (fpoly, fpoly, (3, 3, 3, 3)) * xsq) * xsqsq;
+  v4f g = (SHUFPS (gpoly, gpoly, (0, 0, 0, 0))
+    + SHUFPS (gpoly, gpoly, (1, 1, 1, 1)) * xsq)
+    + (SHUFPS (gpoly, gpoly, (2, 2, 2, 2))
+      + SHUFPS (gpoly, gpoly, (3, 3, 3, 3)) * xsq) * xsqsq;
+  s = x * f;
+  c = _mm_set1_ps (1.0f) - xsq * g;
+}
+
 // Very restricted range [+0x1.8c97f0P-001f, +0x1.fb5486P-001f]
 // ([0.774596691, 0.990879238]).
 // Argument x x x x, result acos(x) acos(x) acos(x) acos(x).
@@ -40,11 +40,16 @@ v4f rotate (v4f u, v4f v);
 // result sin(x) cos(x) sin(x) cos(x),
 // range [-pi/2, pi/2].
 
+// sincos (four lanes): argument x0 x1 x2 x3,
+// results sin(x0) sin(x1) sin(x2) sin(x3) and cos(x0) cos(x1) cos(x2) cos(x3),
+// range [-pi/2, pi/2].
+
 // arccos: argument x x x x,
 // result acos(x) acos(x) acos(x) acos(x),
 // range [+0x1.8c97f0P-001f, +0x1.fb5486P-001f] ([0.774596691, 0.990879238]).
 
 v4f sincos (v4f x);
+void sincos (v4f x, v4f & s, v4f & c);
 v4f arccos (v4f x);
 
 #endif
@@ -0,0 +1,101 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scheduler.h"
+#include "qpc.h"
+
+namespace usr
+{
+  // Frame rate caps.
+  const unsigned preview_rate = 20;
+  const unsigned persistent_rate = 30;
+  const unsigned small_window_rate = 30;
+  // Windows with fewer pixels than this are small.
+  const int small_window_area = 640 * 480;
+  // Simulation steps per second (as usr::frame_time in model.cpp).
+  const unsigned simulation_rate = 60;
+  // At most this many steps per frame; beyond that the simulation slows.
+  const unsigned max_batch = 4;
+  // Milliseconds between polls while the window is hidden.
+  const unsigned hidden_poll = 250;
+}
+
+namespace
+{
+  std::uint64_t qpc_now (void *)
+  {
+    return qpc ();
+  }
+}
+
+clock_source_t system_clock ()
+{
+  return { & qpc_now, nullptr, qpf () };
+}
+
+void scheduler_t::reset (const clock_source_t & source, schedule_mode_t mode,
+  int width, int height)
+{
+  clock = source;
+  base = clock.now (clock.context);
+  // (Signed conversion, to avoid a libgcc call in the x86 tiny build.)
+  tick = 1.0 / (std::int64_t) clock.frequency;
+  rate =
+    mode == schedule_preview ? usr::preview_rate :
+    mode == schedule_persistent ? usr::persistent_rate :
+    width * height < usr::small_window_area ? usr::small_window_rate : 0;
+  paused = true;
+}
+
+unsigned scheduler_t::poll (visibility_t visibility, unsigned & wait)
+{
+  if (visibility != window_visible) {
+    paused = true;
+    wait = usr::hidden_poll;
+    return 0;
+  }
+  wait = 0;
+  if (! rate) return 1;
+
+  double now = tick * (std::int64_t) (clock.now (clock.context) - base);
+  if (paused) {
+    paused = false;
+    origin = now;
+    next_frame = now;
+    steps = 0;
+  }
+  if (now < next_frame) {
+    wait = 1 + (int) (1000.0 * (next_frame - now));
+    return 0;
+  }
+
+  // Run the steps that are due, at least one and at most max_batch. If the
+  // simulation has fallen further behind, let it go.
+  // (Signed conversions, as in reset.)
+  unsigned due = (int) ((now - origin) * usr::simulation_rate);
+  unsigned n = due > steps ? due - steps : 1;
+  if (n > usr::max_batch) {
+    n = usr::max_batch;
+    steps = due - n;
+  }
+  steps += n;
+
+  // The next frame is due one interval after this one was, or after now if
+  // this one was late (no bursts of frames to catch up).
+  double interval = 1.0 / rate;
+  next_frame += interval;
+  if (next_frame <= now) next_frame = now + interval;
+  wait = 1 + (int) (1000.0 * (next_frame - now));
+  return n;
+}
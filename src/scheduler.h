@@ -0,0 +1,88 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef scheduler_h
+#define scheduler_h
+
+#define ENABLE_SCHEDULER
+
+#ifdef ENABLE_SCHEDULER
+#define SCHEDULER_ENABLED 1
+#else
+#define SCHEDULER_ENABLED 0
+#endif
+
+// Power-aware frame scheduler.
+
+// The screen saver proper runs flat out: a frame is drawn as soon as the
+// previous one has been presented (so the swap interval sets the pace), and
+// each frame advances the simulation by one step. In the Control Panel
+// preview, in persistent mode and in any small window that wastes power, so
+// there the scheduler caps the frame rate and keeps the simulation at its
+// nominal rate (60 steps per second) by batching several steps into each
+// frame. While the window is minimized or completely covered nothing is
+// simulated or drawn; the scheduler asks to be polled at a low rate until the
+// window is visible again, and the simulation then resumes where it left off
+// rather than catching up.
+
+// Time is read from a clock_source_t, which the caller supplies, so the
+// policy can be exercised against a simulated clock (see bench/schedule.cpp).
+
+#include <cstdint>
+
+struct clock_source_t
+{
+  std::uint64_t (* now) (void * context);
+  void * context;
+  std::uint64_t frequency; // Ticks per second.
+};
+
+// The performance counter (see qpc.h).
+clock_source_t system_clock ();
+
+enum schedule_mode_t
+{
+  schedule_screensaver, schedule_persistent, schedule_preview
+};
+
+enum visibility_t
+{
+  window_visible, window_occluded, window_minimized
+};
+
+struct scheduler_t
+{
+  // Call when the window is created or resized.
+  void reset (const clock_source_t & clock, schedule_mode_t mode, int width,
+    int height);
+  // Call when the window is ready for another frame, or a wait has expired.
+  // Returns the number of simulation steps to run before drawing a frame,
+  // or zero for no frame. Sets "wait" to the number of milliseconds until
+  // the next call, or zero to call again as soon as the frame is presented.
+  unsigned poll (visibility_t visibility, unsigned & wait);
+
+  unsigned rate;  // Frames per second, or zero if not capped.
+private:
+  clock_source_t clock;
+  std::uint64_t base;
+  double tick;          // Seconds per clock tick.
+  double origin;        // Time at which the simulation last resumed.
+  double next_frame;    // Time at which the next frame is due.
+  unsigned steps;       // Steps run since the simulation last resumed.
+  bool paused;
+};
+
+#endif
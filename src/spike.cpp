@@ -0,0 +1,118 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spike.h"
+
+#if SPIKE_DETECTOR_ENABLED
+
+#include "collision-stats.h"
+#include "phase.h"
+#include "qpc.h"
+
+namespace usr
+{
+  // A spike is a frame taking this many times the baseline.
+  const double spike_threshold = 3.0;
+  // Frames averaged for the initial baseline.
+  const unsigned spike_warmup = 60;
+  // Weight of the latest frame in the moving average.
+  const double spike_smoothing = 1.0 / 32.0;
+  // Maximum number of bundles written.
+  const unsigned spike_bundle_limit = 16;
+}
+
+namespace
+{
+  struct spike_state_t
+  {
+    std::uint64_t frames;
+    double baseline;
+    unsigned bundles;
+    // The most recent spike.
+    std::uint64_t frame;
+    double ticks;
+    double ticks_baseline;
+  };
+
+  thread_local spike_state_t spike_state;
+}
+
+bool spike_detect (std::uint64_t ticks)
+{
+  spike_state_t & state = spike_state;
+  double t = double (ticks);
+  double baseline = state.baseline;
+  std::uint64_t frame = state.frames ++;
+  bool spike = frame >= usr::spike_warmup
+    && t > usr::spike_threshold * baseline;
+  if (frame < usr::spike_warmup) {
+    state.baseline += (t - baseline) / state.frames;
+  }
+  else {
+    // Clamp, so that an isolated spike hardly moves the baseline but a
+    // sustained change (a larger count, say) is followed within a few dozen
+    // frames.
+    double clamped = t < 2 * baseline ? t : 2 * baseline;
+    state.baseline += (clamped - baseline) * usr::spike_smoothing;
+  }
+  if (! spike || state.bundles == usr::spike_bundle_limit) return false;
+  state.frame = frame;
+  state.ticks = t;
+  state.ticks_baseline = baseline;
+  return true;
+}
+
+std::FILE * spike_begin_bundle (unsigned object_count)
+{
+  spike_state_t & state = spike_state;
+  char filename [64];
+  std::snprintf (filename, sizeof filename, "polymorph-spike-%llu.json",
+    (unsigned long long) state.frame);
+  std::FILE * file = std::fopen (filename, "w");
+  if (! file) return nullptr;
+  ++ state.bundles;
+
+  double ms = 1e3 / qpf ();
+  std::fprintf (file, "{\"frame\":%llu,\"frame_ms\":%.4f,\"baseline_ms\":%.4f,"
+    "\"objects\":%u,\n", (unsigned long long) state.frame, state.ticks * ms,
+    state.ticks_baseline * ms, object_count);
+
+  const phase_times_t & times = phase_times_last_frame ();
+  std::fprintf (file, "\"phases_ms\":{");
+  for (unsigned p = 0; p != phase_count; ++ p) {
+    std::fprintf (file, "%s\"%s\":%.4f", p ? "," : "", phase_names [p],
+      times.ticks [p] * ms);
+  }
+  std::fprintf (file, "},\n");
+
+#if COLLISION_STATS_ENABLED
+  const collision_counts_t & counts = collision_stats_last_frame ();
+  std::fprintf (file, "\"collisions\":{");
+  for (unsigned k = 0; k != collision_counter_count; ++ k) {
+    std::fprintf (file, "%s\"%s\":%llu", k ? "," : "",
+      collision_counter_names [k], (unsigned long long) counts.counts [k]);
+  }
+  std::fprintf (file, "},\n");
+#endif
+
+  return file;
+}
+
+void spike_end_bundle (std::FILE * file)
+{
+  std::fprintf (file, "}\n");
+  std::fclose (file);
+}
+
+#endif
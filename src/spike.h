@@ -0,0 +1,54 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef spike_h
+#define spike_h
+
+//#define ENABLE_SPIKE_DETECTOR
+
+#if defined (ENABLE_SPIKE_DETECTOR) && ! defined (TINY)
+#define SPIKE_DETECTOR_ENABLED 1
+#else
+#define SPIKE_DETECTOR_ENABLED 0
+#endif
+
+// Frame-spike detector.
+
+// spike_detect is given the duration of each frame in qpc ticks. It keeps a
+// baseline (the mean of the first few frames, then an exponential moving
+// average) and returns true for a frame that takes more than
+// usr::spike_threshold times the baseline, until spike_bundle_limit spikes
+// have been captured.
+
+// To capture a spike, call spike_begin_bundle, which creates the file
+// "polymorph-spike-<frame>.json" and writes the frame's time, the baseline,
+// the object count, the frame's phase times (phase-times.h) and collision
+// counts (collision-stats.h, if enabled); end the frame in those first. Then
+// write a "state" member and call spike_end_bundle. Nothing is written for a
+// frame that is not a spike.
+
+// All state is per thread.
+
+#if SPIKE_DETECTOR_ENABLED
+#include <cstdint>
+#include <cstdio>
+
+bool spike_detect (std::uint64_t ticks);
+std::FILE * spike_begin_bundle (unsigned object_count);
+void spike_end_bundle (std::FILE * file);
+#endif
+
+#endif
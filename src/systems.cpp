@@ -19,9 +19,9 @@
 #include "cramer.h"
 #include "graphics.h"
 #include "make_system.h"
-#include "resources.h"
 #include "vector.h"
 #include "rodrigues.h"
+#include "trace.h"
 #include <cstdint>
 #include <cstring>
 #include <utility>
@@ -144,9 +144,9 @@ void get_triangle (unsigned (& p) [3], bool reflect, float (& xyz) [3] [4],
 
 void initialize_systems (float (& abc) [system_count] [8] [4],
   float (& xyz) [system_count] [3] [4], float (& xyzinv) [system_count] [3] [4],
-  unsigned (& primitive_count) [system_count],
-  unsigned (& vao_ids) [system_count])
+  unsigned (& primitive_count) [system_count])
 {
+  TRACE_SCOPE ("initialize_systems");
   ALIGNED16 float nodes [62] [4];
   std::uint8_t indices [60] [6];
 
@@ -155,8 +155,21 @@ void initialize_systems (float (& abc) [system_count] [8] [4],
     std::memcpy (p, symbols [n / 2], sizeof p);
     get_triangle (p, n & 1, xyz [n], abc [n]);
     cramer::inverse (xyz [n], xyzinv [n]);
+    primitive_count [n] = make_system (p, xyz [n], nodes, indices);
+  }
+}
+
+void initialize_vaos (const float (& xyz) [system_count] [3] [4],
+  unsigned (& vao_ids) [system_count])
+{
+  TRACE_SCOPE ("initialize_vaos");
+  ALIGNED16 float nodes [62] [4];
+  std::uint8_t indices [60] [6];
+
+  for (unsigned n = 0; n != 6; ++ n) {
+    unsigned p [3];
+    std::memcpy (p, symbols [n / 2], sizeof p);
     unsigned N = make_system (p, xyz [n], nodes, indices);
     vao_ids [n] = make_vao (N, nodes, indices);
-    primitive_count [n] = N;
   }
 }
@@ -27,7 +27,11 @@ enum system_select_t {
 void initialize_systems (float (& abc) [system_count] [8] [4],
                          float (& xyz) [system_count] [3] [4],
                          float (& xyzinv) [system_count] [3] [4],
-                         unsigned (& N) [system_count],
-                         unsigned (& vao_ids) [system_count]);
+                         unsigned (& N) [system_count]);
+
+// Make the vertex arrays (this needs the graphics context; the rest does
+// not). Takes xyz as computed by initialize_systems.
+void initialize_vaos (const float (& xyz) [system_count] [3] [4],
+                      unsigned (& vao_ids) [system_count]);
 
 #endif
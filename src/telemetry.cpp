@@ -0,0 +1,306 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "telemetry.h"
+
+#if TELEMETRY_ENABLED
+
+#include "collision-stats.h"
+#include "memory.h"
+#include "phase.h"
+#include "qpc.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace usr
+{
+  // Records queued for the client (a power of two).
+  const unsigned telemetry_queue_length = 256;
+  // How often the idle server checks for a new client, a hang-up, or a
+  // request to stop.
+  const int telemetry_poll_ms = 10;
+}
+
+namespace
+{
+  struct record_t
+  {
+    std::uint64_t frame;
+    std::uint64_t time;         // qpc, at the end of the frame.
+    std::uint64_t ticks;        // Frame time.
+    std::uint64_t transitions;  // So far.
+    std::uint64_t dropped;      // So far.
+    std::uint64_t allocations;
+    std::uint64_t phases [phase_count];
+    std::uint64_t collisions [collision_counter_count];
+    unsigned objects;
+  };
+
+  // Single-producer, single-consumer ring (see telemetry.h).
+  struct queue_t
+  {
+    bool push (const record_t & record)
+    {
+      unsigned t = tail.load (std::memory_order_relaxed);
+      if (t - head.load (std::memory_order_acquire) == capacity) return false;
+      entries [t & (capacity - 1)] = record;
+      tail.store (t + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop (record_t & record)
+    {
+      unsigned h = head.load (std::memory_order_relaxed);
+      if (h == tail.load (std::memory_order_acquire)) return false;
+      record = entries [h & (capacity - 1)];
+      head.store (h + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    static const unsigned capacity = usr::telemetry_queue_length;
+    record_t entries [capacity];
+    std::atomic <unsigned> head, tail;
+  };
+
+  struct server_t
+  {
+    int listener;
+    char path [sizeof (sockaddr_un::sun_path)]; // Empty for TCP.
+    std::thread thread;
+    std::atomic <bool> stop;
+    std::atomic <bool> connected;
+    // Producer only.
+    std::uint64_t frames;
+    std::uint64_t dropped;
+    queue_t queue;
+  };
+
+  server_t * server;
+
+  // Format a record as a line of JSON. The rate of Markov transitions is
+  // over the interval since the previous record sent.
+  int format (char * buffer, std::size_t size, const record_t & r,
+    const record_t & previous)
+  {
+    double f = 1.0 / qpf ();
+    double interval = (r.time - previous.time) * f;
+    double rate = previous.time && interval > 0.0
+      ? (r.transitions - previous.transitions) / interval : 0.0;
+    int n = std::snprintf (buffer, size, "{\"frame\":%llu,\"time\":%.6f,"
+      "\"frame_ms\":%.4f,\"objects\":%u,\"transitions_per_second\":%.1f,"
+      "\"dropped\":%llu,\"phases_ms\":{", (unsigned long long) r.frame,
+      r.time * f, r.ticks * f * 1e3, r.objects, rate,
+      (unsigned long long) r.dropped);
+    for (unsigned k = 0; k != phase_count; ++ k) {
+      n += std::snprintf (buffer + n, size - n, "%s\"%s\":%.4f",
+        k ? "," : "", phase_names [k], r.phases [k] * f * 1e3);
+    }
+    n += std::snprintf (buffer + n, size - n, "}");
+    if constexpr (COLLISION_STATS_ENABLED) {
+      n += std::snprintf (buffer + n, size - n, ",\"collisions\":{");
+      for (unsigned k = 0; k != collision_counter_count; ++ k) {
+        n += std::snprintf (buffer + n, size - n, "%s\"%s\":%llu",
+          k ? "," : "", collision_counter_names [k],
+          (unsigned long long) r.collisions [k]);
+      }
+      n += std::snprintf (buffer + n, size - n, "}");
+    }
+    if constexpr (MEMORY_STATS_ENABLED) {
+      n += std::snprintf (buffer + n, size - n, ",\"allocations\":%llu",
+        (unsigned long long) r.allocations);
+    }
+    n += std::snprintf (buffer + n, size - n, "}\n");
+    return n;
+  }
+
+  bool send_all (int fd, const char * p, std::size_t n)
+  {
+    while (n) {
+      ssize_t sent = ::send (fd, p, n, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR) continue;
+      if (sent <= 0) return false;
+      p += sent;
+      n -= sent;
+    }
+    return true;
+  }
+
+  // Send records to one client until it hangs up.
+  void serve_client (server_t & s, int client)
+  {
+    char line [2048];
+    record_t r, previous {};
+    while (! s.stop.load (std::memory_order_relaxed)) {
+      if (s.queue.pop (r)) {
+        int n = format (line, sizeof line, r, previous);
+        if (! send_all (client, line, n)) return;
+        previous = r;
+        continue;
+      }
+      pollfd p = { client, POLLIN, 0 };
+      if (::poll (& p, 1, usr::telemetry_poll_ms) > 0) {
+        // The client sends nothing; readable means it has gone.
+        char c [64];
+        if (p.revents & (POLLHUP | POLLERR)
+            || ::recv (client, c, sizeof c, MSG_DONTWAIT) <= 0) {
+          return;
+        }
+      }
+    }
+  }
+
+  void serve (server_t & s)
+  {
+    while (! s.stop.load (std::memory_order_relaxed)) {
+      pollfd p = { s.listener, POLLIN, 0 };
+      if (::poll (& p, 1, usr::telemetry_poll_ms) <= 0) continue;
+      int client = ::accept4 (s.listener, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) continue;
+      s.connected.store (true, std::memory_order_relaxed);
+      serve_client (s, client);
+      s.connected.store (false, std::memory_order_relaxed);
+      ::close (client);
+      // Discard the records meant for this client.
+      record_t r;
+      while (s.queue.pop (r)) { }
+    }
+  }
+
+  // Listen on a Unix-domain socket or a localhost TCP port.
+  int listen_on (const char * address, char * path, std::size_t path_size)
+  {
+    char * end;
+    unsigned long port = std::strtoul (address, & end, 10);
+    int fd;
+    if (* address && ! * end) {
+      if (! port || port > 65535) return -1;
+      fd = ::socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0) return -1;
+      int one = 1;
+      ::setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, & one, sizeof one);
+      sockaddr_in a = { };
+      a.sin_family = AF_INET;
+      a.sin_port = htons ((std::uint16_t) port);
+      a.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+      if (::bind (fd, (const sockaddr *) & a, sizeof a)) {
+        ::close (fd);
+        return -1;
+      }
+      path [0] = 0;
+    }
+    else {
+      sockaddr_un a = { };
+      a.sun_family = AF_UNIX;
+      if (std::strlen (address) >= sizeof a.sun_path
+          || std::strlen (address) >= path_size) {
+        return -1;
+      }
+      std::strcpy (a.sun_path, address);
+      // Replace a stale socket, but nothing else.
+      struct stat st;
+      if (! ::lstat (address, & st)) {
+        if (! S_ISSOCK (st.st_mode) || ::unlink (address)) return -1;
+      }
+      else if (errno != ENOENT) {
+        return -1;
+      }
+      fd = ::socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (fd < 0) return -1;
+      if (::bind (fd, (const sockaddr *) & a, sizeof a)) {
+        ::close (fd);
+        return -1;
+      }
+      std::strcpy (path, address);
+    }
+    if (::listen (fd, 1)) {
+      ::close (fd);
+      if (path [0]) ::unlink (path);
+      return -1;
+    }
+    return fd;
+  }
+}
+
+bool telemetry_open (const char * address)
+{
+  telemetry_close ();
+  server_t * s = new (std::nothrow) server_t ();
+  if (! s) return false;
+  s->listener = listen_on (address, s->path, sizeof s->path);
+  if (s->listener < 0) {
+    delete s;
+    return false;
+  }
+  s->thread = std::thread (serve, std::ref (* s));
+  server = s;
+  return true;
+}
+
+void telemetry_close ()
+{
+  server_t * s = server;
+  if (! s) return;
+  server = nullptr;
+  s->stop.store (true, std::memory_order_relaxed);
+  s->thread.join ();
+  ::close (s->listener);
+  if (s->path [0]) ::unlink (s->path);
+  delete s;
+}
+
+void telemetry_end_frame (std::uint64_t ticks, unsigned object_count,
+  std::uint64_t transitions)
+{
+  server_t * s = server;
+  if (! s) return;
+  ++ s->frames;
+  if (! s->connected.load (std::memory_order_relaxed)) return;
+  record_t r;
+  r.frame = s->frames;
+  r.time = qpc ();
+  r.ticks = ticks;
+  r.transitions = transitions;
+  r.dropped = s->dropped;
+  r.objects = object_count;
+  const phase_times_t & phases = phase_times_last_frame ();
+  for (unsigned k = 0; k != phase_count; ++ k) r.phases [k] = phases.ticks [k];
+#if COLLISION_STATS_ENABLED
+  const collision_counts_t & counts = collision_stats_last_frame ();
+  for (unsigned k = 0; k != collision_counter_count; ++ k) {
+    r.collisions [k] = counts.counts [k];
+  }
+#else
+  for (std::uint64_t & c : r.collisions) c = 0;
+#endif
+#if MEMORY_STATS_ENABLED
+  r.allocations = memory_stats_last_frame ();
+#else
+  r.allocations = 0;
+#endif
+  if (! s->queue.push (r)) ++ s->dropped;
+}
+
+#endif
@@ -0,0 +1,70 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef telemetry_h
+#define telemetry_h
+
+//#define ENABLE_TELEMETRY
+
+#if defined (ENABLE_TELEMETRY) && ! defined (TINY) && ! defined (_WIN32)
+#define TELEMETRY_ENABLED 1
+#else
+#define TELEMETRY_ENABLED 0
+#endif
+
+// Live telemetry: per-frame metrics streamed to a local client.
+
+// telemetry_open starts a server thread listening on a Unix-domain socket
+// (the address is a path, where a stale socket is replaced but any other
+// file is left alone, and telemetry_open fails) or on a localhost TCP port
+// (the address is a port number). After each frame, telemetry_end_frame
+// queues a record of the frame's time, the object count, the Markov
+// transitions so far, the frame's phase times (phase-times.h) and, if
+// enabled, its collision counts (collision-stats.h) and allocations
+// (memory.h); end the frame in those first. The server sends the records to
+// the connected client (one at a time) as JSON, one object per line; see
+// bench/scrape.cpp.
+
+// The queue is a bounded single-producer, single-consumer ring: the frame
+// loop writes a record, then publishes it by advancing "tail" (a release
+// store), and the server frees the records it has read by advancing
+// "head" (another release store). When it is full, because the client reads
+// slowly, telemetry_end_frame drops the record and counts it (each record
+// carries the count so far), so the frame loop never waits for the
+// client; and nothing is queued while no client is connected. Call
+// telemetry_end_frame from one thread, the one running the frames.
+
+// POSIX only. When disabled the macros expand to nothing.
+
+#if TELEMETRY_ENABLED
+#include <cstdint>
+
+bool telemetry_open (const char * address);
+void telemetry_close ();
+void telemetry_end_frame (std::uint64_t ticks, unsigned object_count,
+  std::uint64_t transitions);
+
+#define TELEMETRY_OPEN(address) telemetry_open (address)
+#define TELEMETRY_CLOSE() telemetry_close ()
+#define TELEMETRY_END_FRAME(ticks, object_count, transitions) \
+  telemetry_end_frame (ticks, object_count, transitions)
+#else
+#define TELEMETRY_OPEN(address) false
+#define TELEMETRY_CLOSE()
+#define TELEMETRY_END_FRAME(ticks, object_count, transitions)
+#endif
+
+#endif
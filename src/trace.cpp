@@ -0,0 +1,156 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include "memory.h"
+#include "qpc.h"
+#include <atomic>
+#include <cstdio>
+#include <new>
+
+namespace
+{
+  // Events per thread (a power of two). Older events are overwritten.
+  const unsigned trace_capacity = 1u << 16;
+
+  // A counter event has end = counter_event.
+  const std::uint64_t counter_event = ~ std::uint64_t (0);
+
+  struct trace_event_t
+  {
+    const char * name;
+    std::uint64_t begin;
+    std::uint64_t end;
+    double value;
+  };
+
+  struct trace_buffer_t
+  {
+    trace_buffer_t * next;
+    const char * thread_name;
+    unsigned tid;
+    // Total number of events recorded, published with release semantics
+    // after each event is written.
+    std::atomic <std::uint64_t> written;
+    trace_event_t events [trace_capacity];
+  };
+
+  // Lock-free singly-linked list of per-thread buffers (push only).
+  std::atomic <trace_buffer_t *> trace_buffers (nullptr);
+  std::atomic <unsigned> trace_thread_count (0);
+  thread_local trace_buffer_t * trace_buffer = nullptr;
+
+  trace_buffer_t * get_trace_buffer ()
+  {
+    if (! trace_buffer) {
+      void * memory = allocate (sizeof (trace_buffer_t));
+      if (! memory) return nullptr;
+      trace_buffer_t * buffer = new (memory) trace_buffer_t;
+      buffer->thread_name = nullptr;
+      buffer->tid = ++ trace_thread_count;
+      buffer->written.store (0, std::memory_order_relaxed);
+      buffer->next = trace_buffers.load (std::memory_order_relaxed);
+      while (! trace_buffers.compare_exchange_weak (buffer->next, buffer,
+          std::memory_order_release, std::memory_order_relaxed)) {
+        continue;
+      }
+      trace_buffer = buffer;
+    }
+    return trace_buffer;
+  }
+
+  void record (const char * name, std::uint64_t begin, std::uint64_t end,
+    double value)
+  {
+    if (trace_buffer_t * buffer = get_trace_buffer ()) {
+      std::uint64_t n = buffer->written.load (std::memory_order_relaxed);
+      buffer->events [n & (trace_capacity - 1)] = { name, begin, end, value };
+      buffer->written.store (n + 1, std::memory_order_release);
+    }
+  }
+}
+
+trace_scope_t::trace_scope_t (const char * name)
+  : name (name), begin (qpc ())
+{
+}
+
+trace_scope_t::~trace_scope_t ()
+{
+  record (name, begin, qpc (), 0.0);
+}
+
+void trace_counter (const char * name, double value)
+{
+  record (name, qpc (), counter_event, value);
+}
+
+void trace_thread_name (const char * name)
+{
+  if (trace_buffer_t * buffer = get_trace_buffer ()) {
+    buffer->thread_name = name;
+  }
+}
+
+bool trace_write (const char * filename)
+{
+  std::FILE * file = std::fopen (filename, "w");
+  if (! file) return false;
+
+  // Timestamps are in microseconds from the earliest retained event.
+  auto first = [] (trace_buffer_t * buffer) -> std::uint64_t {
+    std::uint64_t n = buffer->written.load (std::memory_order_acquire);
+    return n > trace_capacity ? n - trace_capacity : 0;
+  };
+  trace_buffer_t * head = trace_buffers.load (std::memory_order_acquire);
+  std::uint64_t t0 = ~ std::uint64_t (0);
+  for (trace_buffer_t * buffer = head; buffer; buffer = buffer->next) {
+    std::uint64_t n = buffer->written.load (std::memory_order_acquire);
+    for (std::uint64_t i = first (buffer); i != n; ++ i) {
+      std::uint64_t begin = buffer->events [i & (trace_capacity - 1)].begin;
+      if (t0 > begin) t0 = begin;
+    }
+  }
+  double scale = 1.0e6 / qpf ();
+
+  const char * separator = "\n";
+  std::fprintf (file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (trace_buffer_t * buffer = head; buffer; buffer = buffer->next) {
+    const char * thread_name = buffer->thread_name;
+    std::fprintf (file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+      "\"tid\":%u,\"args\":{\"name\":\"%s\"}}", separator, buffer->tid,
+      thread_name ? thread_name : "thread");
+    separator = ",\n";
+    std::uint64_t n = buffer->written.load (std::memory_order_acquire);
+    for (std::uint64_t i = first (buffer); i != n; ++ i) {
+      const trace_event_t & e = buffer->events [i & (trace_capacity - 1)];
+      if (e.end == counter_event) {
+        std::fprintf (file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+          "\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%.9g}}", e.name,
+          buffer->tid, scale * (e.begin - t0), e.value);
+        continue;
+      }
+      std::fprintf (file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+        "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", e.name, buffer->tid,
+        scale * (e.begin - t0), scale * (e.end - e.begin));
+    }
+  }
+  std::fprintf (file, "\n]}\n");
+  return std::fclose (file) == 0;
+}
+
+#endif
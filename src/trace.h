@@ -0,0 +1,75 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef trace_h
+#define trace_h
+
+//#define ENABLE_TRACE
+
+#if defined (ENABLE_TRACE) && ! defined (TINY)
+#define TRACE_ENABLED 1
+#else
+#define TRACE_ENABLED 0
+#endif
+
+// Timeline tracing.
+
+// TRACE_SCOPE (name) records a "complete" event spanning the rest of the
+// enclosing block. TRACE_COUNTER (name, value) records the value of a counter
+// (shown as a graph). The name must be a string literal (only the pointer is
+// stored). Each thread records into its own buffer, which holds the most
+// recent trace_capacity events of that thread; no locks are taken and
+// nothing is allocated after a thread's first event.
+
+// trace_write writes every thread's events to a file in the Chrome Trace
+// Event format, which Perfetto (ui.perfetto.dev) and chrome://tracing can
+// open. Call it when the recording threads are quiescent.
+
+// When tracing is disabled the macros expand to nothing.
+
+#if TRACE_ENABLED
+#include <cstdint>
+
+struct trace_scope_t
+{
+  trace_scope_t (const char * name);
+  ~trace_scope_t ();
+private:
+  const char * name;
+  std::uint64_t begin;
+  trace_scope_t (const trace_scope_t &) = delete;
+  trace_scope_t & operator = (const trace_scope_t &) = delete;
+};
+
+void trace_counter (const char * name, double value);
+void trace_thread_name (const char * name);
+bool trace_write (const char * filename);
+
+#define TRACE_CONCAT0(a, b) a ## b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT0 (a, b)
+#define TRACE_SCOPE(name) \
+  trace_scope_t TRACE_CONCAT (trace_scope_, __LINE__) (name)
+#define TRACE_COUNTER(name, value) trace_counter (name, value)
+#define TRACE_THREAD_NAME(name) trace_thread_name (name)
+#define TRACE_WRITE(filename) trace_write (filename)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_WRITE(filename)
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "workers.h"
+
+#ifndef TINY
+
+#include "trace.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+
+struct workers_state_t
+{
+  std::mutex mutex;
+  std::condition_variable go;    // The owner has begun a job, or is stopping.
+  std::condition_variable done;  // The last part has finished.
+  std::uint64_t generation;      // Jobs begun.
+  worker_job_t job;
+  void * context;
+  unsigned parts;
+  unsigned finished;             // Parts finished, of parts 1 to parts - 1.
+  bool stopping;
+  std::thread * threads;
+
+  void loop (unsigned part);
+};
+
+void workers_state_t::loop (unsigned part)
+{
+  TRACE_THREAD_NAME ("worker");
+  std::uint64_t seen = 0;
+  for (;;) {
+    worker_job_t j;
+    void * c;
+    unsigned n;
+    {
+      std::unique_lock <std::mutex> lock (mutex);
+      go.wait (lock, [&] { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+      j = job;
+      c = context;
+      n = parts;
+    }
+    if (part < n) {
+      j (c, part, n);
+      std::lock_guard <std::mutex> lock (mutex);
+      if (++ finished == n - 1) done.notify_one ();
+    }
+  }
+}
+
+bool workers_t::start (unsigned n)
+{
+  stop ();
+  if (! n) return true;
+  state = new (std::nothrow) workers_state_t ();
+  if (! state) return false;
+  state->threads = new (std::nothrow) std::thread [n];
+  if (! state->threads) {
+    delete state;
+    state = nullptr;
+    return false;
+  }
+  for (unsigned t = 0; t != n; ++ t) {
+    state->threads [t] = std::thread (& workers_state_t::loop, state, t + 1);
+  }
+  threads = n;
+  return true;
+}
+
+void workers_t::stop ()
+{
+  if (! state) return;
+  {
+    std::lock_guard <std::mutex> lock (state->mutex);
+    state->stopping = true;
+  }
+  state->go.notify_all ();
+  for (unsigned t = 0; t != threads; ++ t) state->threads [t].join ();
+  delete [] state->threads;
+  delete state;
+  state = nullptr;
+  threads = 0;
+}
+
+void workers_t::begin (worker_job_t job, void * context, unsigned parts)
+{
+  {
+    std::lock_guard <std::mutex> lock (state->mutex);
+    state->job = job;
+    state->context = context;
+    state->parts = parts;
+    state->finished = 0;
+    ++ state->generation;
+  }
+  state->go.notify_all ();
+}
+
+void workers_t::wait ()
+{
+  std::unique_lock <std::mutex> lock (state->mutex);
+  state->done.wait (lock,
+    [this] { return state->finished == state->parts - 1; });
+}
+
+#endif
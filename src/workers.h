@@ -0,0 +1,58 @@
+// -*- C++ -*-
+
+// Copyright 2012-2019 Richard Copley
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef workers_h
+#define workers_h
+
+// A fixed set of threads, started once, that split a job with their owner.
+
+// Starting threads every frame costs a heap allocation per thread (which
+// the memory statistics do not see) and leaves per-thread state behind:
+// each new thread opens its own perf counters and trace buffer. The
+// model's fill stage (see model_t::render) instead starts its workers with
+// the graphics and wakes them each frame. Not in the tiny build.
+
+#ifndef TINY
+
+struct workers_state_t;
+
+// A job: do part "part" of "parts" (0 <= part < parts).
+typedef void (* worker_job_t) (void * context, unsigned part, unsigned parts);
+
+struct workers_t
+{
+  workers_t () = default;
+  workers_t (const workers_t &) = delete;
+  workers_t & operator = (const workers_t &) = delete;
+  ~workers_t () { stop (); }
+
+  // Start n threads. Returns false on failure (and starts none).
+  bool start (unsigned n);
+  void stop ();
+  unsigned count () const { return threads; }
+
+  // Run parts 1, ..., parts - 1 of the job on the threads (parts is at most
+  // count () + 1); the caller does part 0 itself, then calls wait.
+  void begin (worker_job_t job, void * context, unsigned parts);
+  void wait ();
+
+  workers_state_t * state;
+  unsigned threads;
+};
+
+#endif
+
+#endif